@@ -0,0 +1,655 @@
+#include "AllocationTracking.h"
+#include "Bvh.h"
+#include "FrameArena.h"
+#include "MlpPolicy.h"
+#include "PaddleController.h"
+#include "Replay.h"
+#include "Snapshot.h"
+#include "SnapshotDelta.h"
+#include "SweepAndPrune.h"
+#include "VectorEnv.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct Box {
+    glm::vec2 min;
+    glm::vec2 max;
+};
+
+bool overlaps(const Box& a, const Box& b) {
+    return (a.min.x <= b.max.x && a.max.x >= b.min.x) &&
+        (a.min.y <= b.max.y && a.max.y >= b.min.y);
+}
+
+template <typename Function>
+double measureMicroseconds(Function function) {
+    auto start = std::chrono::high_resolution_clock::now();
+    function();
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count();
+}
+
+// Static bricks spread at constant density against moving balls, comparing
+// a brute force test of every pair against the incremental sweep and prune
+void benchSweepAndPrune() {
+    const std::uint32_t BallCount = 256;
+    const std::uint32_t TickCount = 20;
+    const float TickTime = 1.0 / 60.0;
+    const float BallSpeed = 400.0;
+    const glm::vec2 BrickHalfExtents = glm::vec2(10.0, 5.0);
+    const glm::vec2 BallHalfExtents = glm::vec2(5.0, 5.0);
+
+    std::printf("Sweep and prune, %u moving balls, average per tick\n", BallCount);
+    std::printf("%12s %16s %16s %12s\n", "obstacles", "brute force us", "sweep prune us", "pairs");
+
+    for (std::uint32_t obstacleCount : {10u, 1000u, 50000u}) {
+        std::mt19937 engine(1);
+        float side = std::sqrt(static_cast<float>(obstacleCount + BallCount)) * 40.0f;
+        std::uniform_real_distribution<float> coordinate(0.0f, side);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+
+        std::vector<Box> obstacles;
+        SweepAndPrune broadphase;
+        for (std::uint32_t i = 0; i < obstacleCount; i++) {
+            glm::vec2 center(coordinate(engine), coordinate(engine));
+            obstacles.push_back({center - BrickHalfExtents, center + BrickHalfExtents});
+            broadphase.add(obstacles.back().min, obstacles.back().max, 0);
+        }
+
+        std::vector<glm::vec2> ballPositions;
+        std::vector<glm::vec2> ballVelocities;
+        std::vector<std::uint32_t> ballProxies;
+        for (std::uint32_t i = 0; i < BallCount; i++) {
+            glm::vec2 center(coordinate(engine), coordinate(engine));
+            float a = angle(engine);
+            ballPositions.push_back(center);
+            ballVelocities.push_back(glm::vec2(std::cos(a), std::sin(a)) * BallSpeed);
+            ballProxies.push_back(broadphase.add(center - BallHalfExtents, center + BallHalfExtents, 1));
+        }
+
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+        broadphase.findPairs(pairs);
+
+        double bruteForceTime = 0.0;
+        double sweepTime = 0.0;
+        std::uint64_t bruteForcePairs = 0;
+        std::uint64_t sweepPairs = 0;
+
+        for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+            for (std::uint32_t i = 0; i < BallCount; i++) {
+                glm::vec2& position = ballPositions[i];
+                position += ballVelocities[i] * TickTime;
+                if (position.x < 0.0f || position.x > side) {
+                    ballVelocities[i].x = -ballVelocities[i].x;
+                }
+                if (position.y < 0.0f || position.y > side) {
+                    ballVelocities[i].y = -ballVelocities[i].y;
+                }
+            }
+
+            bruteForceTime += measureMicroseconds([&]() {
+                for (std::uint32_t i = 0; i < BallCount; i++) {
+                    Box ball {ballPositions[i] - BallHalfExtents, ballPositions[i] + BallHalfExtents};
+                    for (const Box& obstacle : obstacles) {
+                        bruteForcePairs += overlaps(obstacle, ball);
+                    }
+                }
+            });
+
+            sweepTime += measureMicroseconds([&]() {
+                for (std::uint32_t i = 0; i < BallCount; i++) {
+                    broadphase.update(
+                        ballProxies[i],
+                        ballPositions[i] - BallHalfExtents,
+                        ballPositions[i] + BallHalfExtents);
+                }
+                broadphase.findPairs(pairs);
+            });
+            sweepPairs += pairs.size();
+        }
+
+        std::printf("%12u %16.1f %16.1f %12llu%s\n",
+            obstacleCount,
+            bruteForceTime / TickCount,
+            sweepTime / TickCount,
+            static_cast<unsigned long long>(sweepPairs),
+            sweepPairs == bruteForcePairs ? "" : " MISMATCH");
+    }
+    std::printf("\n");
+}
+
+// Queries against a static hierarchy of bricks, as issued by AI and continuous collision
+void benchBvh() {
+    const std::uint32_t QueryCount = 10000;
+    const glm::vec2 BrickHalfExtents = glm::vec2(10.0, 5.0);
+    const glm::vec2 BallHalfExtents = glm::vec2(5.0, 5.0);
+
+    std::printf("Static BVH, %u queries of each kind, average per query\n", QueryCount);
+    std::printf("%12s %12s %12s %12s %12s %12s\n", "obstacles", "build us", "overlap ns", "ray ns", "sweep ns", "hits");
+
+    for (std::uint32_t obstacleCount : {10u, 1000u, 50000u}) {
+        std::mt19937 engine(1);
+        float side = std::sqrt(static_cast<float>(obstacleCount)) * 40.0f;
+        std::uniform_real_distribution<float> coordinate(0.0f, side);
+        std::uniform_real_distribution<float> offset(-200.0f, 200.0f);
+
+        std::vector<BvhBox> boxes;
+        for (std::uint32_t i = 0; i < obstacleCount; i++) {
+            glm::vec2 center(coordinate(engine), coordinate(engine));
+            boxes.push_back({center - BrickHalfExtents, center + BrickHalfExtents});
+        }
+
+        std::vector<glm::vec2> origins;
+        std::vector<glm::vec2> displacements;
+        for (std::uint32_t i = 0; i < QueryCount; i++) {
+            origins.push_back(glm::vec2(coordinate(engine), coordinate(engine)));
+            displacements.push_back(glm::vec2(offset(engine), offset(engine)));
+        }
+
+        Bvh bvh;
+        double buildTime = measureMicroseconds([&]() {
+            bvh.build(boxes);
+        });
+
+        std::uint64_t hits = 0;
+        double overlapTime = measureMicroseconds([&]() {
+            for (const glm::vec2& origin : origins) {
+                bvh.queryOverlap(origin - BallHalfExtents, origin + BallHalfExtents, [&](std::uint32_t) {
+                    hits++;
+                });
+            }
+        });
+
+        double rayTime = measureMicroseconds([&]() {
+            for (std::uint32_t i = 0; i < QueryCount; i++) {
+                BvhHit hit;
+                hits += bvh.raycast(origins[i], glm::normalize(displacements[i]), 200.0f, hit);
+            }
+        });
+
+        double sweepTime = measureMicroseconds([&]() {
+            for (std::uint32_t i = 0; i < QueryCount; i++) {
+                BvhHit hit;
+                hits += bvh.sweep(BallHalfExtents, origins[i], displacements[i], hit);
+            }
+        });
+
+        std::printf("%12u %12.1f %12.1f %12.1f %12.1f %12llu\n",
+            obstacleCount,
+            buildTime,
+            overlapTime * 1000.0 / QueryCount,
+            rayTime * 1000.0 / QueryCount,
+            sweepTime * 1000.0 / QueryCount,
+            static_cast<unsigned long long>(hits));
+    }
+    std::printf("\n");
+}
+
+// One decision for each of many matches, comparing a scalar controller per match
+// against the stateless batched form of the same policy
+void benchControllers() {
+    const std::uint32_t TickCount = 100;
+
+    PaddleField field;
+    field.paddleX = 500.0;
+    field.paddleFaceX = 485.0;
+    field.ballMinY = -325.0;
+    field.ballMaxY = 325.0;
+
+    std::printf("Paddle controllers, average per tick\n");
+    std::printf("%12s %12s %12s\n", "matches", "scalar us", "batch us");
+
+    for (std::uint32_t matchCount : {64u, 4096u, 65536u}) {
+        std::mt19937 engine(1);
+        std::uniform_real_distribution<float> x(-480.0f, 480.0f);
+        std::uniform_real_distribution<float> y(-300.0f, 300.0f);
+        std::uniform_real_distribution<float> velocity(-400.0f, 400.0f);
+
+        std::vector<float> observations(PaddleObservationSize * matchCount);
+        for (std::uint32_t i = 0; i < matchCount; i++) {
+            observations[i] = x(engine);
+            observations[matchCount + i] = y(engine);
+            observations[matchCount * 2 + i] = velocity(engine);
+            observations[matchCount * 3 + i] = velocity(engine);
+            observations[matchCount * 4 + i] = y(engine);
+            observations[matchCount * 5 + i] = y(engine);
+        }
+        auto batch = PaddleObservationBatch::fromBuffer(observations.data(), matchCount);
+
+        std::vector<std::shared_ptr<PaddleController>> controllers;
+        for (std::uint32_t i = 0; i < matchCount; i++) {
+            controllers.push_back(std::make_shared<StateMachineController>(field, true));
+        }
+        ScalarControllerBatch scalar(controllers);
+        InterceptBatchController batched(field);
+
+        std::vector<float> scalarActions(matchCount);
+        std::vector<float> batchActions(matchCount);
+
+        double scalarTime = measureMicroseconds([&]() {
+            for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+                scalar.act(batch, scalarActions.data());
+            }
+        });
+
+        double batchTime = measureMicroseconds([&]() {
+            for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+                batched.act(batch, batchActions.data());
+            }
+        });
+
+        std::printf("%12u %12.1f %12.1f\n",
+            matchCount,
+            scalarTime / TickCount,
+            batchTime / TickCount);
+    }
+    std::printf("\n");
+}
+
+// Environment steps per second for a batch of matches with the agent tracking the ball
+void benchVectorEnv() {
+    const std::uint32_t StepCount = 1000;
+    const std::size_t EnvCount = 4096;
+
+    std::printf("Vector environment, %zu matches, %u steps\n", EnvCount, StepCount);
+    std::printf("%12s %12s %16s\n", "threads", "step us", "env steps/s");
+
+    std::size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t threadCount : {static_cast<std::size_t>(1), hardwareThreads}) {
+        VectorEnv env(EnvCount, threadCount);
+
+        std::vector<std::uint64_t> seeds(EnvCount);
+        for (std::size_t i = 0; i < EnvCount; i++) {
+            seeds[i] = i;
+        }
+
+        std::vector<float> observations(PaddleObservationSize * EnvCount);
+        std::vector<float> actions(EnvCount);
+        std::vector<float> rewards(EnvCount);
+        std::vector<std::uint8_t> dones(EnvCount);
+        env.reset(seeds.data(), observations.data());
+
+        auto batch = PaddleObservationBatch::fromBuffer(observations.data(), EnvCount);
+        double time = measureMicroseconds([&]() {
+            for (std::uint32_t step = 0; step < StepCount; step++) {
+                for (std::size_t i = 0; i < EnvCount; i++) {
+                    actions[i] = steerTowards(batch.ballY[i], batch.paddleY[i], BallToleranceY);
+                }
+                env.step(actions.data(), observations.data(), rewards.data(), dones.data());
+            }
+        });
+
+        std::printf("%12zu %12.1f %16.0f\n",
+            threadCount,
+            time / StepCount,
+            EnvCount * StepCount / (time * 1e-6));
+
+        if (hardwareThreads == 1) {
+            break;
+        }
+    }
+    std::printf("\n");
+}
+
+// Inference for one batch of observations through networks of growing width
+void benchMlpPolicy() {
+    const std::uint32_t RepeatCount = 200;
+    const std::size_t BatchSize = 4096;
+
+    std::printf("MLP policy, batch of %zu, average per batch, %s kernels available\n",
+        BatchSize,
+        mlpAvx2Supported() ? "AVX2" : "no SIMD");
+    std::printf("%12s %12s %12s %12s\n", "hidden", "scalar us", "simd us", "max error");
+
+    std::mt19937 engine(1);
+    std::uniform_real_distribution<float> observation(-400.0f, 400.0f);
+    std::vector<float> observations(PaddleObservationSize * BatchSize);
+    for (float& value : observations) {
+        value = observation(engine);
+    }
+    auto batch = PaddleObservationBatch::fromBuffer(observations.data(), BatchSize);
+
+    for (std::uint32_t width : {16u, 32u, 64u}) {
+        std::uniform_real_distribution<float> weight(-0.1f, 0.1f);
+        std::vector<MlpLayer> layers;
+        std::uint32_t inputCount = PaddleObservationSize;
+        for (std::uint32_t outputCount : {width, width, 1u}) {
+            MlpLayer layer;
+            layer.inputCount = inputCount;
+            layer.outputCount = outputCount;
+            for (std::uint32_t i = 0; i < inputCount * outputCount; i++) {
+                layer.weights.push_back(weight(engine) / std::sqrt(static_cast<float>(inputCount)));
+            }
+            layer.biases.assign(outputCount, 0.0f);
+            layers.push_back(layer);
+            inputCount = outputCount;
+        }
+
+        MlpPolicy policy(layers);
+        std::vector<float> scalarActions(BatchSize);
+        std::vector<float> simdActions(BatchSize);
+
+        policy.setSimd(false);
+        double scalarTime = measureMicroseconds([&]() {
+            for (std::uint32_t repeat = 0; repeat < RepeatCount; repeat++) {
+                policy.act(batch, scalarActions.data());
+            }
+        });
+
+        policy.setSimd(true);
+        double simdTime = measureMicroseconds([&]() {
+            for (std::uint32_t repeat = 0; repeat < RepeatCount; repeat++) {
+                policy.act(batch, simdActions.data());
+            }
+        });
+
+        float maxError = 0.0;
+        for (std::size_t i = 0; i < BatchSize; i++) {
+            maxError = std::max(maxError, std::abs(scalarActions[i] - simdActions[i]));
+        }
+
+        std::printf("%12u %12.1f %12.1f %12g\n",
+            width,
+            scalarTime / RepeatCount,
+            simdTime / RepeatCount,
+            maxError);
+    }
+    std::printf("\n");
+}
+
+// An hour of a headless match at 120 ticks per second, seeking to random ticks by
+// restoring the nearest keyframe and stepping on from it
+void benchReplaySeek() {
+    const std::uint32_t TickCount = 60 * 60 * 120;
+    const std::uint32_t SeekCount = 1000;
+    const float TickTime = 1.0 / 120.0;
+
+    std::printf("Replay seek, %u ticks recorded, average per seek\n", TickCount);
+    std::printf("%12s %12s %12s %12s\n", "interval", "file KiB", "seek us", "worst us");
+
+    PaddleField field = matchField();
+    std::mt19937 engine(1);
+    std::uniform_int_distribution<std::uint32_t> targets(0, TickCount - 1);
+
+    for (std::uint32_t interval : {120u, 240u, 960u}) {
+        TrackingController left;
+        StateMachineController right(field, true);
+        ReplayRecorder recorder(ReplayHeader {1, 1, TickTime});
+
+        MatchState match;
+        resetMatch(match, 1);
+        for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+            if (tick % interval == 0) {
+                recorder.addKeyframe(tick, &match, sizeof(match));
+            }
+            float leftAction = left.act(observeMatch(match, PaddleSide::Left));
+            float rightAction = right.act(observeMatch(match, PaddleSide::Right));
+            recorder.record(tick, leftAction, rightAction);
+            stepMatch(match, leftAction, rightAction, TickTime);
+        }
+
+        std::vector<std::uint8_t> bytes = recorder.finish(TickCount, 0);
+        ReplayPlayer player;
+        player.parse(bytes);
+
+        double total = 0.0;
+        double worst = 0.0;
+        for (std::uint32_t i = 0; i < SeekCount; i++) {
+            std::uint32_t target = targets(engine);
+            MatchState seeked;
+            double time = measureMicroseconds([&]() {
+                const ReplayKeyframe* keyframe = player.seek(target);
+                std::memcpy(&seeked, player.keyframeState(*keyframe), sizeof(seeked));
+                while (seeked.tick < target) {
+                    float leftAction;
+                    float rightAction;
+                    player.actionsAt(seeked.tick, leftAction, rightAction);
+                    stepMatch(seeked, leftAction, rightAction, TickTime);
+                }
+            });
+            total += time;
+            worst = std::max(worst, time);
+        }
+
+        std::printf("%12u %12.1f %12.2f %12.2f\n",
+            interval,
+            bytes.size() / 1024.0,
+            total / SeekCount,
+            worst);
+    }
+    std::printf("\n");
+}
+
+// Saving and restoring the bodies of a game, as the game does between its world and a
+// GameSnapshot
+void benchSnapshots() {
+    const std::uint32_t RepeatCount = 1000;
+
+    std::printf("Game snapshots, average per snapshot\n");
+    std::printf("%12s %12s %12s %12s\n", "balls", "bytes", "save us", "restore us");
+
+    for (std::uint32_t ballCount : {1u, 1000u, 100000u}) {
+        std::uint32_t bodyCount = ballCount + 4;
+        std::vector<Transform> transforms(bodyCount);
+        std::vector<Velocity> velocities(bodyCount);
+        GameSnapshot snapshot;
+
+        double saveTime = measureMicroseconds([&]() {
+            for (std::uint32_t repeat = 0; repeat < RepeatCount; repeat++) {
+                GameSnapshotHeader& header = snapshot.reset(bodyCount, bodyCount);
+                header.tick = repeat;
+                std::memcpy(snapshot.transforms(), transforms.data(), bodyCount * sizeof(Transform));
+                std::memcpy(snapshot.velocities(), velocities.data(), bodyCount * sizeof(Velocity));
+            }
+        });
+
+        double restoreTime = measureMicroseconds([&]() {
+            for (std::uint32_t repeat = 0; repeat < RepeatCount; repeat++) {
+                std::memcpy(transforms.data(), snapshot.transforms(), bodyCount * sizeof(Transform));
+                std::memcpy(velocities.data(), snapshot.velocities(), bodyCount * sizeof(Velocity));
+            }
+        });
+
+        std::printf("%12u %12zu %12.3f %12.3f\n",
+            ballCount,
+            snapshot.size(),
+            saveTime / RepeatCount,
+            restoreTime / RepeatCount);
+    }
+    std::printf("\n");
+}
+
+void benchSnapshotDeltas() {
+    const std::uint32_t TickCount = 100000;
+    const std::uint32_t TickRate = 60;
+
+    // A long match between two ball followers, one snapshot per tick
+    MatchState match;
+    resetMatch(match, 1);
+    std::vector<QuantizedMatch> snapshots;
+    snapshots.push_back(quantizeMatch(match));
+    for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+        PaddleObservation left = observeMatch(match, PaddleSide::Left);
+        PaddleObservation right = observeMatch(match, PaddleSide::Right);
+        stepMatch(match,
+            static_cast<float>(steerTowards(left.ballPosition.y, left.paddleY, BallToleranceY)),
+            static_cast<float>(steerTowards(right.ballPosition.y, right.paddleY, BallToleranceY)),
+            1.0f / TickRate);
+        snapshots.push_back(quantizeMatch(match));
+    }
+
+    DeltaSnapshotCodec codec(TickRate);
+    std::vector<std::uint8_t> bytes(snapshots.size() * MaxDeltaSnapshotSize);
+    std::vector<std::size_t> sizes(snapshots.size());
+
+    std::printf("Delta snapshots of %u ticks\n", TickCount);
+    std::printf("%12s %12s %12s %12s\n", "baseline", "bytes", "encode M/s", "decode M/s");
+
+    // Age 0 encodes against nothing, the others against the snapshot that many ticks back
+    for (std::uint32_t age : {0u, 1u, 4u, 16u}) {
+        std::uint32_t first = std::max(age, 1u);
+        std::size_t totalSize = 0;
+
+        double encodeTime = measureMicroseconds([&]() {
+            for (std::uint32_t i = first; i < snapshots.size(); i++) {
+                const QuantizedMatch* baseline = age > 0 ? &snapshots[i - age] : nullptr;
+                sizes[i] = codec.encode(snapshots[i], baseline, &bytes[i * MaxDeltaSnapshotSize]);
+                totalSize += sizes[i];
+            }
+        });
+
+        std::uint32_t mismatches = 0;
+        double decodeTime = measureMicroseconds([&]() {
+            QuantizedMatch decoded;
+            for (std::uint32_t i = first; i < snapshots.size(); i++) {
+                const QuantizedMatch* baseline = age > 0 ? &snapshots[i - age] : nullptr;
+                codec.decode(&bytes[i * MaxDeltaSnapshotSize], sizes[i], baseline, decoded);
+                mismatches += decoded.ballX != snapshots[i].ballX;
+            }
+        });
+
+        std::uint32_t count = static_cast<std::uint32_t>(snapshots.size()) - first;
+        std::printf("%12s %12.2f %12.1f %12.1f\n",
+            age == 0 ? "none" : std::to_string(age).c_str(),
+            static_cast<double>(totalSize) / count,
+            count / encodeTime,
+            count / decodeTime);
+        if (mismatches > 0) {
+            std::printf("%u snapshots did not decode\n", mismatches);
+        }
+    }
+    std::printf("\n");
+}
+
+// Scratch data of a tick as the game has it, ball positions and broadphase pairs, from fresh
+// heap vectors, from vectors kept across ticks and from a frame arena
+void benchFrameScratch() {
+    const std::uint32_t BallCount = 4096;
+    const std::uint32_t ObstacleCount = 256;
+    const std::uint32_t TickCount = 2000;
+    const float TickTime = 1.0 / 120.0;
+    const float BallSpeed = 400.0;
+    const glm::vec2 HalfExtents = glm::vec2(5.0, 5.0);
+
+    std::printf("Per tick scratch, %u balls, %u obstacles, per tick%s\n",
+        BallCount, ObstacleCount, AllocationTrackingEnabled ? "" : " (allocations not tracked)");
+    std::printf("%12s %12s %12s %12s\n", "scratch", "average us", "p99 us", "allocations");
+
+    using Pair = std::pair<std::uint32_t, std::uint32_t>;
+    FrameArena arena(1 << 20);
+    std::vector<glm::vec2> keptPositions;
+    std::vector<Pair> keptPairs;
+
+    for (const char* mode : {"heap", "kept", "arena"}) {
+        std::mt19937 engine(1);
+        float side = std::sqrt(static_cast<float>(BallCount + ObstacleCount)) * 40.0f;
+        std::uniform_real_distribution<float> coordinate(0.0f, side);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+
+        SweepAndPrune broadphase;
+        for (std::uint32_t i = 0; i < ObstacleCount; i++) {
+            glm::vec2 center(coordinate(engine), coordinate(engine));
+            broadphase.add(center - HalfExtents, center + HalfExtents, 0);
+        }
+        std::vector<glm::vec2> positions;
+        std::vector<glm::vec2> velocities;
+        for (std::uint32_t i = 0; i < BallCount; i++) {
+            glm::vec2 center(coordinate(engine), coordinate(engine));
+            float a = angle(engine);
+            positions.push_back(center);
+            velocities.push_back(glm::vec2(std::cos(a), std::sin(a)) * BallSpeed);
+            broadphase.add(center - HalfExtents, center + HalfExtents, 1);
+        }
+
+        std::vector<double> times;
+        times.reserve(TickCount);
+        AllocationWatch allocations;
+        std::uint64_t pairCount = 0;
+
+        for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+            for (std::uint32_t i = 0; i < BallCount; i++) {
+                positions[i] += velocities[i] * TickTime;
+                if (positions[i].x < 0.0f || positions[i].x > side) {
+                    velocities[i].x = -velocities[i].x;
+                }
+                if (positions[i].y < 0.0f || positions[i].y > side) {
+                    velocities[i].y = -velocities[i].y;
+                }
+            }
+
+            // Allocation counts are reset after the first tick, which warms up the kept vectors
+            if (tick == 1) {
+                allocations.restart();
+            }
+
+            auto fill = [&](auto& scratchPositions, auto& pairs) {
+                scratchPositions.resize(BallCount);
+                for (std::uint32_t i = 0; i < BallCount; i++) {
+                    scratchPositions[i] = positions[i];
+                    broadphase.update(ObstacleCount + i, positions[i] - HalfExtents, positions[i] + HalfExtents);
+                }
+                broadphase.findPairs(pairs);
+                pairCount += pairs.size();
+            };
+
+            times.push_back(measureMicroseconds([&]() {
+                if (std::strcmp(mode, "heap") == 0) {
+                    std::vector<glm::vec2> scratchPositions;
+                    std::vector<Pair> pairs;
+                    fill(scratchPositions, pairs);
+                } else if (std::strcmp(mode, "kept") == 0) {
+                    fill(keptPositions, keptPairs);
+                } else {
+                    ArenaScope scratch(arena);
+                    ArenaVector<glm::vec2> scratchPositions {ArenaAllocator<glm::vec2>(arena)};
+                    ArenaVector<Pair> pairs {ArenaAllocator<Pair>(arena)};
+                    pairs.reserve(BallCount);
+                    fill(scratchPositions, pairs);
+                }
+            }));
+        }
+
+        std::uint64_t tickAllocations = allocations.count();
+        double average = std::accumulate(times.begin(), times.end(), 0.0) / TickCount;
+        std::sort(times.begin(), times.end());
+        std::printf("%12s %12.1f %12.1f %12.2f\n",
+            mode,
+            average,
+            times[TickCount * 99 / 100],
+            static_cast<double>(tickAllocations) / (TickCount - 1));
+        if (pairCount == 0) {
+            std::printf("no pairs found\n");
+        }
+    }
+    std::printf("arena high water %zu of %zu bytes, %llu overflows\n\n",
+        arena.getHighWater(),
+        arena.getCapacity(),
+        static_cast<unsigned long long>(arena.getOverflows()));
+}
+
+int main() {
+    benchSweepAndPrune();
+    benchBvh();
+    benchControllers();
+    benchVectorEnv();
+    benchMlpPolicy();
+    benchReplaySeek();
+    benchSnapshots();
+    benchSnapshotDeltas();
+    benchFrameScratch();
+    return 0;
+}
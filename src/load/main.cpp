@@ -0,0 +1,237 @@
+#include "Match.h"
+#include "MatchServer.h"
+#include "Network.h"
+#include "PaddleController.h"
+#include "SnapshotDelta.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+void printUsage() {
+    std::printf("Usage: pong-load [--matches N] [--shards N] [--port N] [--host ADDRESS] [--threads N] [--rate N] [--server-rate N] [--seconds N]\n");
+    std::printf("Plays both sides of N matches on a pong-server, following the ball as it is seen.\n");
+}
+
+struct LoadSettings {
+    std::uint32_t matchCount = 1000;
+    std::uint32_t shardCount = 1;
+    std::uint32_t basePort = 7700;
+    std::uint32_t host = INADDR_LOOPBACK;
+    std::uint32_t threadCount = 1;
+    std::uint32_t inputRate = 60;
+    std::uint32_t serverTickRate = 60;
+    std::uint32_t seconds = 10;
+};
+
+struct alignas(64) LoadStats {
+    std::atomic<std::uint64_t> sent {0};
+    std::atomic<std::uint64_t> received {0};
+    std::atomic<std::uint64_t> receivedBytes {0};
+    std::atomic<std::uint64_t> skippedTicks {0};
+    std::atomic<std::uint64_t> undecodable {0};
+};
+
+// Plays the matches with index % threadCount == thread from one socket. States for both
+// sides arrive on it, the match index in each state tells them apart.
+void play(std::uint32_t thread, const LoadSettings& settings, const std::atomic<bool>& running, LoadStats& stats) {
+    UdpSocket socket;
+    if (!socket.open(0, INADDR_ANY)) {
+        std::fprintf(stderr, "Could not open a client socket\n");
+        return;
+    }
+    socket.setBufferSizes(SocketBufferSize);
+
+    std::vector<std::uint32_t> indices;
+    for (std::uint32_t index = thread; index < settings.matchCount; index += settings.threadCount) {
+        indices.push_back(index);
+    }
+
+    // What each match looked like in the last state received and the states the deltas
+    // are against, by index / threadCount. Both sides of a match share the history.
+    std::vector<MatchState> views(indices.size());
+    std::vector<SnapshotHistory> histories(indices.size());
+    DeltaSnapshotCodec codec(settings.serverTickRate);
+    std::vector<sockaddr_in> shardAddresses;
+    for (std::uint32_t shard = 0; shard < settings.shardCount; shard++) {
+        shardAddresses.push_back(UdpSocket::makeAddress(settings.host, settings.basePort + shard));
+    }
+
+    DatagramBatch incoming;
+    DatagramBatch outgoing;
+    auto period = std::chrono::nanoseconds(1000000000 / settings.inputRate);
+    auto next = std::chrono::steady_clock::now();
+
+    while (running.load(std::memory_order_relaxed)) {
+        while (std::size_t count = incoming.receive(socket)) {
+            std::uint64_t bytes = 0;
+            std::uint64_t undecodable = 0;
+            for (std::size_t i = 0; i < count; i++) {
+                bytes += incoming[i].size;
+                std::uint32_t index;
+                if (!decodeServerStateMatch(incoming[i].bytes, incoming[i].size, index) ||
+                    index >= settings.matchCount ||
+                    index % settings.threadCount != thread) {
+                    continue;
+                }
+
+                QuantizedMatch state;
+                std::uint32_t slot = index / settings.threadCount;
+                if (!decodeServerState(incoming[i].bytes, incoming[i].size, codec, histories[slot], state)) {
+                    undecodable++;
+                    continue;
+                }
+
+                // Both sides get every state, only count ticks missed since the newest
+                MatchState& view = views[slot];
+                if (view.tick > 0 && state.tick > view.tick + 1) {
+                    stats.skippedTicks.fetch_add(state.tick - view.tick - 1, std::memory_order_relaxed);
+                }
+                if (state.tick > view.tick) {
+                    dequantizeMatch(state, view);
+                }
+            }
+            stats.received.fetch_add(count, std::memory_order_relaxed);
+            stats.receivedBytes.fetch_add(bytes, std::memory_order_relaxed);
+            stats.undecodable.fetch_add(undecodable, std::memory_order_relaxed);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now < next) {
+            socket.wait(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count()));
+            continue;
+        }
+        next += period;
+
+        std::uint64_t sent = 0;
+        for (std::size_t i = 0; i < indices.size(); i++) {
+            for (PaddleSide side : {PaddleSide::Left, PaddleSide::Right}) {
+                PaddleObservation observation = observeMatch(views[i], side);
+
+                ServerInput input;
+                input.match = indices[i];
+                input.side = side;
+                input.action = static_cast<std::int8_t>(
+                    steerTowards(observation.ballPosition.y, observation.paddleY, BallToleranceY));
+                input.acknowledgedTick = histories[i].getNewest();
+
+                if (outgoing.full()) {
+                    sent += outgoing.send(socket);
+                }
+                BatchDatagram& datagram = outgoing.add(shardAddresses[indices[i] % settings.shardCount]);
+                encodeServerInput(input, datagram.bytes);
+                datagram.size = ServerInputSize;
+            }
+        }
+        sent += outgoing.send(socket);
+        stats.sent.fetch_add(sent, std::memory_order_relaxed);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    LoadSettings settings;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (option == "--matches") {
+            settings.matchCount = std::max(1, std::stoi(value));
+        } else if (option == "--shards") {
+            settings.shardCount = std::max(1, std::stoi(value));
+        } else if (option == "--port") {
+            settings.basePort = std::stoi(value);
+        } else if (option == "--host") {
+            in_addr host;
+            if (inet_pton(AF_INET, value.c_str(), &host) != 1) {
+                printUsage();
+                return 1;
+            }
+            settings.host = ntohl(host.s_addr);
+        } else if (option == "--threads") {
+            settings.threadCount = std::max(1, std::stoi(value));
+        } else if (option == "--rate") {
+            settings.inputRate = std::max(1, std::stoi(value));
+        } else if (option == "--server-rate") {
+            settings.serverTickRate = std::max(1, std::stoi(value));
+        } else if (option == "--seconds") {
+            settings.seconds = std::max(1, std::stoi(value));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::printf("%u players in %u matches on %u threads, %u inputs/s each\n",
+        settings.matchCount * 2,
+        settings.matchCount,
+        settings.threadCount,
+        settings.inputRate);
+
+    std::atomic<bool> running {true};
+    std::vector<std::shared_ptr<LoadStats>> stats;
+    std::vector<std::thread> threads;
+    for (std::uint32_t thread = 0; thread < settings.threadCount; thread++) {
+        stats.push_back(std::make_shared<LoadStats>());
+        LoadStats* threadStats = stats.back().get();
+        threads.emplace_back([thread, &settings, &running, threadStats]() {
+            play(thread, settings, running, *threadStats);
+        });
+    }
+
+    std::uint64_t lastSent = 0;
+    std::uint64_t lastReceived = 0;
+    std::uint64_t lastBytes = 0;
+    std::uint64_t lastSkipped = 0;
+    std::uint64_t lastUndecodable = 0;
+    for (std::uint32_t second = 1; second <= settings.seconds; second++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::uint64_t sent = 0;
+        std::uint64_t received = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t skipped = 0;
+        std::uint64_t undecodable = 0;
+        for (const auto& threadStats : stats) {
+            sent += threadStats->sent.load(std::memory_order_relaxed);
+            received += threadStats->received.load(std::memory_order_relaxed);
+            bytes += threadStats->receivedBytes.load(std::memory_order_relaxed);
+            skipped += threadStats->skippedTicks.load(std::memory_order_relaxed);
+            undecodable += threadStats->undecodable.load(std::memory_order_relaxed);
+        }
+
+        std::uint64_t receivedDelta = received - lastReceived;
+        std::printf("%u s: %llu inputs sent, %llu states received, %.1f bytes each, %llu without baseline, %llu match ticks missed\n",
+            second,
+            static_cast<unsigned long long>(sent - lastSent),
+            static_cast<unsigned long long>(receivedDelta),
+            receivedDelta > 0 ? static_cast<double>(bytes - lastBytes) / receivedDelta : 0.0,
+            static_cast<unsigned long long>(undecodable - lastUndecodable),
+            static_cast<unsigned long long>(skipped - lastSkipped));
+        std::fflush(stdout);
+
+        lastSent = sent;
+        lastReceived = received;
+        lastBytes = bytes;
+        lastSkipped = skipped;
+        lastUndecodable = undecodable;
+    }
+
+    running.store(false);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef PONG_ALLOCATION_TRACKING_H
+#define PONG_ALLOCATION_TRACKING_H
+
+// Counts heap allocations when built with PONG_TRACK_ALLOCATIONS, by replacing the global
+// operator new and delete. Include it in exactly one translation unit of a program, which
+// every program here has anyway. Over-aligned allocations are not counted.
+//
+// Every block carries a small header with its size and memory tag, so freeing it is
+// credited to the tag it was charged to, whichever scope it is freed in.
+
+#include "MemoryTracker.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#if defined(PONG_TRACK_ALLOCATIONS)
+const bool AllocationTrackingEnabled = true;
+#else
+const bool AllocationTrackingEnabled = false;
+#endif
+
+// Counts for the whole program and for the calling thread, so a check on one thread is not
+// thrown off by another
+std::atomic<std::uint64_t> totalAllocationCount {0};
+std::atomic<std::uint64_t> totalAllocatedBytes {0};
+thread_local std::uint64_t threadAllocationCount = 0;
+
+// Allocations made by this thread since it was created
+class AllocationWatch {
+public:
+    AllocationWatch() :
+        start(threadAllocationCount) {
+    }
+
+    std::uint64_t count() const {
+        return threadAllocationCount - start;
+    }
+
+    void restart() {
+        start = threadAllocationCount;
+    }
+
+private:
+    std::uint64_t start;
+};
+
+#if defined(PONG_TRACK_ALLOCATIONS)
+
+// GCC sees these pair malloc with free once inlined into a caller of new and delete
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Keeps the default alignment of new for what follows it
+struct alignas(alignof(std::max_align_t)) AllocationHeader {
+    std::size_t size;
+    MemoryTag tag;
+};
+
+void* operator new(std::size_t size) {
+    threadAllocationCount++;
+    totalAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    totalAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* block = std::malloc(sizeof(AllocationHeader) + size)) {
+        AllocationHeader* header = static_cast<AllocationHeader*>(block);
+        header->size = size;
+        header->tag = currentMemoryTag;
+        chargeMemoryTag(header->tag, size);
+        return header + 1;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return ::operator new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void* memory) noexcept {
+    if (memory) {
+        AllocationHeader* header = static_cast<AllocationHeader*>(memory) - 1;
+        releaseMemoryTag(header->tag, header->size);
+        std::free(header);
+    }
+}
+
+void operator delete[](void* memory) noexcept {
+    ::operator delete(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    ::operator delete(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    ::operator delete(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    ::operator delete(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    ::operator delete(memory);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+#endif // PONG_ALLOCATION_TRACKING_H
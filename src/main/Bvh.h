@@ -0,0 +1,336 @@
+#ifndef PONG_BVH_H
+#define PONG_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct BvhBox {
+    glm::vec2 min;
+    glm::vec2 max;
+};
+
+// Leaves hold items [offset, offset + count). Inner nodes have count 0, their left
+// child directly follows them and offset is the index of the right child.
+struct BvhNode {
+    glm::vec2 min;
+    glm::vec2 max;
+    std::uint32_t offset;
+    std::uint32_t count;
+};
+
+struct BvhHit {
+    std::uint32_t item;
+    float t;
+    glm::vec2 normal;
+};
+
+// Bounding volume hierarchy over boxes that do not move, such as level geometry.
+// Built once with a binned surface area heuristic (perimeter in 2D) into a flat,
+// depth first node array. Queries walk it with a small fixed stack and do not allocate.
+class Bvh {
+public:
+    void build(const std::vector<BvhBox>& boxes) {
+        items = boxes;
+        itemIndices.resize(boxes.size());
+        centroids.resize(boxes.size());
+        for (std::uint32_t i = 0; i < boxes.size(); i++) {
+            itemIndices[i] = i;
+            centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        }
+
+        nodes.clear();
+        nodes.reserve(boxes.size() * 2);
+        if (!boxes.empty()) {
+            buildNode(0, boxes.size());
+        }
+
+        std::vector<BvhBox> ordered(items.size());
+        for (std::uint32_t i = 0; i < itemIndices.size(); i++) {
+            ordered[i] = items[itemIndices[i]];
+        }
+        items.swap(ordered);
+        std::vector<glm::vec2>().swap(centroids);
+    }
+
+    std::size_t size() const {
+        return items.size();
+    }
+
+    // Calls visit(item) for every box overlapping [boxMin, boxMax]
+    template <typename Visit>
+    void queryOverlap(glm::vec2 boxMin, glm::vec2 boxMax, Visit visit) const {
+        traverse(
+            [&](const glm::vec2& min, const glm::vec2& max) {
+                return boxMin.x <= max.x && boxMax.x >= min.x && boxMin.y <= max.y && boxMax.y >= min.y;
+            },
+            [&](std::uint32_t item) {
+                const BvhBox& box = items[item];
+                if (boxMin.x <= box.max.x && boxMax.x >= box.min.x && boxMin.y <= box.max.y && boxMax.y >= box.min.y) {
+                    visit(itemIndices[item]);
+                }
+            });
+    }
+
+    // Finds the nearest box entered by origin + direction * t for t in [0, maxT]
+    bool raycast(glm::vec2 origin, glm::vec2 direction, float maxT, BvhHit& hit) const {
+        if (!sweep(glm::vec2(0.0f), origin, direction * maxT, hit)) {
+            return false;
+        }
+        hit.t *= maxT;
+        return true;
+    }
+
+    // Finds the first box hit by a box with halfExtents moving from center by displacement.
+    // hit.t is the fraction of displacement travelled before touching. Boxes overlapping
+    // at the start are ignored so bodies can move away from what they touch.
+    bool sweep(glm::vec2 halfExtents, glm::vec2 center, glm::vec2 displacement, BvhHit& hit) const {
+        hit.t = std::numeric_limits<float>::max();
+        bool found = false;
+
+        traverse(
+            [&](const glm::vec2& min, const glm::vec2& max) {
+                float tEnter;
+                glm::vec2 normal;
+                return intersectSegment(center, displacement, min - halfExtents, max + halfExtents, tEnter, normal, true) &&
+                    tEnter < hit.t;
+            },
+            [&](std::uint32_t item) {
+                float tEnter;
+                glm::vec2 normal;
+                const BvhBox& box = items[item];
+                if (intersectSegment(center, displacement, box.min - halfExtents, box.max + halfExtents, tEnter, normal, false) &&
+                    tEnter < hit.t) {
+                    hit.item = itemIndices[item];
+                    hit.t = tEnter;
+                    hit.normal = normal;
+                    found = true;
+                }
+            });
+
+        return found;
+    }
+
+    const std::vector<BvhNode>& getNodes() const {
+        return nodes;
+    }
+
+private:
+    static constexpr std::uint32_t BinCount = 16;
+    static constexpr std::uint32_t MaxLeafSize = 4;
+    static constexpr std::uint32_t MaxDepth = 64;
+
+    static float halfPerimeter(const glm::vec2& min, const glm::vec2& max) {
+        return (max.x - min.x) + (max.y - min.y);
+    }
+
+    // Clips the segment origin + displacement * t, t in [0, 1], against a box. With
+    // conservative set, a segment starting inside counts as a hit, as needed for nodes.
+    static bool intersectSegment(
+        glm::vec2 origin,
+        glm::vec2 displacement,
+        glm::vec2 min,
+        glm::vec2 max,
+        float& tEnter,
+        glm::vec2& normal,
+        bool conservative) {
+
+        float tNear = -std::numeric_limits<float>::max();
+        float tFar = std::numeric_limits<float>::max();
+
+        for (int axis = 0; axis < 2; axis++) {
+            if (displacement[axis] == 0.0f) {
+                if (origin[axis] < min[axis] || origin[axis] > max[axis]) {
+                    return false;
+                }
+                continue;
+            }
+
+            float inverse = 1.0f / displacement[axis];
+            float t0 = (min[axis] - origin[axis]) * inverse;
+            float t1 = (max[axis] - origin[axis]) * inverse;
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+
+            if (t0 > tNear) {
+                tNear = t0;
+                normal = glm::vec2(0.0f);
+                normal[axis] = displacement[axis] > 0.0f ? -1.0f : 1.0f;
+            }
+            tFar = std::min(tFar, t1);
+        }
+
+        if (tNear > tFar || tFar < 0.0f || tNear > 1.0f) {
+            return false;
+        }
+
+        if (tNear < 0.0f) {
+            if (!conservative) {
+                return false;
+            }
+            tNear = 0.0f;
+        }
+
+        tEnter = tNear;
+        return true;
+    }
+
+    template <typename NodeTest, typename LeafVisit>
+    void traverse(NodeTest nodeTest, LeafVisit leafVisit) const {
+        if (nodes.empty()) {
+            return;
+        }
+
+        std::uint32_t stack[MaxDepth];
+        std::uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            const BvhNode& node = nodes[stack[--stackSize]];
+            if (!nodeTest(node.min, node.max)) {
+                continue;
+            }
+
+            if (node.count > 0) {
+                for (std::uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    leafVisit(i);
+                }
+            } else {
+                std::uint32_t left = &node - nodes.data() + 1;
+                stack[stackSize++] = node.offset;
+                stack[stackSize++] = left;
+            }
+        }
+    }
+
+    std::uint32_t buildNode(std::uint32_t start, std::uint32_t count, std::uint32_t depth = 0) {
+        std::uint32_t nodeIndex = nodes.size();
+        nodes.push_back({});
+
+        glm::vec2 min(std::numeric_limits<float>::max());
+        glm::vec2 max(-std::numeric_limits<float>::max());
+        glm::vec2 centroidMin(std::numeric_limits<float>::max());
+        glm::vec2 centroidMax(-std::numeric_limits<float>::max());
+        for (std::uint32_t i = start; i < start + count; i++) {
+            const BvhBox& box = items[itemIndices[i]];
+            min = glm::min(min, box.min);
+            max = glm::max(max, box.max);
+            centroidMin = glm::min(centroidMin, centroids[itemIndices[i]]);
+            centroidMax = glm::max(centroidMax, centroids[itemIndices[i]]);
+        }
+        nodes[nodeIndex].min = min;
+        nodes[nodeIndex].max = max;
+
+        std::uint32_t split = 0;
+        int splitAxis = -1;
+        if (count > MaxLeafSize && depth + 2 < MaxDepth) {
+            findSplit(start, count, centroidMin, centroidMax, halfPerimeter(min, max), splitAxis, split);
+        }
+
+        if (splitAxis < 0) {
+            nodes[nodeIndex].offset = start;
+            nodes[nodeIndex].count = count;
+            return nodeIndex;
+        }
+
+        float extent = centroidMax[splitAxis] - centroidMin[splitAxis];
+        auto middle = std::partition(
+            itemIndices.begin() + start,
+            itemIndices.begin() + start + count,
+            [&](std::uint32_t item) {
+                return binOf(centroids[item][splitAxis], centroidMin[splitAxis], extent) < split;
+            });
+        std::uint32_t leftCount = middle - (itemIndices.begin() + start);
+
+        buildNode(start, leftCount, depth + 1);
+        std::uint32_t right = buildNode(start + leftCount, count - leftCount, depth + 1);
+        nodes[nodeIndex].offset = right;
+        nodes[nodeIndex].count = 0;
+        return nodeIndex;
+    }
+
+    static std::uint32_t binOf(float centroid, float centroidMin, float extent) {
+        std::uint32_t bin = static_cast<std::uint32_t>((centroid - centroidMin) / extent * BinCount);
+        return std::min(bin, BinCount - 1);
+    }
+
+    // Picks the axis and bin boundary with the lowest surface area heuristic cost,
+    // leaving splitAxis at -1 when keeping all items in a leaf is cheaper
+    void findSplit(
+        std::uint32_t start,
+        std::uint32_t count,
+        glm::vec2 centroidMin,
+        glm::vec2 centroidMax,
+        float parentCost,
+        int& splitAxis,
+        std::uint32_t& split) {
+
+        float bestCost = parentCost * count;
+
+        for (int axis = 0; axis < 2; axis++) {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+
+            std::uint32_t binCounts[BinCount] = {};
+            glm::vec2 binMin[BinCount];
+            glm::vec2 binMax[BinCount];
+            for (std::uint32_t bin = 0; bin < BinCount; bin++) {
+                binMin[bin] = glm::vec2(std::numeric_limits<float>::max());
+                binMax[bin] = glm::vec2(-std::numeric_limits<float>::max());
+            }
+
+            for (std::uint32_t i = start; i < start + count; i++) {
+                std::uint32_t item = itemIndices[i];
+                std::uint32_t bin = binOf(centroids[item][axis], centroidMin[axis], extent);
+                binCounts[bin]++;
+                binMin[bin] = glm::min(binMin[bin], items[item].min);
+                binMax[bin] = glm::max(binMax[bin], items[item].max);
+            }
+
+            // Sweep from the right to get the cost of everything right of each boundary
+            float rightCosts[BinCount];
+            glm::vec2 accumulatedMin(std::numeric_limits<float>::max());
+            glm::vec2 accumulatedMax(-std::numeric_limits<float>::max());
+            std::uint32_t accumulatedCount = 0;
+            for (std::uint32_t bin = BinCount - 1; bin > 0; bin--) {
+                accumulatedMin = glm::min(accumulatedMin, binMin[bin]);
+                accumulatedMax = glm::max(accumulatedMax, binMax[bin]);
+                accumulatedCount += binCounts[bin];
+                rightCosts[bin] = accumulatedCount > 0 ?
+                    halfPerimeter(accumulatedMin, accumulatedMax) * accumulatedCount : 0.0f;
+            }
+
+            accumulatedMin = glm::vec2(std::numeric_limits<float>::max());
+            accumulatedMax = glm::vec2(-std::numeric_limits<float>::max());
+            accumulatedCount = 0;
+            for (std::uint32_t bin = 1; bin < BinCount; bin++) {
+                accumulatedMin = glm::min(accumulatedMin, binMin[bin - 1]);
+                accumulatedMax = glm::max(accumulatedMax, binMax[bin - 1]);
+                accumulatedCount += binCounts[bin - 1];
+                if (accumulatedCount == 0 || accumulatedCount == count) {
+                    continue;
+                }
+
+                float cost = halfPerimeter(accumulatedMin, accumulatedMax) * accumulatedCount + rightCosts[bin];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    splitAxis = axis;
+                    split = bin;
+                }
+            }
+        }
+    }
+
+    std::vector<BvhBox> items;
+    std::vector<std::uint32_t> itemIndices;
+    std::vector<glm::vec2> centroids;
+    std::vector<BvhNode> nodes;
+};
+
+#endif // PONG_BVH_H
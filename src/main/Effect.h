@@ -2,6 +2,8 @@
 #define PONG_EFFECT_H
 
 #include "EffectParameter.h"
+#include "FrameUniforms.h"
+#include "GlObject.h"
 
 #include <cstdint>
 #include <iostream>
@@ -9,22 +11,37 @@
 #include <string>
 #include <vector>
 
+static const char * const ModelParameterName = "model";
+static const char * const TextureParameterName = "tex";
+
 struct Effect {
-    std::uint32_t shaderProgram;
+    GlProgram shaderProgram;
     std::string vertexShaderSource;
     std::string fragmentShaderSource;
 
    	std::vector<EffectParameter> effectParameters;
+    // Whether the shaders declare the Frame uniform block, the only block the renderer feeds
+    bool usesFrameUniforms = false;
+
+    // Takes the name as it is, so looking a parameter up in the frame loop builds no string
+    std::int32_t parameterId(const char* name) const {
+        for (const auto& effectParameter : effectParameters) {
+            if (effectParameter.name == name) {
+                return effectParameter.id;
+            }
+        }
+        return -1;
+    }
 };
 
 std::shared_ptr<Effect> buildOrthoEffect() {
     auto effect = std::make_shared<Effect>();
 
-    effect->vertexShaderSource = std::string(
-        "#version 330 core\n"
-
+    effect->vertexShaderSource =
+        std::string("#version 330 core\n") +
+        FrameUniformsGlsl +
+        std::string(
         "uniform mat4 model;"
-        "uniform mat4 projection;"
 
         "layout(location = 0) in vec4 vertexPosition;"
         "layout(location = 2) in vec2 vertexTexCoord;"
@@ -51,13 +68,12 @@ std::shared_ptr<Effect> buildOrthoEffect() {
         "   result = vec4(temp.r);"
         "}");
 
-    EffectParameter epProjection {"projection"};
-    effect->effectParameters.push_back(epProjection);
+    effect->usesFrameUniforms = true;
 
-    EffectParameter epModel {"model"};
+    EffectParameter epModel {ModelParameterName};
     effect->effectParameters.push_back(epModel);
 
-    EffectParameter epTexture {"tex"};
+    EffectParameter epTexture {TextureParameterName};
     effect->effectParameters.push_back(epTexture);
 
     return effect;
@@ -1,6 +1,7 @@
 #ifndef PONG_EFFECT_PARAMETER_H
 #define PONG_EFFECT_PARAMETER_H
 
+#include <cstdint>
 #include <string>
 
 struct EffectParameter {
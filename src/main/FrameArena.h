@@ -0,0 +1,159 @@
+#ifndef PONG_FRAME_ARENA_H
+#define PONG_FRAME_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Hands out memory for data that lives no longer than a frame by bumping an offset through
+// one block allocated up front. Resetting at the start of a frame frees everything at once,
+// so transient data never goes through the heap and cannot fragment it over a long run.
+class FrameArena {
+public:
+    explicit FrameArena(std::size_t capacity) :
+        block(new std::uint8_t[capacity]),
+        capacity(capacity) {
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Returns nullptr when the arena is full, alignment has to be a power of two
+    void* allocate(std::size_t size, std::size_t alignment) {
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(block.get());
+        std::size_t start = ((base + offset + alignment - 1) & ~(alignment - 1)) - base;
+        if (start + size > capacity) {
+            overflows++;
+            return nullptr;
+        }
+
+        offset = start + size;
+        highWater = std::max(highWater, offset);
+        return block.get() + start;
+    }
+
+    template <typename T>
+    T* allocateArray(std::size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena memory is dropped without destructors");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    bool owns(const void* pointer) const {
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(pointer);
+        return bytes >= block.get() && bytes < block.get() + capacity;
+    }
+
+    // Everything allocated after a marker is freed by rewinding to it
+    std::size_t getMarker() const {
+        return offset;
+    }
+
+    void rewind(std::size_t marker) {
+        offset = marker;
+    }
+
+    void reset() {
+        offset = 0;
+    }
+
+    std::size_t getUsed() const {
+        return offset;
+    }
+
+    std::size_t getCapacity() const {
+        return capacity;
+    }
+
+    std::size_t getHighWater() const {
+        return highWater;
+    }
+
+    // Allocations that did not fit, a sign the arena should be larger
+    std::uint64_t getOverflows() const {
+        return overflows;
+    }
+
+private:
+    std::unique_ptr<std::uint8_t[]> block;
+    std::size_t capacity;
+    std::size_t offset = 0;
+    std::size_t highWater = 0;
+    std::uint64_t overflows = 0;
+};
+
+// Frees whatever was allocated from an arena while it was in scope, for scratch data of
+// a step that runs several times a frame
+class ArenaScope {
+public:
+    explicit ArenaScope(FrameArena& arena) :
+        arena(arena),
+        marker(arena.getMarker()) {
+    }
+
+    ~ArenaScope() {
+        arena.rewind(marker);
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    FrameArena& arena;
+    std::size_t marker;
+};
+
+// Lets standard containers live in an arena. What does not fit comes from the heap, so a
+// too small arena costs allocations but never fails.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(FrameArena& arena) :
+        arena(&arena) {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) :
+        arena(other.arena) {
+    }
+
+    T* allocate(std::size_t count) {
+        if (void* memory = arena->allocate(count * sizeof(T), alignof(T))) {
+            return static_cast<T*>(memory);
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    // Arena memory is only given back when the arena is rewound
+    void deallocate(T* pointer, std::size_t) {
+        if (!arena->owns(pointer)) {
+            ::operator delete(pointer);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    FrameArena* arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // PONG_FRAME_ARENA_H
@@ -0,0 +1,31 @@
+#ifndef PONG_FRAME_UNIFORMS_H
+#define PONG_FRAME_UNIFORMS_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+static const char * const FrameUniformsBlockName = "Frame";
+static const std::uint32_t FrameUniformsBinding = 0;
+
+// Per-frame data shared by all effects through one uniform buffer.
+// Layout follows std140, so members are ordered to avoid implicit padding.
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::vec4 viewport;
+    float time;
+    float frameTime;
+    float padding[2];
+};
+
+static_assert(sizeof(FrameUniforms) == 96, "FrameUniforms must match the std140 block layout");
+
+static const char * const FrameUniformsGlsl =
+    "layout(std140) uniform Frame {"
+    "   mat4 projection;"
+    "   vec4 viewport;"
+    "   float time;"
+    "   float frameTime;"
+    "};";
+
+#endif // PONG_FRAME_UNIFORMS_H
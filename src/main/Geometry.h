@@ -0,0 +1,109 @@
+#ifndef PONG_GEOMETRY_H
+#define PONG_GEOMETRY_H
+
+#include "GlObject.h"
+#include "VertexLayout.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Vertex and index data with its GPU buffers, shared by every mesh drawing the same shape
+struct Geometry {
+    VertexLayout layout;
+
+    std::uint32_t vertexCount;
+    std::uint32_t verticesTotalSize;
+    std::vector<std::uint8_t> vertexData;
+
+    int indexCount;
+    int indicesTotalSize;
+    std::vector<std::uint32_t> indices;
+
+    GlVertexArray vertexArrayObject;
+    GlBuffer vertexBufferObject;
+    GlBuffer elementBufferObject;
+
+    // Dynamic geometry keeps its CPU copy after upload so it can be modified,
+    // and is never shared since changes would show up in every mesh using it
+    bool dynamic = false;
+
+    // Fills vertices and indices again when they have been discarded after upload
+    std::function<void(Geometry&)> rebuild;
+};
+
+void fillQuadGeometry(Geometry& geometry, float width, float height, const VertexLayout& layout) {
+
+    float halfWidth = width * 0.5;
+    float halfHeight = height * 0.5;
+
+    // Source data per attribute, packed into the vertex buffer according to layout.
+    // Colors have 4 elements so layouts may include alpha.
+    float positions[] = {
+        halfWidth, halfHeight, 0.0f,
+        halfWidth, -halfHeight, 0.0f,
+        -halfWidth, -halfHeight, 0.0f,
+        -halfWidth,  halfHeight, 0.0f
+    };
+
+    float colors[] = {
+        1.0f, 0.0f, 0.0f, 1.0f,
+        0.0f, 1.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f, 1.0f,
+        1.0f, 1.0f, 0.0f, 1.0f
+    };
+
+    float texCoords[] = {
+        1.0f, 1.0f,
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f
+    };
+
+    geometry.layout = layout;
+    geometry.vertexCount = 4;
+    geometry.verticesTotalSize = geometry.vertexCount * layout.stride;
+    geometry.vertexData.assign(geometry.verticesTotalSize, 0);
+
+    for (std::uint32_t i = 0; i < geometry.vertexCount; i++) {
+        std::uint8_t *vertex = geometry.vertexData.data() + i * layout.stride;
+
+        for (const auto& attribute : layout.attributes) {
+            if (attribute.location == PositionLocation) {
+                packVertexAttribute(attribute, positions + i * 3, vertex);
+            } else if (attribute.location == ColorLocation) {
+                packVertexAttribute(attribute, colors + i * 4, vertex);
+            } else if (attribute.location == TexCoordLocation) {
+                packVertexAttribute(attribute, texCoords + i * 2, vertex);
+            }
+        }
+    }
+
+    // Indices
+    std::uint32_t indices[] = {
+        0, 1, 3,
+        1, 2, 3
+    };
+
+    geometry.indexCount = 6;
+    geometry.indicesTotalSize = sizeof(std::uint32_t) * geometry.indexCount;
+    geometry.indices.assign(indices, indices + geometry.indexCount);
+}
+
+std::shared_ptr<Geometry> buildQuadGeometry(
+    float width,
+    float height,
+    const VertexLayout& layout = compactVertexLayout()) {
+
+    auto geometry = std::make_shared<Geometry>();
+    fillQuadGeometry(*geometry, width, height, layout);
+
+    geometry->rebuild = [width, height, layout](Geometry& geometry) {
+        fillQuadGeometry(geometry, width, height, layout);
+    };
+
+    return geometry;
+}
+
+#endif // PONG_GEOMETRY_H
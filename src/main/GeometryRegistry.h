@@ -0,0 +1,102 @@
+#ifndef PONG_GEOMETRY_REGISTRY_H
+#define PONG_GEOMETRY_REGISTRY_H
+
+#include "Geometry.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+std::uint64_t hashBytes(std::uint64_t hash, const void *data, std::size_t size) {
+    const std::uint64_t FnvPrime = 1099511628211ull;
+    const std::uint8_t *bytes = static_cast<const std::uint8_t*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FnvPrime;
+    }
+    return hash;
+}
+
+std::uint64_t hashGeometry(const Geometry& geometry) {
+    const std::uint64_t FnvOffsetBasis = 14695981039346656037ull;
+    std::uint64_t hash = FnvOffsetBasis;
+    hash = hashBytes(hash, &geometry.layout.stride, sizeof(geometry.layout.stride));
+    hash = hashBytes(hash, geometry.vertexData.data(), geometry.vertexData.size());
+    hash = hashBytes(hash, geometry.indices.data(), geometry.indices.size() * sizeof(std::uint32_t));
+    return hash;
+}
+
+// Interns geometry by content so identical shapes share one set of GPU buffers.
+// Entries are weak, a shape is forgotten once the last mesh using it is gone.
+class GeometryRegistry {
+public:
+    // Returns the already registered geometry with the same content, or registers this one.
+    // Dynamic geometry and geometry without a CPU copy to hash are returned as is.
+    std::shared_ptr<Geometry> intern(std::shared_ptr<Geometry> geometry) {
+        if (geometry->dynamic || geometry->vertexData.empty()) {
+            return geometry;
+        }
+
+        std::uint64_t hash = hashGeometry(*geometry);
+        auto range = entries.equal_range(hash);
+        for (auto entry = range.first; entry != range.second;) {
+            auto existing = entry->second.lock();
+            if (existing == nullptr) {
+                entry = entries.erase(entry);
+                continue;
+            }
+            if (existing == geometry || sameContent(*existing, *geometry)) {
+                return existing;
+            }
+            ++entry;
+        }
+
+        entries.emplace(hash, geometry);
+        return geometry;
+    }
+
+    std::size_t size() {
+        for (auto entry = entries.begin(); entry != entries.end();) {
+            entry = entry->second.expired() ? entries.erase(entry) : std::next(entry);
+        }
+        return entries.size();
+    }
+
+private:
+    // Equal hashes are only a hint, the data itself is compared. Geometry whose CPU copy was
+    // discarded after upload is rebuilt for the comparison, and is never shared when it
+    // cannot be rebuilt.
+    bool sameContent(const Geometry& a, const Geometry& b) {
+        if (!(a.layout == b.layout) ||
+            a.vertexCount != b.vertexCount ||
+            a.verticesTotalSize != b.verticesTotalSize ||
+            a.indexCount != b.indexCount ||
+            a.indicesTotalSize != b.indicesTotalSize) {
+            return false;
+        }
+
+        Geometry rebuiltA;
+        Geometry rebuiltB;
+        const Geometry* dataA = withData(a, rebuiltA);
+        const Geometry* dataB = withData(b, rebuiltB);
+        if (dataA == nullptr || dataB == nullptr) {
+            return false;
+        }
+        return dataA->vertexData == dataB->vertexData && dataA->indices == dataB->indices;
+    }
+
+    static const Geometry* withData(const Geometry& geometry, Geometry& rebuilt) {
+        if (!geometry.vertexData.empty()) {
+            return &geometry;
+        }
+        if (!geometry.rebuild) {
+            return nullptr;
+        }
+        geometry.rebuild(rebuilt);
+        return &rebuilt;
+    }
+
+    std::unordered_multimap<std::uint64_t, std::weak_ptr<Geometry>> entries;
+};
+
+#endif // PONG_GEOMETRY_REGISTRY_H
@@ -0,0 +1,114 @@
+#ifndef PONG_GL_OBJECT_H
+#define PONG_GL_OBJECT_H
+
+#include "glad.h"
+#include "MemoryTracker.h"
+
+#include <cstdint>
+#include <utility>
+
+struct GlBufferTraits {
+    static std::uint32_t create() {
+        GLuint id;
+        glGenBuffers(1, &id);
+        return id;
+    }
+
+    static void destroy(std::uint32_t id) {
+        memoryTracker().removeGpuObject(GpuNamespace::Buffer, id);
+        glDeleteBuffers(1, &id);
+    }
+};
+
+struct GlVertexArrayTraits {
+    static std::uint32_t create() {
+        GLuint id;
+        glGenVertexArrays(1, &id);
+        return id;
+    }
+
+    static void destroy(std::uint32_t id) {
+        glDeleteVertexArrays(1, &id);
+    }
+};
+
+struct GlTextureTraits {
+    static std::uint32_t create() {
+        GLuint id;
+        glGenTextures(1, &id);
+        return id;
+    }
+
+    static void destroy(std::uint32_t id) {
+        memoryTracker().removeGpuObject(GpuNamespace::Texture, id);
+        glDeleteTextures(1, &id);
+    }
+};
+
+struct GlProgramTraits {
+    static std::uint32_t create() {
+        return glCreateProgram();
+    }
+
+    static void destroy(std::uint32_t id) {
+        glDeleteProgram(id);
+    }
+};
+
+// Owns a single GL object name and deletes it when going out of scope.
+// A value of 0 means no object is owned, so default constructed handles
+// never touch GL and are safe to destroy without a context.
+template <typename Traits>
+class GlObject {
+public:
+    GlObject() = default;
+
+    explicit GlObject(std::uint32_t id) : id(id) {}
+
+    GlObject(const GlObject&) = delete;
+    GlObject& operator=(const GlObject&) = delete;
+
+    GlObject(GlObject&& other) : id(other.release()) {}
+
+    GlObject& operator=(GlObject&& other) {
+        reset(other.release());
+        return *this;
+    }
+
+    ~GlObject() {
+        reset();
+    }
+
+    static GlObject create() {
+        return GlObject(Traits::create());
+    }
+
+    std::uint32_t get() const {
+        return id;
+    }
+
+    explicit operator bool() const {
+        return id != 0;
+    }
+
+    std::uint32_t release() {
+        return std::exchange(id, 0);
+    }
+
+    void reset(std::uint32_t newId = 0) {
+        if (id != 0) {
+            Traits::destroy(id);
+        }
+        id = newId;
+    }
+
+private:
+    std::uint32_t id = 0;
+};
+
+using GlBuffer = GlObject<GlBufferTraits>;
+using GlVertexArray = GlObject<GlVertexArrayTraits>;
+using GlTexture = GlObject<GlTextureTraits>;
+using GlProgram = GlObject<GlProgramTraits>;
+
+#endif // PONG_GL_OBJECT_H
@@ -5,16 +5,20 @@
 #include "Image.h"
 #include "Texture.h"
 #include "Mesh.h"
+#include "MemoryTracker.h"
 #include "Renderer.h"
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "stb_truetype.h"
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <fstream>
-#include <map>
 #include <vector>
 
+static const char * const FontPath = "../data/arial.ttf";
+
 class Gui {
 public:
     Gui(
@@ -24,46 +28,29 @@ public:
         renderer(renderer),
         orthoEffect(orthoEffect) {
 
-        std::ifstream ifs("../data/arial.ttf", std::ios::in | std::ios::binary);
-        if (ifs.is_open()) {
-            std::vector<std::uint8_t> ttfBuffer {
-                std::istreambuf_iterator<char>(ifs),
-                std::istreambuf_iterator<char>()
-            };
+        MemoryTagScope memoryTag(MemoryTag::Gui);
+        std::vector<std::uint8_t> ttfBuffer = readFont();
+        if (!ttfBuffer.empty()) {
+            for (std::uint8_t i = 0; i < 10; i++) {
+                char character = indexToChar(i);
+                auto image = rasterizeGlyph(ttfBuffer, character);
 
-            stbtt_fontinfo font;
-            stbtt_InitFont(
-                &font,
-                ttfBuffer.data(),
-                stbtt_GetFontOffsetForIndex(ttfBuffer.data(), 0));
+                // Glyphs are rasterized again from the font file if the renderer
+                // discarded the bitmap after upload and has to restore the texture
+                image->reload = [character]() {
+                    return rasterizeGlyph(readFont(), character)->data;
+                };
 
-            for (std::uint8_t i = 0; i < 10; i++) {
-                float scaleY = stbtt_ScaleForPixelHeight(&font, 120);
-                int imageWidth;
-                int imageHeight;
-                std::uint8_t *imageData = stbtt_GetCodepointBitmap(
-                    &font,
-                    10,
-                    scaleY,
-                    indexToChar(i),
-                    &imageWidth,
-                    &imageHeight,
-                    0,
-                    0);
-
-                auto image = std::make_shared<Image>(imageWidth, imageHeight, imageData);
                 auto texture = std::make_shared<Texture>(image);
-                mapCharToTexture[indexToChar(i)] = texture;
+                digitTextures[i] = texture;
                 renderer->addTexture(texture);
             }
 
-            pointsLeftMesh = createTextMesh(glm::vec2(-100.0, -310.0));
-            pointsRightMesh = createTextMesh(glm::vec2(100.0, -310.0));
+            pointsLeftDisplay = createScoreDisplay(glm::vec2(-100.0, -310.0));
+            pointsRightDisplay = createScoreDisplay(glm::vec2(100.0, -310.0));
 
             enabled = true;
 
-            ifs.close();
-
         } else {
             std::cerr << "Font file not found\n";
         }
@@ -71,15 +58,84 @@ public:
 
     void update(std::uint8_t pointsLeft, std::uint8_t pointsRight) {
         if (enabled) {
-            pointsLeftMesh->texture = mapCharToTexture[indexToChar(pointsLeft)];
-            pointsRightMesh->texture = mapCharToTexture[indexToChar(pointsRight)];
+            showScore(pointsLeftDisplay, pointsLeft);
+            showScore(pointsRightDisplay, pointsRight);
         }
     }
 
 private:
+    // A score of up to two digits, the meshes for both are created up front so changing
+    // the score only swaps textures
+    struct ScoreDisplay {
+        std::shared_ptr<Mesh> tens;
+        std::shared_ptr<Mesh> ones;
+    };
+
+    static std::vector<std::uint8_t> readFont() {
+        std::ifstream ifs(FontPath, std::ios::in | std::ios::binary);
+        if (!ifs.is_open()) {
+            return {};
+        }
+
+        return std::vector<std::uint8_t> {
+            std::istreambuf_iterator<char>(ifs),
+            std::istreambuf_iterator<char>()
+        };
+    }
+
+    static std::shared_ptr<Image> rasterizeGlyph(const std::vector<std::uint8_t>& ttfBuffer, char character) {
+        MemoryTagScope memoryTag(MemoryTag::Image);
+        if (ttfBuffer.empty()) {
+            return std::make_shared<Image>(0, 0, std::vector<std::uint8_t>());
+        }
+
+        stbtt_fontinfo font;
+        stbtt_InitFont(
+            &font,
+            ttfBuffer.data(),
+            stbtt_GetFontOffsetForIndex(ttfBuffer.data(), 0));
+
+        float scaleY = stbtt_ScaleForPixelHeight(&font, 120);
+        int imageWidth;
+        int imageHeight;
+        std::uint8_t *imageData = stbtt_GetCodepointBitmap(
+            &font,
+            10,
+            scaleY,
+            character,
+            &imageWidth,
+            &imageHeight,
+            0,
+            0);
+
+        auto image = std::make_shared<Image>(
+            imageWidth,
+            imageHeight,
+            std::vector<std::uint8_t>(imageData, imageData + imageWidth * imageHeight));
+        stbtt_FreeBitmap(imageData, nullptr);
+
+        return image;
+    }
+
+    ScoreDisplay createScoreDisplay(glm::vec2 position) {
+        ScoreDisplay display;
+        display.tens = createTextMesh(position - glm::vec2(DigitWidth, 0.0));
+        display.tens->visible = false;
+        display.ones = createTextMesh(position);
+        return display;
+    }
+
+    // Scores above two digits stay at 99 rather than wrapping around
+    void showScore(ScoreDisplay& display, std::uint8_t points) {
+        points = std::min(points, MaxShownPoints);
+        display.tens->visible = points >= 10;
+        display.tens->texture = digitTextures[points / 10];
+        display.ones->texture = digitTextures[points % 10];
+    }
+
     std::shared_ptr<Mesh> createTextMesh(glm::vec2 position) {
-        auto textMesh = buildQuadMesh(30.0, 40.0, orthoEffect);
-        textMesh->texture = mapCharToTexture[indexToChar(0)];
+        auto textMesh = buildQuadMesh(DigitWidth, 40.0, orthoEffect);
+        textMesh->texture = digitTextures[0];
         textMesh->transform = createTranslation(position);
         renderer->addMesh(textMesh);
         return textMesh;
@@ -89,12 +145,15 @@ private:
         return index + 48;
     }
 
+    static constexpr float DigitWidth = 30.0f;
+    static constexpr std::uint8_t MaxShownPoints = 99;
+
     bool enabled = false;
 
     std::shared_ptr<Effect> orthoEffect;
-    std::shared_ptr<Mesh> pointsLeftMesh;
-    std::shared_ptr<Mesh> pointsRightMesh;
-    std::map<char, std::shared_ptr<Texture>> mapCharToTexture;
+    ScoreDisplay pointsLeftDisplay;
+    ScoreDisplay pointsRightDisplay;
+    std::array<std::shared_ptr<Texture>, 10> digitTextures;
 
     std::shared_ptr<Renderer> renderer;
 };
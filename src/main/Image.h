@@ -2,17 +2,22 @@
 #define PONG_IMAGE_H
 
 #include <cstdint>
+#include <functional>
+#include <vector>
 
 struct Image {
 
-	Image(std::uint32_t width, std::uint32_t height, std::uint8_t* data) :
+	Image(std::uint32_t width, std::uint32_t height, std::vector<std::uint8_t> data) :
 		width(width),
 		height(height),
-		data(data) {}
+		data(std::move(data)) {}
 
     std::uint32_t width;
     std::uint32_t height;
-    std::uint8_t* data;
+    std::vector<std::uint8_t> data;
+
+    // Produces the pixel data again when it has been discarded after upload
+    std::function<std::vector<std::uint8_t>()> reload;
 };
 
 #endif // PONG_IMAGE_H
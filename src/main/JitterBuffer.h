@@ -0,0 +1,209 @@
+#ifndef PONG_JITTER_BUFFER_H
+#define PONG_JITTER_BUFFER_H
+
+#include "SnapshotDelta.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+// A remote match as drawn at one moment
+struct RemoteMatchView {
+    glm::vec2 ballPosition;
+    float leftPaddleY = 0.0;
+    float rightPaddleY = 0.0;
+    std::uint32_t pointsLeft = 0;
+    std::uint32_t pointsRight = 0;
+    bool extrapolated = false;
+};
+
+struct JitterBufferSettings {
+    // Bounds of the delay kept on top of the time snapshots take at best
+    double minDelay = 0.0;
+    double maxDelay = 0.25;
+    // The delay covers the snapshot interval and this many times the measured jitter
+    double jitterScale = 3.0;
+    // Every extrapolated frame adds this much delay, which wears off again over seconds
+    double underflowDelay = 0.002;
+    double underflowDecay = 0.01;
+    // How far past the newest snapshot the ball is carried on by its velocity
+    double maxExtrapolation = 0.1;
+    // The fraction by which playback may run fast or slow to reach a new delay, so the
+    // delay changes without visible jumps
+    double slewRate = 0.05;
+};
+
+// Holds snapshots of a remote match back just long enough to draw it smoothly between
+// them, whatever the spacing they arrive with. Snapshots are stamped with the local time
+// they arrived at, in seconds.
+//
+// The least arrival time seen for a tick says where the remote timeline sits on the local
+// clock. Arrivals later than that are jitter, which the delay adapts to, shrinking again
+// when the network calms down. Running dry carries the ball on for a moment and adds delay.
+class JitterBuffer {
+public:
+    explicit JitterBuffer(double tickTime, const JitterBufferSettings& settings = JitterBufferSettings()) :
+        tickTime(tickTime),
+        settings(settings) {
+        snapshots.reserve(Capacity);
+    }
+
+    void add(const QuantizedMatch& snapshot, double arrival) {
+        double time = snapshot.tick * tickTime;
+        double offset = arrival - time;
+        if (!started) {
+            clockOffset = offset;
+            lastArrival = arrival;
+            interval = tickTime;
+            started = true;
+        }
+
+        // The best case creeps up slowly, in case the clocks drift apart
+        clockOffset = std::min(offset, clockOffset + ClockDrift * (arrival - lastArrival));
+        lastArrival = arrival;
+        jitter += (offset - clockOffset - jitter) / 16.0;
+
+        if (!snapshots.empty() && snapshot.tick <= snapshots.front().snapshot.tick) {
+            lateSnapshots++;
+            return;
+        }
+
+        Entry entry;
+        entry.snapshot = snapshot;
+        entry.time = time;
+        auto position = snapshots.end();
+        while (position != snapshots.begin() && std::prev(position)->snapshot.tick >= snapshot.tick) {
+            position--;
+        }
+        if (position != snapshots.end() && position->snapshot.tick == snapshot.tick) {
+            return;
+        }
+        if (position == snapshots.end() && !snapshots.empty()) {
+            interval += ((snapshot.tick - snapshots.back().snapshot.tick) * tickTime - interval) / 16.0;
+        }
+        // Room is kept up front so adding never allocates, a full buffer drops its oldest
+        if (snapshots.size() == Capacity) {
+            if (position == snapshots.begin()) {
+                return;
+            }
+            std::ptrdiff_t index = position - snapshots.begin();
+            snapshots.erase(snapshots.begin());
+            position = snapshots.begin() + (index - 1);
+        }
+        snapshots.insert(position, entry);
+    }
+
+    // Draws the match as it was the current delay ago. Returns false until a snapshot has
+    // arrived.
+    bool sample(double now, RemoteMatchView& view) {
+        if (snapshots.empty()) {
+            return false;
+        }
+
+        double elapsed = std::max(0.0, now - lastSample);
+        lastSample = now;
+        underflowBoost = std::max(0.0, underflowBoost - settings.underflowDecay * elapsed);
+        targetDelay = std::min(settings.maxDelay, std::max(settings.minDelay,
+            interval + settings.jitterScale * jitter + underflowBoost));
+        if (!sampled) {
+            delay = targetDelay;
+            sampled = true;
+        }
+        double step = settings.slewRate * elapsed;
+        delay += std::min(step, std::max(-step, targetDelay - delay));
+
+        double time = now - clockOffset - delay;
+        while (snapshots.size() >= 2 && snapshots[1].time <= time) {
+            snapshots.erase(snapshots.begin());
+        }
+
+        const Entry& from = snapshots.front();
+        view.extrapolated = false;
+        if (time <= from.time) {
+            fill(from.snapshot, view);
+        } else if (snapshots.size() >= 2) {
+            const Entry& to = snapshots[1];
+            float alpha = static_cast<float>((time - from.time) / (to.time - from.time));
+            fill(from.snapshot, view);
+            view.leftPaddleY += (dequantize(to.snapshot.leftPaddleY) - view.leftPaddleY) * alpha;
+            view.rightPaddleY += (dequantize(to.snapshot.rightPaddleY) - view.rightPaddleY) * alpha;
+            // A point puts the ball back in the middle, which is not a path to draw
+            if (from.snapshot.pointsLeft == to.snapshot.pointsLeft && from.snapshot.pointsRight == to.snapshot.pointsRight) {
+                glm::vec2 target(dequantize(to.snapshot.ballX), dequantize(to.snapshot.ballY));
+                view.ballPosition += (target - view.ballPosition) * alpha;
+            }
+        } else {
+            fill(from.snapshot, view);
+            float ahead = static_cast<float>(std::min(time - from.time, settings.maxExtrapolation));
+            view.ballPosition += glm::vec2(dequantize(from.snapshot.velocityX), dequantize(from.snapshot.velocityY)) * ahead;
+            view.extrapolated = true;
+            underflowBoost = std::min(settings.maxDelay, underflowBoost + settings.underflowDelay);
+            underflows++;
+        }
+        return true;
+    }
+
+    double getDelay() const {
+        return delay;
+    }
+
+    double getTargetDelay() const {
+        return targetDelay;
+    }
+
+    double getJitter() const {
+        return jitter;
+    }
+
+    std::size_t getBuffered() const {
+        return snapshots.size();
+    }
+
+    std::uint64_t getUnderflows() const {
+        return underflows;
+    }
+
+    std::uint64_t getLateSnapshots() const {
+        return lateSnapshots;
+    }
+
+private:
+    static constexpr double ClockDrift = 0.001;
+    static constexpr std::size_t Capacity = 256;
+
+    struct Entry {
+        QuantizedMatch snapshot;
+        double time = 0.0;
+    };
+
+    static void fill(const QuantizedMatch& snapshot, RemoteMatchView& view) {
+        view.ballPosition = glm::vec2(dequantize(snapshot.ballX), dequantize(snapshot.ballY));
+        view.leftPaddleY = dequantize(snapshot.leftPaddleY);
+        view.rightPaddleY = dequantize(snapshot.rightPaddleY);
+        view.pointsLeft = snapshot.pointsLeft;
+        view.pointsRight = snapshot.pointsRight;
+    }
+
+    double tickTime;
+    JitterBufferSettings settings;
+    std::vector<Entry> snapshots;
+
+    bool started = false;
+    bool sampled = false;
+    double clockOffset = 0.0;
+    double lastArrival = 0.0;
+    double lastSample = 0.0;
+    double interval = 0.0;
+    double jitter = 0.0;
+    double underflowBoost = 0.0;
+    double delay = 0.0;
+    double targetDelay = 0.0;
+    std::uint64_t underflows = 0;
+    std::uint64_t lateSnapshots = 0;
+};
+
+#endif // PONG_JITTER_BUFFER_H
@@ -0,0 +1,195 @@
+#ifndef PONG_MATCH_H
+#define PONG_MATCH_H
+
+#include "PaddleController.h"
+#include "Randomizer.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Rules shared by the interactive game and headless matches. The per tick rules below are
+// called by stepMatch and by the systems of the interactive game alike. What the game adds
+// on top of a match:
+// - more than one ball with --balls, balls then bounce off each other and are served
+//   from a random spot instead of the middle,
+// - walls and paddles are found through a broadphase and the ball is swept through a BVH,
+//   which for one ball ends where moveMatchBall does,
+// - a tick of 1/120 s, headless matches take the tick time from their caller,
+// - games to GamePoints after which the score starts over, a match only counts points and
+//   leaves it to its caller when a game is won.
+const float BallSpeed = 400.0;
+const float BallSize = 10.0;
+const float PaddleSpeed = 300.0;
+const float PaddleWidth = 20.0;
+const float PaddleHeight = 50.0;
+const float PaddleX = 500.0;
+const float WallY = 340.0;
+const float WallWidth = 1280.0;
+const float WallThickness = 20.0;
+const float SurfaceDistance = 4.0;
+const float LimitX = 600.0;
+const float LimitY = 300.0;
+const std::uint32_t GamePoints = 10;
+
+// Bounces off a paddle are steered by where the ball hits it, off centre hits
+// leave at a steeper angle
+glm::vec2 paddleBounceNormal(glm::vec2 normal, float ballY, float paddleY) {
+    float pctY = (ballY - paddleY) / (PaddleHeight * 0.5);
+    return glm::normalize(glm::vec2(normal.x, pctY * 0.1));
+}
+
+// Bounces a ball off a wall or paddle it touches, pushing it out along the surface normal
+void bounceBall(glm::vec2& ballPosition, glm::vec2& ballVelocity, glm::vec2 normal) {
+    ballPosition += normal * SurfaceDistance;
+    ballVelocity = glm::reflect(ballVelocity, normal);
+}
+
+void bounceBallOffPaddle(glm::vec2& ballPosition, glm::vec2& ballVelocity, glm::vec2 normal, float paddleY) {
+    ballPosition += normal * SurfaceDistance;
+    ballVelocity = glm::reflect(ballVelocity, paddleBounceNormal(normal, ballPosition.y, paddleY));
+}
+
+// Actions are paddle velocities as a fraction of full speed, anything beyond is full speed
+float paddleVelocity(float action) {
+    return std::min(1.0f, std::max(-1.0f, action)) * PaddleSpeed;
+}
+
+float constrainPaddleY(float y) {
+    return std::min(LimitY, std::max(-LimitY, y));
+}
+
+bool gameWon(std::uint32_t pointsLeft, std::uint32_t pointsRight, std::uint32_t pointsToWin) {
+    return pointsLeft >= pointsToWin || pointsRight >= pointsToWin;
+}
+
+// Everything needed to continue a single ball match, without pointers so it can be copied
+struct MatchState {
+    glm::vec2 ballPosition;
+    glm::vec2 ballVelocity;
+    float leftPaddleY = 0.0;
+    float rightPaddleY = 0.0;
+    std::uint32_t pointsLeft = 0;
+    std::uint32_t pointsRight = 0;
+    std::uint32_t tick = 0;
+    Randomizer random;
+};
+
+enum class MatchEvent {
+    None,
+    LeftScored,
+    RightScored
+};
+
+// A ball past either paddle is a point for the other side
+MatchEvent ballScored(glm::vec2 ballPosition) {
+    if (ballPosition.x < -LimitX) {
+        return MatchEvent::RightScored;
+    }
+    if (ballPosition.x > LimitX) {
+        return MatchEvent::LeftScored;
+    }
+    return MatchEvent::None;
+}
+
+enum class PaddleSide {
+    Left,
+    Right
+};
+
+// The field as seen by a controller on either side, see PaddleObservation
+PaddleField matchField() {
+    PaddleField field;
+    field.paddleX = PaddleX;
+    field.paddleFaceX = PaddleX - (PaddleWidth + BallSize) * 0.5f;
+    field.ballMinY = -WallY + (WallThickness + BallSize) * 0.5f;
+    field.ballMaxY = WallY - (WallThickness + BallSize) * 0.5f;
+    return field;
+}
+
+void serveBall(MatchState& match) {
+    match.ballPosition = glm::vec2();
+    match.ballVelocity = match.random.randomDirection() * BallSpeed;
+}
+
+void resetMatch(MatchState& match, std::uint64_t seed) {
+    match = MatchState();
+    match.random = Randomizer(seed);
+    serveBall(match);
+}
+
+PaddleObservation observeMatch(const MatchState& match, PaddleSide side) {
+    float mirror = side == PaddleSide::Left ? -1.0f : 1.0f;
+
+    PaddleObservation observation;
+    observation.ballPosition = glm::vec2(match.ballPosition.x * mirror, match.ballPosition.y);
+    observation.ballVelocity = glm::vec2(match.ballVelocity.x * mirror, match.ballVelocity.y);
+    observation.paddleY = side == PaddleSide::Left ? match.leftPaddleY : match.rightPaddleY;
+    observation.opponentY = side == PaddleSide::Left ? match.rightPaddleY : match.leftPaddleY;
+    return observation;
+}
+
+bool boxesOverlap(glm::vec2 centerA, glm::vec2 halfExtentsA, glm::vec2 centerB, glm::vec2 halfExtentsB) {
+    glm::vec2 distance = glm::abs(centerA - centerB);
+    glm::vec2 reach = halfExtentsA + halfExtentsB;
+    return distance.x <= reach.x && distance.y <= reach.y;
+}
+
+// Bounces the ball off walls and paddles it touches, as collideObstacles does
+void collideMatchBall(MatchState& match) {
+    const glm::vec2 ballHalfExtents = glm::vec2(BallSize * 0.5f);
+    const glm::vec2 wallHalfExtents = glm::vec2(WallWidth, WallThickness) * 0.5f;
+    const glm::vec2 paddleHalfExtents = glm::vec2(PaddleWidth, PaddleHeight) * 0.5f;
+
+    for (float side : {1.0f, -1.0f}) {
+        if (boxesOverlap(match.ballPosition, ballHalfExtents, glm::vec2(0.0, WallY * side), wallHalfExtents)) {
+            bounceBall(match.ballPosition, match.ballVelocity, glm::vec2(0.0, -side));
+        }
+    }
+
+    for (float side : {-1.0f, 1.0f}) {
+        float paddleY = side < 0.0f ? match.leftPaddleY : match.rightPaddleY;
+        if (boxesOverlap(match.ballPosition, ballHalfExtents, glm::vec2(PaddleX * side, paddleY), paddleHalfExtents)) {
+            bounceBallOffPaddle(match.ballPosition, match.ballVelocity, glm::vec2(-side, 0.0), paddleY);
+        }
+    }
+}
+
+// Moves the ball, stopping it where it would enter a wall like the swept collision
+// in updateMovement. Walls span the whole field, so only the y axis can hit.
+void moveMatchBall(MatchState& match, float tickTime) {
+    glm::vec2 displacement = match.ballVelocity * tickTime;
+    float innerY = WallY - (WallThickness + BallSize) * 0.5f;
+    float y = match.ballPosition.y;
+
+    float t = 1.0;
+    if (displacement.y > 0.0f && y < innerY) {
+        t = std::min(t, (innerY - y) / displacement.y);
+    } else if (displacement.y < 0.0f && y > -innerY) {
+        t = std::min(t, (-innerY - y) / displacement.y);
+    }
+
+    match.ballPosition += displacement * t;
+}
+
+// Advances a match by one tick in the same order as simulateTick: bounces, movement,
+// paddle limits and then scoring. A scoring ball is served again from the middle.
+MatchEvent stepMatch(MatchState& match, float leftAction, float rightAction, float tickTime) {
+    collideMatchBall(match);
+    moveMatchBall(match, tickTime);
+
+    match.leftPaddleY = constrainPaddleY(match.leftPaddleY + paddleVelocity(leftAction) * tickTime);
+    match.rightPaddleY = constrainPaddleY(match.rightPaddleY + paddleVelocity(rightAction) * tickTime);
+    match.tick++;
+
+    MatchEvent event = ballScored(match.ballPosition);
+    if (event != MatchEvent::None) {
+        event == MatchEvent::LeftScored ? match.pointsLeft++ : match.pointsRight++;
+        serveBall(match);
+    }
+    return event;
+}
+
+#endif // PONG_MATCH_H
@@ -0,0 +1,367 @@
+#ifndef PONG_MATCH_SERVER_H
+#define PONG_MATCH_SERVER_H
+
+#include "Match.h"
+#include "Network.h"
+#include "Replay.h"
+#include "SnapshotDelta.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Datagrams between players and the match server. Every match is owned by one shard,
+// match % shardCount, which listens on basePort + shard.
+//
+//     input  'I', fixed32 match, side, action as int8 from -1 to 1, fixed32 tick of the
+//            newest state the player has, 0 before the first
+//     watch  'W', fixed32 match, fixed32 tick of the newest state the watcher has
+//     state  'D', fixed32 match, the match as a delta snapshot against the newest state the
+//            player acknowledged, or against nothing until it has
+//
+// An input also tells the server where to send the states for that side, so there is no
+// separate joining. A watch does the same for one spectator of the match, usually a relay,
+// and a match takes up to MaxMatchWatchers of them.
+const std::size_t ServerInputSize = 11;
+const std::size_t ServerWatchSize = 9;
+const std::size_t ServerStateHeaderSize = 5;
+const std::size_t MaxServerStateSize = ServerStateHeaderSize + MaxDeltaSnapshotSize;
+const std::size_t MaxMatchWatchers = 4;
+
+// Writes straight into a fixed size buffer, the few fields do not need a vector
+class FixedWriter {
+public:
+    explicit FixedWriter(std::uint8_t* bytes) :
+        cursor(bytes) {
+    }
+
+    void byte(std::uint8_t value) {
+        *cursor++ = value;
+    }
+
+    void fixed32(std::uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            *cursor++ = static_cast<std::uint8_t>(value >> (i * 8));
+        }
+    }
+
+private:
+    std::uint8_t* cursor;
+};
+
+struct ServerInput {
+    std::uint32_t match = 0;
+    PaddleSide side = PaddleSide::Left;
+    std::int8_t action = 0;
+    std::uint32_t acknowledgedTick = 0;
+};
+
+void encodeServerInput(const ServerInput& input, std::uint8_t* bytes) {
+    FixedWriter writer(bytes);
+    writer.byte('I');
+    writer.fixed32(input.match);
+    writer.byte(input.side == PaddleSide::Left ? 0 : 1);
+    writer.byte(static_cast<std::uint8_t>(input.action));
+    writer.fixed32(input.acknowledgedTick);
+}
+
+bool decodeServerInput(const std::uint8_t* bytes, std::size_t size, ServerInput& input) {
+    const std::uint8_t* cursor = bytes + 1;
+    if (size != ServerInputSize || bytes[0] != 'I' || !readFixed32(cursor, bytes + size, input.match)) {
+        return false;
+    }
+    input.side = bytes[5] == 0 ? PaddleSide::Left : PaddleSide::Right;
+    input.action = static_cast<std::int8_t>(std::max(-1, std::min(1, static_cast<int>(static_cast<std::int8_t>(bytes[6])))));
+    cursor = bytes + 7;
+    return readFixed32(cursor, bytes + size, input.acknowledgedTick);
+}
+
+struct ServerWatch {
+    std::uint32_t match = 0;
+    std::uint32_t acknowledgedTick = 0;
+};
+
+void encodeServerWatch(const ServerWatch& watch, std::uint8_t* bytes) {
+    FixedWriter writer(bytes);
+    writer.byte('W');
+    writer.fixed32(watch.match);
+    writer.fixed32(watch.acknowledgedTick);
+}
+
+bool decodeServerWatch(const std::uint8_t* bytes, std::size_t size, ServerWatch& watch) {
+    const std::uint8_t* cursor = bytes + 1;
+    return size == ServerWatchSize && bytes[0] == 'W' &&
+        readFixed32(cursor, bytes + size, watch.match) &&
+        readFixed32(cursor, bytes + size, watch.acknowledgedTick);
+}
+
+// Returns the size of the datagram
+std::size_t encodeServerState(
+    std::uint32_t matchIndex,
+    const DeltaSnapshotCodec& codec,
+    const QuantizedMatch& match,
+    const QuantizedMatch* baseline,
+    std::uint8_t* bytes) {
+
+    FixedWriter writer(bytes);
+    writer.byte('D');
+    writer.fixed32(matchIndex);
+    return ServerStateHeaderSize + codec.encode(match, baseline, bytes + ServerStateHeaderSize);
+}
+
+// Reads which match a state is for, so the caller can pick its history
+bool decodeServerStateMatch(const std::uint8_t* bytes, std::size_t size, std::uint32_t& matchIndex) {
+    const std::uint8_t* cursor = bytes + 1;
+    return size > ServerStateHeaderSize && bytes[0] == 'D' && readFixed32(cursor, bytes + size, matchIndex);
+}
+
+// Decodes a state against its baseline in the history of its match and adds it there.
+// Returns false if the baseline is no longer in the history.
+bool decodeServerState(
+    const std::uint8_t* bytes,
+    std::size_t size,
+    const DeltaSnapshotCodec& codec,
+    SnapshotHistory& history,
+    QuantizedMatch& match) {
+
+    const std::uint8_t* snapshot = bytes + ServerStateHeaderSize;
+    std::size_t snapshotSize = size - ServerStateHeaderSize;
+    std::uint8_t baselineTick;
+    const QuantizedMatch* baseline = nullptr;
+    if (DeltaSnapshotCodec::peekBaseline(snapshot, snapshotSize, baselineTick)) {
+        baseline = history.findByLowByte(baselineTick);
+        if (!baseline) {
+            return false;
+        }
+    }
+
+    if (!codec.decode(snapshot, snapshotSize, baseline, match)) {
+        return false;
+    }
+    history.add(match);
+    return true;
+}
+
+const int SocketBufferSize = 16 * 1024 * 1024;
+
+struct MatchServerSettings {
+    std::uint32_t matchCount = 1000;
+    std::uint32_t shardCount = 1;
+    std::uint32_t tickRate = 60;
+    std::uint32_t pointsToWin = 11;
+    std::uint64_t seed = 1;
+};
+
+// Counters a shard updates as it goes and anyone may read, without locking
+struct alignas(64) MatchShardStats {
+    std::atomic<std::uint64_t> ticks {0};
+    std::atomic<std::uint64_t> received {0};
+    std::atomic<std::uint64_t> rejectedWatches {0};
+    std::atomic<std::uint64_t> sent {0};
+    std::atomic<std::uint64_t> sentBytes {0};
+    std::atomic<std::uint64_t> tickNanoseconds {0};
+    std::atomic<std::uint64_t> maxTickNanoseconds {0};
+};
+
+// The matches of one shard with their own socket and buffers. Nothing is shared with other
+// shards, so each runs on its own thread without any locking.
+class MatchShard {
+public:
+    MatchShard(std::uint32_t shard, const MatchServerSettings& settings) :
+        shard(shard),
+        settings(settings),
+        codec(settings.tickRate) {
+
+        for (std::uint32_t index = shard; index < settings.matchCount; index += settings.shardCount) {
+            ServedMatch served;
+            served.index = index;
+            resetMatch(served.state, settings.seed + index);
+            matches.push_back(served);
+        }
+    }
+
+    // Every tick sends a burst of states, one per player, the buffers are sized to hold it
+    bool open(std::uint16_t port, std::uint32_t address = INADDR_ANY) {
+        if (!socket.open(port, address)) {
+            return false;
+        }
+        socket.setBufferSizes(SocketBufferSize);
+        return true;
+    }
+
+    // Applies every input and watch waiting on the socket, later inputs replace earlier ones
+    void receiveInputs() {
+        while (std::size_t count = incoming.receive(socket)) {
+            for (std::size_t i = 0; i < count; i++) {
+                ServerInput input;
+                ServerWatch watch;
+                if (decodeServerInput(incoming[i].bytes, incoming[i].size, input) && owns(input.match)) {
+                    ServedMatch& served = matches[input.match / settings.shardCount];
+                    Player& player = served.players[input.side == PaddleSide::Left ? 0 : 1];
+                    join(player, incoming[i].address, input.acknowledgedTick);
+                    player.action = input.action;
+                } else if (decodeServerWatch(incoming[i].bytes, incoming[i].size, watch) && owns(watch.match)) {
+                    ServedMatch& served = matches[watch.match / settings.shardCount];
+                    if (Player* watcher = findWatcher(served, incoming[i].address)) {
+                        join(*watcher, incoming[i].address, watch.acknowledgedTick);
+                    } else {
+                        stats.rejectedWatches.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+            stats.received.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    // Steps every match and sends its state to the players and watchers that have joined,
+    // each as a delta against the newest state they have acknowledged
+    void tick() {
+        auto start = std::chrono::steady_clock::now();
+        float tickTime = 1.0f / settings.tickRate;
+        std::uint64_t sent = 0;
+        std::uint64_t sentBytes = 0;
+
+        for (ServedMatch& served : matches) {
+            MatchState& match = served.state;
+            stepMatch(match, served.players[0].action, served.players[1].action, tickTime);
+            // The next game starts at once, ticks keep counting so clients can order states
+            if (gameWon(match.pointsLeft, match.pointsRight, settings.pointsToWin)) {
+                MatchState next;
+                next.random = match.random;
+                next.tick = match.tick;
+                match = next;
+                serveBall(match);
+            }
+
+            QuantizedMatch quantized = quantizeMatch(match);
+            served.history.add(quantized);
+
+            auto sendState = [&](const Player& player) {
+                if (!player.joined) {
+                    return;
+                }
+                if (outgoing.full()) {
+                    sent += outgoing.send(socket);
+                }
+                BatchDatagram& datagram = outgoing.add(player.address);
+                const QuantizedMatch* baseline = served.history.find(player.acknowledgedTick);
+                datagram.size = static_cast<std::uint32_t>(
+                    encodeServerState(served.index, codec, quantized, baseline, datagram.bytes));
+                sentBytes += datagram.size;
+            };
+            for (const Player& player : served.players) {
+                sendState(player);
+            }
+            for (const Player& watcher : served.watchers) {
+                sendState(watcher);
+            }
+        }
+        sent += outgoing.send(socket);
+
+        std::uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        stats.ticks.fetch_add(1, std::memory_order_relaxed);
+        stats.sent.fetch_add(sent, std::memory_order_relaxed);
+        stats.sentBytes.fetch_add(sentBytes, std::memory_order_relaxed);
+        stats.tickNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        if (nanoseconds > stats.maxTickNanoseconds.load(std::memory_order_relaxed)) {
+            stats.maxTickNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+        }
+    }
+
+    // Ticks at the tick rate until running is cleared, waiting on the socket in between.
+    // A shard that falls more than a second behind skips ahead instead of catching up.
+    void run(const std::atomic<bool>& running) {
+        auto period = std::chrono::nanoseconds(1000000000 / settings.tickRate);
+        auto next = std::chrono::steady_clock::now() + period;
+
+        while (running.load(std::memory_order_relaxed)) {
+            receiveInputs();
+
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next) {
+                tick();
+                next += period;
+                if (now - next > std::chrono::seconds(1)) {
+                    next = now + period;
+                }
+                continue;
+            }
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count();
+            socket.wait(static_cast<int>(remaining));
+        }
+    }
+
+    const MatchShardStats& getStats() const {
+        return stats;
+    }
+
+    std::uint16_t getPort() const {
+        return socket.getPort();
+    }
+
+    const MatchState& getMatch(std::uint32_t index) const {
+        return matches[index / settings.shardCount].state;
+    }
+
+private:
+    struct Player {
+        sockaddr_in address;
+        std::int8_t action = 0;
+        bool joined = false;
+        std::uint32_t acknowledgedTick = 0;
+    };
+
+    struct ServedMatch {
+        std::uint32_t index = 0;
+        MatchState state;
+        SnapshotHistory history;
+        Player players[2];
+        Player watchers[MaxMatchWatchers];
+    };
+
+    bool owns(std::uint32_t match) const {
+        return match % settings.shardCount == shard && match < settings.matchCount;
+    }
+
+    // The slot a watch from an address goes to, the one it already has or a free one. Returns
+    // nullptr when every slot is taken by someone else.
+    static Player* findWatcher(ServedMatch& served, const sockaddr_in& from) {
+        Player* free = nullptr;
+        for (Player& watcher : served.watchers) {
+            if (!watcher.joined) {
+                free = free ? free : &watcher;
+            } else if (watcher.address.sin_addr.s_addr == from.sin_addr.s_addr && watcher.address.sin_port == from.sin_port) {
+                return &watcher;
+            }
+        }
+        return free;
+    }
+
+    // Inputs may arrive out of order, the newest acknowledgement wins. A new client has
+    // none of the states the previous one acknowledged.
+    static void join(Player& player, const sockaddr_in& from, std::uint32_t acknowledgedTick) {
+        bool sameClient = player.joined &&
+            player.address.sin_addr.s_addr == from.sin_addr.s_addr &&
+            player.address.sin_port == from.sin_port;
+        player.acknowledgedTick = sameClient ? std::max(player.acknowledgedTick, acknowledgedTick) : acknowledgedTick;
+        player.address = from;
+        player.joined = true;
+    }
+
+    std::uint32_t shard;
+    MatchServerSettings settings;
+    DeltaSnapshotCodec codec;
+    std::vector<ServedMatch> matches;
+
+    UdpSocket socket;
+    DatagramBatch incoming;
+    DatagramBatch outgoing;
+    MatchShardStats stats;
+};
+
+#endif // PONG_MATCH_SERVER_H
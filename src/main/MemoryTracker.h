@@ -0,0 +1,320 @@
+#ifndef PONG_MEMORY_TRACKER_H
+#define PONG_MEMORY_TRACKER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Subsystems memory is charged to. Heap allocations go to the tag of the innermost
+// MemoryTagScope on the allocating thread, GPU objects to the tag of their kind.
+enum class MemoryTag : std::uint8_t {
+    Untagged,
+    Renderer,
+    Gui,
+    Mesh,
+    Image,
+    Simulation
+};
+
+const std::size_t MemoryTagCount = 6;
+
+inline const char* memoryTagName(MemoryTag tag) {
+    switch (tag) {
+        case MemoryTag::Untagged : return "untagged";
+        case MemoryTag::Renderer : return "renderer";
+        case MemoryTag::Gui : return "gui";
+        case MemoryTag::Mesh : return "mesh";
+        case MemoryTag::Image : return "image";
+        case MemoryTag::Simulation : return "simulation";
+    }
+    return "untagged";
+}
+
+// Heap use of one tag, only counted in builds with PONG_TRACK_ALLOCATIONS
+struct MemoryTagStats {
+    std::int64_t liveBytes = 0;
+    std::int64_t liveAllocations = 0;
+    std::uint64_t allocations = 0;
+    std::int64_t highWaterBytes = 0;
+};
+
+// Updated from operator new and delete on any thread, so there is one set of relaxed
+// counters per tag and one for all of them after those
+struct MemoryTagCounters {
+    std::atomic<std::int64_t> liveBytes;
+    std::atomic<std::int64_t> liveAllocations;
+    std::atomic<std::uint64_t> allocations;
+    std::atomic<std::int64_t> highWaterBytes;
+};
+
+inline MemoryTagCounters memoryTagCounters[MemoryTagCount + 1];
+inline thread_local MemoryTag currentMemoryTag = MemoryTag::Untagged;
+
+inline void chargeMemoryTag(MemoryTagCounters& counters, std::int64_t bytes) {
+    std::int64_t live = counters.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    counters.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    std::int64_t highWater = counters.highWaterBytes.load(std::memory_order_relaxed);
+    while (live > highWater && !counters.highWaterBytes.compare_exchange_weak(highWater, live, std::memory_order_relaxed)) {
+    }
+}
+
+inline void chargeMemoryTag(MemoryTag tag, std::size_t bytes) {
+    chargeMemoryTag(memoryTagCounters[static_cast<std::size_t>(tag)], static_cast<std::int64_t>(bytes));
+    chargeMemoryTag(memoryTagCounters[MemoryTagCount], static_cast<std::int64_t>(bytes));
+}
+
+inline void releaseMemoryTag(MemoryTag tag, std::size_t bytes) {
+    for (std::size_t index : {static_cast<std::size_t>(tag), MemoryTagCount}) {
+        memoryTagCounters[index].liveBytes.fetch_sub(static_cast<std::int64_t>(bytes), std::memory_order_relaxed);
+        memoryTagCounters[index].liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+// Charges what this thread allocates while in scope to a tag, scopes nest
+class MemoryTagScope {
+public:
+    explicit MemoryTagScope(MemoryTag tag) :
+        previous(currentMemoryTag) {
+        currentMemoryTag = tag;
+    }
+
+    ~MemoryTagScope() {
+        currentMemoryTag = previous;
+    }
+
+    MemoryTagScope(const MemoryTagScope&) = delete;
+    MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+
+private:
+    MemoryTag previous;
+};
+
+enum class GpuObjectKind : std::uint8_t {
+    Texture,
+    VertexBuffer,
+    IndexBuffer,
+    UniformBuffer,
+    StreamBuffer
+};
+
+inline const char* gpuObjectKindName(GpuObjectKind kind) {
+    switch (kind) {
+        case GpuObjectKind::Texture : return "texture";
+        case GpuObjectKind::VertexBuffer : return "vertex buffer";
+        case GpuObjectKind::IndexBuffer : return "index buffer";
+        case GpuObjectKind::UniformBuffer : return "uniform buffer";
+        case GpuObjectKind::StreamBuffer : return "stream buffer";
+    }
+    return "buffer";
+}
+
+inline MemoryTag gpuObjectTag(GpuObjectKind kind) {
+    switch (kind) {
+        case GpuObjectKind::Texture : return MemoryTag::Image;
+        case GpuObjectKind::VertexBuffer : return MemoryTag::Mesh;
+        case GpuObjectKind::IndexBuffer : return MemoryTag::Mesh;
+        case GpuObjectKind::UniformBuffer : return MemoryTag::Renderer;
+        case GpuObjectKind::StreamBuffer : return MemoryTag::Renderer;
+    }
+    return MemoryTag::Renderer;
+}
+
+// GL names are unique within a namespace, and every kind of buffer shares one
+enum class GpuNamespace : std::uint8_t {
+    Buffer,
+    Texture
+};
+
+inline GpuNamespace gpuObjectNamespace(GpuObjectKind kind) {
+    return kind == GpuObjectKind::Texture ? GpuNamespace::Texture : GpuNamespace::Buffer;
+}
+
+// A GL object and the memory its data takes, an estimate since drivers may pad or convert it
+struct GpuObjectUsage {
+    GpuObjectKind kind = GpuObjectKind::Texture;
+    std::uint32_t name = 0;
+    std::uint64_t bytes = 0;
+};
+
+struct GpuMemoryStats {
+    std::uint64_t bytes = 0;
+    std::uint64_t highWaterBytes = 0;
+    std::uint32_t objectCount = 0;
+};
+
+// Memory use per tag, heap use from the counters above and GPU use from the objects the
+// renderer reports as it creates them. Deleting a GL object through GlObject removes it
+// again, whoever frees it. Everything can be queried while the game runs or written out
+// as JSON.
+class MemoryTracker {
+public:
+    MemoryTracker() = default;
+    MemoryTracker(const MemoryTracker&) = delete;
+    MemoryTracker& operator=(const MemoryTracker&) = delete;
+
+    static bool tracksHeap() {
+#if defined(PONG_TRACK_ALLOCATIONS)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    MemoryTagStats getHeapStats(MemoryTag tag) const {
+        return readCounters(memoryTagCounters[static_cast<std::size_t>(tag)]);
+    }
+
+    MemoryTagStats getHeapTotal() const {
+        return readCounters(memoryTagCounters[MemoryTagCount]);
+    }
+
+    // An object created again under the same name replaces the old one
+    void addGpuObject(GpuObjectKind kind, std::uint32_t name, std::uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        removeLocked(gpuObjectNamespace(kind), name);
+
+        GpuObjectUsage& object = gpuObjects[key(gpuObjectNamespace(kind), name)];
+        object.kind = kind;
+        object.name = name;
+        object.bytes = bytes;
+
+        GpuMemoryStats& stats = gpuStats[static_cast<std::size_t>(gpuObjectTag(kind))];
+        stats.bytes += bytes;
+        stats.objectCount++;
+        stats.highWaterBytes = std::max(stats.highWaterBytes, stats.bytes);
+        gpuTotal.bytes += bytes;
+        gpuTotal.objectCount++;
+        gpuTotal.highWaterBytes = std::max(gpuTotal.highWaterBytes, gpuTotal.bytes);
+    }
+
+    // Names that were never added are ignored, not every buffer or texture is tracked
+    void removeGpuObject(GpuNamespace space, std::uint32_t name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        removeLocked(space, name);
+    }
+
+    // For a lost context, whose objects are gone without being deleted one by one
+    void clearGpuObjects() {
+        std::lock_guard<std::mutex> lock(mutex);
+        gpuObjects.clear();
+        for (GpuMemoryStats& stats : gpuStats) {
+            stats.bytes = 0;
+            stats.objectCount = 0;
+        }
+        gpuTotal.bytes = 0;
+        gpuTotal.objectCount = 0;
+    }
+
+    GpuMemoryStats getGpuStats(MemoryTag tag) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return gpuStats[static_cast<std::size_t>(tag)];
+    }
+
+    GpuMemoryStats getGpuTotal() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return gpuTotal;
+    }
+
+    std::vector<GpuObjectUsage> getGpuObjects() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<GpuObjectUsage> objects;
+        objects.reserve(gpuObjects.size());
+        for (const auto& entry : gpuObjects) {
+            objects.push_back(entry.second);
+        }
+        return objects;
+    }
+
+    void writeJson(std::ostream& out) const {
+        out << "{\n  \"heapTracked\": " << (tracksHeap() ? "true" : "false") << ",\n  \"heap\": {\n";
+        for (std::size_t i = 0; i <= MemoryTagCount; i++) {
+            MemoryTagStats stats = i < MemoryTagCount ? getHeapStats(static_cast<MemoryTag>(i)) : getHeapTotal();
+            out << "    \"" << (i < MemoryTagCount ? memoryTagName(static_cast<MemoryTag>(i)) : "total") << "\": {"
+                << "\"liveBytes\": " << stats.liveBytes
+                << ", \"liveAllocations\": " << stats.liveAllocations
+                << ", \"allocations\": " << stats.allocations
+                << ", \"highWaterBytes\": " << stats.highWaterBytes
+                << "}" << (i < MemoryTagCount ? ",\n" : "\n");
+        }
+
+        out << "  },\n  \"gpu\": {\n";
+        for (std::size_t i = 0; i <= MemoryTagCount; i++) {
+            GpuMemoryStats stats = i < MemoryTagCount ? getGpuStats(static_cast<MemoryTag>(i)) : getGpuTotal();
+            out << "    \"" << (i < MemoryTagCount ? memoryTagName(static_cast<MemoryTag>(i)) : "total") << "\": {"
+                << "\"bytes\": " << stats.bytes
+                << ", \"highWaterBytes\": " << stats.highWaterBytes
+                << ", \"objects\": " << stats.objectCount
+                << "},\n";
+        }
+
+        out << "    \"objects\": [";
+        std::vector<GpuObjectUsage> objects = getGpuObjects();
+        for (std::size_t i = 0; i < objects.size(); i++) {
+            out << (i == 0 ? "\n" : ",\n")
+                << "      {\"kind\": \"" << gpuObjectKindName(objects[i].kind) << "\""
+                << ", \"name\": " << objects[i].name
+                << ", \"tag\": \"" << memoryTagName(gpuObjectTag(objects[i].kind)) << "\""
+                << ", \"bytes\": " << objects[i].bytes << "}";
+        }
+        out << (objects.empty() ? "]\n" : "\n    ]\n") << "  }\n}\n";
+    }
+
+    bool saveJson(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            return false;
+        }
+        writeJson(out);
+        return static_cast<bool>(out);
+    }
+
+private:
+    static std::uint64_t key(GpuNamespace space, std::uint32_t name) {
+        return (static_cast<std::uint64_t>(space) << 32) | name;
+    }
+
+    static MemoryTagStats readCounters(const MemoryTagCounters& counters) {
+        MemoryTagStats stats;
+        stats.liveBytes = counters.liveBytes.load(std::memory_order_relaxed);
+        stats.liveAllocations = counters.liveAllocations.load(std::memory_order_relaxed);
+        stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+        stats.highWaterBytes = counters.highWaterBytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void removeLocked(GpuNamespace space, std::uint32_t name) {
+        auto found = gpuObjects.find(key(space, name));
+        if (found == gpuObjects.end()) {
+            return;
+        }
+
+        GpuMemoryStats& stats = gpuStats[static_cast<std::size_t>(gpuObjectTag(found->second.kind))];
+        stats.bytes -= found->second.bytes;
+        stats.objectCount--;
+        gpuTotal.bytes -= found->second.bytes;
+        gpuTotal.objectCount--;
+        gpuObjects.erase(found);
+    }
+
+    mutable std::mutex mutex;
+    std::map<std::uint64_t, GpuObjectUsage> gpuObjects;
+    GpuMemoryStats gpuStats[MemoryTagCount];
+    GpuMemoryStats gpuTotal;
+};
+
+// Never destroyed, GL objects held by globals still report to it while the program exits
+inline MemoryTracker& memoryTracker() {
+    static MemoryTracker* tracker = new MemoryTracker();
+    return *tracker;
+}
+
+#endif // PONG_MEMORY_TRACKER_H
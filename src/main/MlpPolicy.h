@@ -0,0 +1,286 @@
+#ifndef PONG_MLP_POLICY_H
+#define PONG_MLP_POLICY_H
+
+#include "PaddleController.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PONG_MLP_AVX2
+#include <immintrin.h>
+#endif
+
+// A fully connected layer, weights are stored one row of inputCount per output
+struct MlpLayer {
+    std::uint32_t inputCount = 0;
+    std::uint32_t outputCount = 0;
+    std::vector<float> weights;
+    std::vector<float> biases;
+};
+
+// Activations are processed in blocks of this many matches through every layer, so a
+// block stays in cache from the first layer to the last
+const std::size_t MlpBlockColumns = 128;
+
+// Kernels compute outputs = weights * inputs + biases for a block. Inputs and outputs hold
+// one row per neuron, columns floats apart, where columns is a multiple of 16. Hidden layers
+// cut negative outputs to zero.
+void denseLayerScalar(const MlpLayer& layer, const float* inputs, float* outputs, std::size_t columns, bool relu) {
+    for (std::uint32_t o = 0; o < layer.outputCount; o++) {
+        float* row = outputs + o * columns;
+        const float* weights = layer.weights.data() + o * layer.inputCount;
+        std::fill(row, row + columns, layer.biases[o]);
+
+        for (std::uint32_t k = 0; k < layer.inputCount; k++) {
+            float weight = weights[k];
+            const float* input = inputs + k * columns;
+            for (std::size_t c = 0; c < columns; c++) {
+                row[c] += weight * input[c];
+            }
+        }
+
+        if (relu) {
+            for (std::size_t c = 0; c < columns; c++) {
+                row[c] = std::max(row[c], 0.0f);
+            }
+        }
+    }
+}
+
+#ifdef PONG_MLP_AVX2
+
+bool mlpAvx2Supported() {
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+// Register blocked over 4 outputs and 16 columns, which keeps 8 accumulators and leaves
+// room for the two input vectors and a broadcast weight
+__attribute__((target("avx2,fma")))
+void denseLayerAvx2(const MlpLayer& layer, const float* inputs, float* outputs, std::size_t columns, bool relu) {
+    const std::uint32_t inputCount = layer.inputCount;
+    const float* weights = layer.weights.data();
+    const __m256 zero = _mm256_setzero_ps();
+
+    std::uint32_t o = 0;
+    for (; o + 4 <= layer.outputCount; o += 4) {
+        for (std::size_t c = 0; c < columns; c += 16) {
+            __m256 accumulators[4][2];
+            for (int r = 0; r < 4; r++) {
+                accumulators[r][0] = _mm256_set1_ps(layer.biases[o + r]);
+                accumulators[r][1] = accumulators[r][0];
+            }
+
+            for (std::uint32_t k = 0; k < inputCount; k++) {
+                __m256 x0 = _mm256_loadu_ps(inputs + k * columns + c);
+                __m256 x1 = _mm256_loadu_ps(inputs + k * columns + c + 8);
+                for (int r = 0; r < 4; r++) {
+                    __m256 weight = _mm256_broadcast_ss(weights + (o + r) * inputCount + k);
+                    accumulators[r][0] = _mm256_fmadd_ps(weight, x0, accumulators[r][0]);
+                    accumulators[r][1] = _mm256_fmadd_ps(weight, x1, accumulators[r][1]);
+                }
+            }
+
+            for (int r = 0; r < 4; r++) {
+                if (relu) {
+                    accumulators[r][0] = _mm256_max_ps(accumulators[r][0], zero);
+                    accumulators[r][1] = _mm256_max_ps(accumulators[r][1], zero);
+                }
+                _mm256_storeu_ps(outputs + (o + r) * columns + c, accumulators[r][0]);
+                _mm256_storeu_ps(outputs + (o + r) * columns + c + 8, accumulators[r][1]);
+            }
+        }
+    }
+
+    for (; o < layer.outputCount; o++) {
+        for (std::size_t c = 0; c < columns; c += 16) {
+            __m256 accumulator0 = _mm256_set1_ps(layer.biases[o]);
+            __m256 accumulator1 = accumulator0;
+
+            for (std::uint32_t k = 0; k < inputCount; k++) {
+                __m256 weight = _mm256_broadcast_ss(weights + o * inputCount + k);
+                accumulator0 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(inputs + k * columns + c), accumulator0);
+                accumulator1 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(inputs + k * columns + c + 8), accumulator1);
+            }
+
+            if (relu) {
+                accumulator0 = _mm256_max_ps(accumulator0, zero);
+                accumulator1 = _mm256_max_ps(accumulator1, zero);
+            }
+            _mm256_storeu_ps(outputs + o * columns + c, accumulator0);
+            _mm256_storeu_ps(outputs + o * columns + c + 8, accumulator1);
+        }
+    }
+}
+
+#else
+
+bool mlpAvx2Supported() {
+    return false;
+}
+
+#endif
+
+// A learned paddle policy. Observations go in unscaled, so any normalization has to be
+// folded into the first layer. Hidden layers use ReLU and the single output is clamped to
+// the -1 to 1 action range. AVX2 kernels are used when the processor has them.
+//
+// Policy files start with "PMLP", a version and the layer count as 32 bit integers,
+// followed by each layer's input and output counts, its weights and its biases.
+// Values are stored in native byte order.
+class MlpPolicy : public BatchPaddleController, public PaddleController {
+public:
+    // Layers must chain from PaddleObservationSize inputs to a single output, as load checks
+    explicit MlpPolicy(std::vector<MlpLayer> layers) :
+        layers(std::move(layers)) {
+
+        for (const MlpLayer& layer : this->layers) {
+            maxWidth = std::max<std::size_t>(maxWidth, std::max(layer.inputCount, layer.outputCount));
+        }
+    }
+
+    // Returns nullptr if the file cannot be read or does not map observations to one action
+    static std::shared_ptr<MlpPolicy> load(const std::string& path) {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if (!ifs.is_open()) {
+            return nullptr;
+        }
+
+        char magic[4];
+        std::uint32_t version = 0;
+        std::uint32_t layerCount = 0;
+        ifs.read(magic, sizeof(magic));
+        ifs.read(reinterpret_cast<char*>(&version), sizeof(version));
+        ifs.read(reinterpret_cast<char*>(&layerCount), sizeof(layerCount));
+        if (!ifs || std::memcmp(magic, "PMLP", 4) != 0 || version != FileVersion ||
+            layerCount == 0 || layerCount > MaxLayers) {
+            return nullptr;
+        }
+
+        std::vector<MlpLayer> layers(layerCount);
+        std::uint32_t expectedInputs = PaddleObservationSize;
+        for (MlpLayer& layer : layers) {
+            ifs.read(reinterpret_cast<char*>(&layer.inputCount), sizeof(layer.inputCount));
+            ifs.read(reinterpret_cast<char*>(&layer.outputCount), sizeof(layer.outputCount));
+            if (!ifs || layer.inputCount != expectedInputs || layer.outputCount == 0 || layer.outputCount > MaxWidth) {
+                return nullptr;
+            }
+
+            layer.weights.resize(layer.inputCount * layer.outputCount);
+            layer.biases.resize(layer.outputCount);
+            ifs.read(reinterpret_cast<char*>(layer.weights.data()), layer.weights.size() * sizeof(float));
+            ifs.read(reinterpret_cast<char*>(layer.biases.data()), layer.biases.size() * sizeof(float));
+            expectedInputs = layer.outputCount;
+        }
+
+        if (!ifs || expectedInputs != 1) {
+            return nullptr;
+        }
+
+        return std::make_shared<MlpPolicy>(std::move(layers));
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream ofs(path, std::ios::out | std::ios::binary);
+        if (!ofs.is_open()) {
+            return false;
+        }
+
+        std::uint32_t version = FileVersion;
+        std::uint32_t layerCount = layers.size();
+        ofs.write("PMLP", 4);
+        ofs.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        ofs.write(reinterpret_cast<const char*>(&layerCount), sizeof(layerCount));
+
+        for (const MlpLayer& layer : layers) {
+            ofs.write(reinterpret_cast<const char*>(&layer.inputCount), sizeof(layer.inputCount));
+            ofs.write(reinterpret_cast<const char*>(&layer.outputCount), sizeof(layer.outputCount));
+            ofs.write(reinterpret_cast<const char*>(layer.weights.data()), layer.weights.size() * sizeof(float));
+            ofs.write(reinterpret_cast<const char*>(layer.biases.data()), layer.biases.size() * sizeof(float));
+        }
+
+        return static_cast<bool>(ofs);
+    }
+
+    // Safe to call from several threads at once, each thread has its own scratch space
+    void act(const PaddleObservationBatch& batch, float* actions) override {
+        const float* features[PaddleObservationSize] = {
+            batch.ballX, batch.ballY, batch.ballVelocityX, batch.ballVelocityY, batch.paddleY, batch.opponentY
+        };
+
+        thread_local std::vector<float> scratch;
+        scratch.resize(std::max(scratch.size(), maxWidth * MlpBlockColumns * 2));
+
+        for (std::size_t start = 0; start < batch.count; start += MlpBlockColumns) {
+            std::size_t count = std::min(MlpBlockColumns, batch.count - start);
+            std::size_t columns = (count + 15) / 16 * 16;
+
+            float* current = scratch.data();
+            float* next = current + maxWidth * MlpBlockColumns;
+
+            for (std::size_t k = 0; k < PaddleObservationSize; k++) {
+                float* row = current + k * columns;
+                std::copy(features[k] + start, features[k] + start + count, row);
+                std::fill(row + count, row + columns, 0.0f);
+            }
+
+            for (std::size_t i = 0; i < layers.size(); i++) {
+                bool relu = i + 1 < layers.size();
+#ifdef PONG_MLP_AVX2
+                if (simd) {
+                    denseLayerAvx2(layers[i], current, next, columns, relu);
+                } else {
+                    denseLayerScalar(layers[i], current, next, columns, relu);
+                }
+#else
+                denseLayerScalar(layers[i], current, next, columns, relu);
+#endif
+                std::swap(current, next);
+            }
+
+            for (std::size_t c = 0; c < count; c++) {
+                actions[start + c] = std::min(1.0f, std::max(-1.0f, current[c]));
+            }
+        }
+    }
+
+    float act(const PaddleObservation& observation) override {
+        float data[PaddleObservationSize];
+        storePaddleObservation(observation, data, 1, 0);
+
+        float action = 0.0;
+        act(PaddleObservationBatch::fromBuffer(data, 1), &action);
+        return action;
+    }
+
+    // Falls back to the scalar kernels when disabled or not supported
+    void setSimd(bool enabled) {
+        simd = enabled && mlpAvx2Supported();
+    }
+
+    bool getSimd() const {
+        return simd;
+    }
+
+    const std::vector<MlpLayer>& getLayers() const {
+        return layers;
+    }
+
+private:
+    static constexpr std::uint32_t FileVersion = 1;
+    static constexpr std::uint32_t MaxLayers = 64;
+    static constexpr std::uint32_t MaxWidth = 4096;
+
+    std::vector<MlpLayer> layers;
+    std::size_t maxWidth = PaddleObservationSize;
+    bool simd = mlpAvx2Supported();
+};
+
+#endif // PONG_MLP_POLICY_H
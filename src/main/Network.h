@@ -0,0 +1,360 @@
+#ifndef PONG_NETWORK_H
+#define PONG_NETWORK_H
+
+#include "ObjectPool.h"
+#include "Randomizer.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+using SocketHandle = SOCKET;
+const SocketHandle NoSocket = INVALID_SOCKET;
+#else
+using SocketHandle = int;
+const SocketHandle NoSocket = -1;
+#endif
+
+// Non-blocking UDP socket bound to a local IPv4 port
+class UdpSocket {
+public:
+    UdpSocket() = default;
+
+    ~UdpSocket() {
+        close();
+    }
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    // Port 0 lets the system pick one, see getPort. Returns false if the socket could not
+    // be opened or the port is taken.
+    bool open(std::uint16_t port, std::uint32_t address = INADDR_LOOPBACK) {
+        close();
+
+#if defined(_WIN32)
+        static bool started = false;
+        WSADATA data;
+        if (!started && WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+            return false;
+        }
+        started = true;
+#endif
+
+        descriptor = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (descriptor == NoSocket) {
+            return false;
+        }
+
+        sockaddr_in local = makeAddress(address, port);
+        socklen_t length = sizeof(local);
+        if (::bind(descriptor, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 ||
+            ::getsockname(descriptor, reinterpret_cast<sockaddr*>(&local), &length) != 0 ||
+            !makeNonBlocking()) {
+            close();
+            return false;
+        }
+
+        boundPort = ntohs(local.sin_port);
+        return true;
+    }
+
+    void close() {
+        if (descriptor != NoSocket) {
+#if defined(_WIN32)
+            ::closesocket(descriptor);
+#else
+            ::close(descriptor);
+#endif
+            descriptor = NoSocket;
+        }
+    }
+
+    bool send(const sockaddr_in& to, const std::uint8_t* data, std::size_t size) {
+        auto sent = ::sendto(
+            descriptor,
+            reinterpret_cast<const char*>(data),
+            size,
+            0,
+            reinterpret_cast<const sockaddr*>(&to),
+            sizeof(to));
+        return sent == static_cast<decltype(sent)>(size);
+    }
+
+    // Returns the size of the datagram read into buffer, or 0 when none is waiting
+    std::size_t receive(std::uint8_t* buffer, std::size_t capacity, sockaddr_in& from) {
+        socklen_t length = sizeof(from);
+        auto size = ::recvfrom(
+            descriptor,
+            reinterpret_cast<char*>(buffer),
+            capacity,
+            0,
+            reinterpret_cast<sockaddr*>(&from),
+            &length);
+        return size > 0 ? static_cast<std::size_t>(size) : 0;
+    }
+
+    // Asks for larger kernel buffers, so bursts of datagrams are not dropped. The system may
+    // grant less, up to its own limit.
+    void setBufferSizes(int bytes) {
+        ::setsockopt(descriptor, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+        ::setsockopt(descriptor, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+    }
+
+    // Waits until a datagram is waiting or the timeout in milliseconds has passed
+    bool wait(int timeout) {
+        pollfd request {descriptor, POLLIN, 0};
+#if defined(_WIN32)
+        return ::WSAPoll(&request, 1, timeout) > 0;
+#else
+        return ::poll(&request, 1, timeout) > 0;
+#endif
+    }
+
+    SocketHandle getDescriptor() const {
+        return descriptor;
+    }
+
+    std::uint16_t getPort() const {
+        return boundPort;
+    }
+
+    static sockaddr_in makeAddress(std::uint32_t address, std::uint16_t port) {
+        sockaddr_in result;
+        std::memset(&result, 0, sizeof(result));
+        result.sin_family = AF_INET;
+        result.sin_addr.s_addr = htonl(address);
+        result.sin_port = htons(port);
+        return result;
+    }
+
+private:
+    bool makeNonBlocking() {
+#if defined(_WIN32)
+        u_long enabled = 1;
+        return ::ioctlsocket(descriptor, FIONBIO, &enabled) == 0;
+#else
+        return ::fcntl(descriptor, F_SETFL, ::fcntl(descriptor, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+    }
+
+    SocketHandle descriptor = NoSocket;
+    std::uint16_t boundPort = 0;
+};
+
+const std::size_t MaxBatchDatagramSize = 128;
+
+struct BatchDatagram {
+    sockaddr_in address;
+    std::uint32_t size = 0;
+    std::uint8_t bytes[MaxBatchDatagramSize];
+};
+
+// Sends or receives many small datagrams with one system call, with recvmmsg and sendmmsg
+// on Linux and one call per datagram elsewhere. The message headers point into the
+// datagrams once and for all, so a batch can be reused without setting anything up again.
+class DatagramBatch {
+public:
+    explicit DatagramBatch(std::size_t capacity = 64) :
+        datagrams(capacity) {
+#if defined(__linux__)
+        messages.resize(capacity);
+        vectors.resize(capacity);
+        for (std::size_t i = 0; i < capacity; i++) {
+            vectors[i].iov_base = datagrams[i].bytes;
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &datagrams[i].address;
+        }
+#endif
+    }
+
+    DatagramBatch(const DatagramBatch&) = delete;
+    DatagramBatch& operator=(const DatagramBatch&) = delete;
+
+    // Replaces the batch with the datagrams waiting on the socket, as many as fit
+    std::size_t receive(UdpSocket& socket) {
+        count = 0;
+#if defined(__linux__)
+        for (std::size_t i = 0; i < datagrams.size(); i++) {
+            vectors[i].iov_len = MaxBatchDatagramSize;
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        int received = ::recvmmsg(socket.getDescriptor(), messages.data(), datagrams.size(), MSG_DONTWAIT, nullptr);
+        for (int i = 0; i < received; i++) {
+            datagrams[i].size = messages[i].msg_len;
+        }
+        count = received > 0 ? received : 0;
+#else
+        while (count < datagrams.size()) {
+            std::size_t size = socket.receive(datagrams[count].bytes, MaxBatchDatagramSize, datagrams[count].address);
+            if (size == 0) {
+                break;
+            }
+            datagrams[count++].size = size;
+        }
+#endif
+        return count;
+    }
+
+    // Adds a datagram to send, the caller fills in its bytes and size
+    BatchDatagram& add(const sockaddr_in& to) {
+        BatchDatagram& datagram = datagrams[count++];
+        datagram.address = to;
+        return datagram;
+    }
+
+    // Sends every datagram added and empties the batch. Returns how many went out,
+    // datagrams the socket had no room for are dropped as the network could have.
+    std::size_t send(UdpSocket& socket) {
+        std::size_t sent = 0;
+#if defined(__linux__)
+        for (std::size_t i = 0; i < count; i++) {
+            vectors[i].iov_len = datagrams[i].size;
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        while (sent < count) {
+            int result = ::sendmmsg(socket.getDescriptor(), messages.data() + sent, count - sent, MSG_DONTWAIT);
+            if (result <= 0) {
+                break;
+            }
+            sent += result;
+        }
+#else
+        for (std::size_t i = 0; i < count; i++) {
+            sent += socket.send(datagrams[i].address, datagrams[i].bytes, datagrams[i].size);
+        }
+#endif
+        count = 0;
+        return sent;
+    }
+
+    bool full() const {
+        return count == datagrams.size();
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    BatchDatagram& operator[](std::size_t i) {
+        return datagrams[i];
+    }
+
+private:
+    std::vector<BatchDatagram> datagrams;
+    std::size_t count = 0;
+#if defined(__linux__)
+    std::vector<mmsghdr> messages;
+    std::vector<iovec> vectors;
+#endif
+};
+
+// One way conditions of a simulated network link. Times are in seconds, jitter adds a
+// uniform delay of up to its value and loss is the fraction of datagrams dropped.
+struct LinkConditions {
+    double latency = 0.0;
+    double jitter = 0.0;
+    float loss = 0.0;
+};
+
+// Sits in front of a socket and holds outgoing datagrams back as a worse network would,
+// so network play can be tried on one machine. Jitter lets later datagrams overtake
+// earlier ones. Times are whatever clock the caller uses, in seconds.
+//
+// Held datagrams live in a pool, so sending allocates nothing. Like a router with a full
+// queue, datagrams that find the pool empty or are too large for it are dropped.
+class LinkShim {
+public:
+    static constexpr std::size_t MaxHeldDatagrams = 4096;
+
+    LinkShim(UdpSocket& socket, LinkConditions conditions, std::uint64_t seed = 1) :
+        socket(socket),
+        conditions(conditions),
+        random(seed),
+        datagrams(MaxHeldDatagrams) {
+        queue.reserve(MaxHeldDatagrams);
+    }
+
+    void send(const sockaddr_in& to, const std::uint8_t* data, std::size_t size, double now) {
+        if (random.random() < conditions.loss) {
+            dropped++;
+            return;
+        }
+
+        double delay = conditions.latency + conditions.jitter * random.random();
+        if (delay <= 0.0) {
+            socket.send(to, data, size);
+            return;
+        }
+
+        Datagram* datagram = size <= MaxBatchDatagramSize ? datagrams.acquire() : nullptr;
+        if (!datagram) {
+            dropped++;
+            return;
+        }
+
+        datagram->time = now + delay;
+        datagram->to = to;
+        datagram->size = static_cast<std::uint32_t>(size);
+        std::memcpy(datagram->bytes, data, size);
+        queue.push_back(datagram);
+        std::push_heap(queue.begin(), queue.end(), later);
+    }
+
+    // Sends every datagram whose delay has passed
+    void flush(double now) {
+        while (!queue.empty() && queue.front()->time <= now) {
+            std::pop_heap(queue.begin(), queue.end(), later);
+            Datagram* datagram = queue.back();
+            socket.send(datagram->to, datagram->bytes, datagram->size);
+            queue.pop_back();
+            datagrams.release(datagram);
+        }
+    }
+
+    void setConditions(LinkConditions newConditions) {
+        conditions = newConditions;
+    }
+
+    std::uint64_t getDropped() const {
+        return dropped;
+    }
+
+private:
+    struct Datagram {
+        double time;
+        sockaddr_in to;
+        std::uint32_t size;
+        std::uint8_t bytes[MaxBatchDatagramSize];
+    };
+
+    // Orders the heap so the datagram due first is on top
+    static bool later(const Datagram* a, const Datagram* b) {
+        return a->time > b->time;
+    }
+
+    UdpSocket& socket;
+    LinkConditions conditions;
+    Randomizer random;
+    ObjectPool<Datagram> datagrams;
+    std::vector<Datagram*> queue;
+    std::uint64_t dropped = 0;
+};
+
+#endif // PONG_NETWORK_H
@@ -0,0 +1,59 @@
+#ifndef PONG_OBJECT_POOL_H
+#define PONG_OBJECT_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A fixed number of objects allocated up front, handed out and taken back without going
+// through the heap. For transient objects whose lifetimes do not follow frames. Objects
+// keep whatever was in them when they come back, the caller fills them in.
+template <typename T>
+class ObjectPool {
+public:
+    explicit ObjectPool(std::size_t capacity) :
+        objects(capacity) {
+        free.reserve(capacity);
+        for (std::size_t i = capacity; i > 0; i--) {
+            free.push_back(static_cast<std::uint32_t>(i - 1));
+        }
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // Returns nullptr when every object is in use
+    T* acquire() {
+        if (free.empty()) {
+            return nullptr;
+        }
+        T* object = &objects[free.back()];
+        free.pop_back();
+        highWater = std::max(highWater, inUse());
+        return object;
+    }
+
+    void release(T* object) {
+        free.push_back(static_cast<std::uint32_t>(object - objects.data()));
+    }
+
+    std::size_t inUse() const {
+        return objects.size() - free.size();
+    }
+
+    std::size_t getCapacity() const {
+        return objects.size();
+    }
+
+    std::size_t getHighWater() const {
+        return highWater;
+    }
+
+private:
+    std::vector<T> objects;
+    std::vector<std::uint32_t> free;
+    std::size_t highWater = 0;
+};
+
+#endif // PONG_OBJECT_POOL_H
@@ -0,0 +1,328 @@
+#ifndef PONG_PADDLE_CONTROLLER_H
+#define PONG_PADDLE_CONTROLLER_H
+
+#include "Trajectory.h"
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+const float SightDistance = 350.0;
+const float IdleDistanceY = 30.0;
+const float BallToleranceY = 30.0;
+const float InterceptToleranceY = 10.0;
+
+// What a controller sees of a match. The x axis is mirrored for the left paddle, so a
+// controller always plays from the right facing left and can be used for either side.
+struct PaddleObservation {
+    glm::vec2 ballPosition;
+    glm::vec2 ballVelocity;
+    float paddleY = 0.0;
+    float opponentY = 0.0;
+};
+
+// Where the paddle stands and where the ball centre can go, in the same mirrored frame
+struct PaddleField {
+    float paddleX = 0.0;
+    float paddleFaceX = 0.0;
+    float ballMinY = 0.0;
+    float ballMaxY = 0.0;
+};
+
+const std::size_t PaddleObservationSize = 6;
+
+// Observations of many matches with one array per feature, so batched controllers
+// stream through each feature with unit stride
+struct PaddleObservationBatch {
+    std::size_t count = 0;
+    const float* ballX = nullptr;
+    const float* ballY = nullptr;
+    const float* ballVelocityX = nullptr;
+    const float* ballVelocityY = nullptr;
+    const float* paddleY = nullptr;
+    const float* opponentY = nullptr;
+
+    // Views a feature major buffer of PaddleObservationSize * count floats, in the
+    // order of the members above
+    static PaddleObservationBatch fromBuffer(const float* data, std::size_t count) {
+        PaddleObservationBatch batch;
+        batch.count = count;
+        batch.ballX = data;
+        batch.ballY = data + count;
+        batch.ballVelocityX = data + count * 2;
+        batch.ballVelocityY = data + count * 3;
+        batch.paddleY = data + count * 4;
+        batch.opponentY = data + count * 5;
+        return batch;
+    }
+
+    // Views the matches from begin up to end, for splitting a batch between threads
+    PaddleObservationBatch slice(std::size_t begin, std::size_t end) const {
+        PaddleObservationBatch batch = *this;
+        batch.count = end - begin;
+        for (const float** feature : {&batch.ballX, &batch.ballY, &batch.ballVelocityX,
+                &batch.ballVelocityY, &batch.paddleY, &batch.opponentY}) {
+            *feature += begin;
+        }
+        return batch;
+    }
+
+    PaddleObservation operator[](std::size_t i) const {
+        PaddleObservation observation;
+        observation.ballPosition = glm::vec2(ballX[i], ballY[i]);
+        observation.ballVelocity = glm::vec2(ballVelocityX[i], ballVelocityY[i]);
+        observation.paddleY = paddleY[i];
+        observation.opponentY = opponentY[i];
+        return observation;
+    }
+};
+
+// Writes the observation of match i into a feature major buffer for count matches
+void storePaddleObservation(const PaddleObservation& observation, float* data, std::size_t count, std::size_t i) {
+    data[i] = observation.ballPosition.x;
+    data[count + i] = observation.ballPosition.y;
+    data[count * 2 + i] = observation.ballVelocity.x;
+    data[count * 3 + i] = observation.ballVelocity.y;
+    data[count * 4 + i] = observation.paddleY;
+    data[count * 5 + i] = observation.opponentY;
+}
+
+// What a controller remembers between ticks, as plain data so game snapshots can hold it
+struct PaddleControllerState {
+    std::uint32_t mode = 0;
+    std::uint32_t flags = 0;
+    float values[3] = {0.0, 0.0, 0.0};
+};
+
+// Decides the vertical paddle velocity as a fraction of full speed, from -1 to 1
+class PaddleController {
+public:
+    virtual ~PaddleController() = default;
+
+    virtual float act(const PaddleObservation& observation) = 0;
+
+    // Controllers that decide from the observation alone have nothing to save
+    virtual PaddleControllerState saveState() const {
+        return PaddleControllerState();
+    }
+
+    virtual void restoreState(const PaddleControllerState&) {
+    }
+};
+
+// Decides for a whole batch of matches in one call, writing batch.count actions
+class BatchPaddleController {
+public:
+    virtual ~BatchPaddleController() = default;
+
+    virtual void act(const PaddleObservationBatch& batch, float* actions) = 0;
+};
+
+// Moves towards target once it is further away than tolerance
+float steerTowards(float target, float paddleY, float tolerance) {
+    if (target - paddleY > tolerance) {
+        return 1.0;
+    }
+    if (target - paddleY < -tolerance) {
+        return -1.0;
+    }
+    return 0.0;
+}
+
+// Driven by the keyboard, see keyCallback. The keys held are input rather than state,
+// so they are left alone when a snapshot is restored.
+class HumanController : public PaddleController {
+public:
+    float act(const PaddleObservation&) override {
+        return (movingUp ? 1.0f : 0.0f) - (movingDown ? 1.0f : 0.0f);
+    }
+
+    bool movingUp = false;
+    bool movingDown = false;
+};
+
+// Follows the height of the ball at all times
+class TrackingController : public PaddleController {
+public:
+    float act(const PaddleObservation& observation) override {
+        return steerTowards(observation.ballPosition.y, observation.paddleY, BallToleranceY);
+    }
+};
+
+enum class PaddleAiState {
+    Idle,
+    GoingToIdle,
+    CatchingBall
+};
+
+// Waits in the middle until the ball comes within sight, catches it and goes back.
+// A predictive controller heads for where the ball will cross the paddle instead of
+// chasing its current height.
+class StateMachineController : public PaddleController {
+public:
+    StateMachineController(PaddleField field, bool predictive) :
+        field(field),
+        predictive(predictive) {
+    }
+
+    float act(const PaddleObservation& observation) override {
+        bool approaching = observation.ballVelocity.x > 0.0 &&
+            std::abs(observation.ballPosition.x - field.paddleX) < SightDistance;
+
+        float velocityY = 0.0;
+
+        switch (state) {
+
+            case PaddleAiState::Idle :
+                if (approaching) {
+                    state = PaddleAiState::CatchingBall;
+                }
+                break;
+
+            case PaddleAiState::CatchingBall :
+                if (approaching) {
+                    velocityY = predictive ?
+                        steerTowards(interceptY(observation), observation.paddleY, InterceptToleranceY) :
+                        steerTowards(observation.ballPosition.y, observation.paddleY, BallToleranceY);
+
+                } else {
+                    state = PaddleAiState::GoingToIdle;
+                }
+                break;
+
+            case PaddleAiState::GoingToIdle :
+                velocityY = steerTowards(0.0, observation.paddleY, IdleDistanceY);
+                if (velocityY == 0.0) {
+                    state = PaddleAiState::Idle;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        return velocityY;
+    }
+
+    PaddleAiState getState() const {
+        return state;
+    }
+
+    PaddleControllerState saveState() const override {
+        PaddleControllerState saved;
+        saved.mode = static_cast<std::uint32_t>(state);
+        saved.flags = interceptValid;
+        saved.values[0] = interceptBallVelocity.x;
+        saved.values[1] = interceptBallVelocity.y;
+        saved.values[2] = intercept;
+        return saved;
+    }
+
+    void restoreState(const PaddleControllerState& saved) override {
+        state = static_cast<PaddleAiState>(saved.mode);
+        interceptValid = saved.flags != 0;
+        interceptBallVelocity = glm::vec2(saved.values[0], saved.values[1]);
+        intercept = saved.values[2];
+    }
+
+private:
+    // The ball moves in straight lines between bounces, so the intercept only has to be
+    // computed again after a bounce, a collision with another ball or a respawn
+    float interceptY(const PaddleObservation& observation) {
+        if (!interceptValid || interceptBallVelocity != observation.ballVelocity) {
+            interceptBallVelocity = observation.ballVelocity;
+            intercept = predictInterceptY(
+                observation.ballPosition,
+                observation.ballVelocity,
+                field.paddleFaceX,
+                field.ballMinY,
+                field.ballMaxY);
+            interceptValid = true;
+        }
+        return intercept;
+    }
+
+    PaddleField field;
+    bool predictive;
+    PaddleAiState state = PaddleAiState::Idle;
+
+    glm::vec2 interceptBallVelocity;
+    float intercept = 0.0;
+    bool interceptValid = false;
+};
+
+// Runs one scalar controller per match, for controllers that keep state between ticks
+class ScalarControllerBatch : public BatchPaddleController {
+public:
+    explicit ScalarControllerBatch(std::vector<std::shared_ptr<PaddleController>> controllers) :
+        controllers(std::move(controllers)) {
+    }
+
+    void act(const PaddleObservationBatch& batch, float* actions) override {
+        for (std::size_t i = 0; i < batch.count; i++) {
+            actions[i] = controllers[i]->act(batch[i]);
+        }
+    }
+
+private:
+    std::vector<std::shared_ptr<PaddleController>> controllers;
+};
+
+// A stateless form of the predictive controller for batches. It catches the ball while
+// it approaches within sight and otherwise returns to the middle, which matches the state
+// machine apart from the tick it waits before starting to move. Choices are blended with
+// arithmetic rather than branches, since the compiler may not speculate a division or an
+// addition past a branch, and the loop then vectorizes.
+class InterceptBatchController : public BatchPaddleController {
+public:
+    explicit InterceptBatchController(PaddleField field) :
+        field(field) {
+    }
+
+    void act(const PaddleObservationBatch& batch, float* actions) override {
+        float range = field.ballMaxY - field.ballMinY;
+        float period = 2.0f * range;
+
+        for (std::size_t i = 0; i < batch.count; i++) {
+            float velocityX = batch.ballVelocityX[i];
+            float approaching = static_cast<float>(
+                (velocityX > 0.0f) & (std::abs(batch.ballX[i] - field.paddleX) < SightDistance));
+
+            // Same unfolding as foldIntoRange, with the fold written as an absolute value
+            float time = (field.paddleFaceX - batch.ballX[i]) / (velocityX * approaching + (1.0f - approaching));
+            float travelled = batch.ballY[i] + batch.ballVelocityY[i] * time - field.ballMinY;
+            travelled -= static_cast<float>(static_cast<std::int32_t>(travelled / period)) * period;
+            travelled += travelled < 0.0f ? period : 0.0f;
+            float interceptY = field.ballMaxY - std::abs(travelled - range);
+
+            float target = interceptY * approaching;
+            float tolerance = IdleDistanceY + (InterceptToleranceY - IdleDistanceY) * approaching;
+            float difference = target - batch.paddleY[i];
+            actions[i] = static_cast<float>(difference > tolerance) - static_cast<float>(difference < -tolerance);
+        }
+    }
+
+private:
+    PaddleField field;
+};
+
+// Creates a computer controller by the name used on the command line, or nullptr if unknown
+std::shared_ptr<PaddleController> createPaddleController(const std::string& name, PaddleField field) {
+    if (name == "tracking") {
+        return std::make_shared<TrackingController>();
+    }
+    if (name == "state-machine") {
+        return std::make_shared<StateMachineController>(field, false);
+    }
+    if (name == "predictive") {
+        return std::make_shared<StateMachineController>(field, true);
+    }
+    return nullptr;
+}
+
+#endif // PONG_PADDLE_CONTROLLER_H
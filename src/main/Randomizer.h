@@ -3,21 +3,50 @@
 
 #include <glm/glm.hpp>
 
-#include <chrono>
-#include <ctime>
-#include <random>
+#include <cstdint>
 
+// Splitmix64 generator. Its whole state is one integer, so a game or match holding one can
+// be copied, saved and replayed with the same numbers on any platform.
 class Randomizer {
 public:
+    explicit Randomizer(std::uint64_t seed = 0) :
+        state(seed) {
+    }
+
+    // Numbers are drawn in separate statements, since the order arguments are evaluated in
+    // differs between compilers
     glm::vec2 randomDirection() {
-        return glm::normalize(glm::vec2(
-            randomPositiveOrNegative(),
-            randomY() * randomPositiveOrNegative()));
+        float x = randomPositiveOrNegative();
+        float y = randomY();
+        y *= randomPositiveOrNegative();
+        return glm::normalize(glm::vec2(x, y));
     }
 
-private:
+    glm::vec2 randomPosition(glm::vec2 min, glm::vec2 max) {
+        float x = min.x + random() * (max.x - min.x);
+        float y = min.y + random() * (max.y - min.y);
+        return glm::vec2(x, y);
+    }
+
+    std::uint64_t getState() const {
+        return state;
+    }
+
+    void setState(std::uint64_t newState) {
+        state = newState;
+    }
+
+    // Uniform in [0, 1) from the top 24 bits, which a float holds exactly
     float random() {
-        return floatDistro(defaultEngine);
+        return static_cast<float>(nextBits() >> 40) / 16777216.0f;
+    }
+
+private:
+    std::uint64_t nextBits() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
     }
 
     float randomY() {
@@ -28,8 +57,7 @@ private:
         return random() > 0.5 ? 1.0f : -1.0f;
     }
 
-    std::default_random_engine defaultEngine {static_cast<std::uint32_t>(std::time(0))};
-    std::uniform_real_distribution<float> floatDistro{0.0, 1.0};
+    std::uint64_t state;
 };
 
 #endif // PONG_RANDOMIZER_H
@@ -0,0 +1,614 @@
+#ifndef PONG_RELAY_H
+#define PONG_RELAY_H
+
+// Fans match states out to spectators. Built on epoll, so Linux only.
+
+#include "MatchServer.h"
+#include "Network.h"
+#include "SnapshotDelta.h"
+
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Spectators connect over TCP and send 'W', fixed32 match for every match they want to
+// watch. The relay then sends one frame per state of those matches:
+//
+//     u8 size of the rest, fixed32 match, delta snapshot against the previous frame of
+//     that match on the connection, or standalone for the first
+const std::size_t SpectatorWatchSize = 5;
+const std::size_t SpectatorFrameHeaderSize = 5;
+const std::size_t MaxSpectatorFrameSize = SpectatorFrameHeaderSize + MaxDeltaSnapshotSize;
+
+// Thousands of connections need more descriptors than the usual soft limit of 1024
+void raiseDescriptorLimit() {
+    rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// One encoded frame, shared by every connection it is queued on and freed with the last
+struct RelayFrame {
+    std::uint32_t size = 0;
+    std::uint8_t bytes[MaxSpectatorFrameSize];
+};
+
+std::shared_ptr<RelayFrame> makeRelayFrame(
+    std::uint32_t matchIndex,
+    const DeltaSnapshotCodec& codec,
+    const QuantizedMatch& match,
+    const QuantizedMatch* baseline) {
+
+    auto frame = std::make_shared<RelayFrame>();
+    FixedWriter writer(frame->bytes);
+    writer.byte(0);
+    writer.fixed32(matchIndex);
+    frame->size = static_cast<std::uint32_t>(
+        SpectatorFrameHeaderSize + codec.encode(match, baseline, frame->bytes + SpectatorFrameHeaderSize));
+    frame->bytes[0] = static_cast<std::uint8_t>(frame->size - 1);
+    return frame;
+}
+
+struct RelaySettings {
+    std::uint32_t matchCount = 1000;
+    std::uint32_t shardCount = 1;
+    std::uint32_t tickRate = 60;
+    std::uint32_t serverHost = INADDR_LOOPBACK;
+    std::uint16_t serverPort = 7700;
+    // Frames a connection may fall behind before they are dropped and it starts over from
+    // standalone frames
+    std::size_t maxQueuedFrames = 256;
+};
+
+// Counters the relay updates as it goes and anyone may read, without locking
+struct alignas(64) RelayStats {
+    std::atomic<std::uint64_t> connections {0};
+    std::atomic<std::uint64_t> upstreamStates {0};
+    std::atomic<std::uint64_t> encodedFrames {0};
+    std::atomic<std::uint64_t> queuedFrames {0};
+    std::atomic<std::uint64_t> sentBytes {0};
+    std::atomic<std::uint64_t> writes {0};
+    std::atomic<std::uint64_t> resyncs {0};
+};
+
+// Watches every match on the server and passes each new state on to the spectators of the
+// match. A state is encoded once into a frame that every spectator in step shares, the
+// connections only queue references to it and write them with one gather call each.
+// Spectators that have fallen behind or just joined share a standalone frame instead.
+//
+// One thread, all sockets non-blocking on one edge triggered epoll set.
+class SpectatorRelay {
+public:
+    explicit SpectatorRelay(const RelaySettings& settings) :
+        settings(settings),
+        codec(settings.tickRate),
+        matches(settings.matchCount) {
+    }
+
+    ~SpectatorRelay() {
+        for (std::uint32_t id = 0; id < connections.size(); id++) {
+            if (connections[id].descriptor >= 0) {
+                ::close(connections[id].descriptor);
+            }
+        }
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        if (poller >= 0) {
+            ::close(poller);
+        }
+    }
+
+    SpectatorRelay(const SpectatorRelay&) = delete;
+    SpectatorRelay& operator=(const SpectatorRelay&) = delete;
+
+    // Listens for spectators on port, 0 lets the system pick one, see getPort
+    bool open(std::uint16_t port, std::uint32_t address = INADDR_ANY) {
+        poller = ::epoll_create1(0);
+        listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (poller < 0 || listener < 0) {
+            return false;
+        }
+
+        int enabled = 1;
+        ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+        sockaddr_in local = UdpSocket::makeAddress(address, port);
+        socklen_t length = sizeof(local);
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0 ||
+            ::getsockname(listener, reinterpret_cast<sockaddr*>(&local), &length) != 0) {
+            return false;
+        }
+        listenPort = ntohs(local.sin_port);
+
+        if (!upstream.open(0, INADDR_ANY)) {
+            return false;
+        }
+        upstream.setBufferSizes(SocketBufferSize);
+
+        return watchDescriptor(listener, ListenerId, EPOLLIN | EPOLLET) &&
+            watchDescriptor(upstream.getDescriptor(), UpstreamId, EPOLLIN | EPOLLET);
+    }
+
+    // Asks the server for the next state of every match, acknowledging the newest one
+    void sendWatches() {
+        for (std::uint32_t index = 0; index < settings.matchCount; index++) {
+            if (outgoing.full()) {
+                outgoing.send(upstream);
+            }
+            ServerWatch watch;
+            watch.match = index;
+            watch.acknowledgedTick = matches[index].upstream.getNewest();
+            sockaddr_in server = UdpSocket::makeAddress(settings.serverHost, settings.serverPort + index % settings.shardCount);
+            BatchDatagram& datagram = outgoing.add(server);
+            encodeServerWatch(watch, datagram.bytes);
+            datagram.size = ServerWatchSize;
+        }
+        outgoing.send(upstream);
+    }
+
+    // Handles whatever happens on the sockets within timeout milliseconds, then writes out
+    // every connection with new frames
+    void poll(int timeout) {
+        epoll_event events[256];
+        int count = ::epoll_wait(poller, events, 256, timeout);
+        for (int i = 0; i < count; i++) {
+            std::uint64_t id = events[i].data.u64;
+            if (id == ListenerId) {
+                accept();
+            } else if (id == UpstreamId) {
+                receiveStates();
+            } else if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                disconnect(static_cast<std::uint32_t>(id));
+            } else {
+                if (events[i].events & EPOLLIN) {
+                    readWatches(static_cast<std::uint32_t>(id));
+                }
+                if (events[i].events & EPOLLOUT) {
+                    markDirty(static_cast<std::uint32_t>(id));
+                }
+            }
+        }
+
+        for (std::uint32_t id : dirty) {
+            connections[id].dirty = false;
+            if (connections[id].descriptor >= 0) {
+                flush(id);
+            }
+        }
+        dirty.clear();
+    }
+
+    // Watches the matches at the tick rate until running is cleared
+    void run(const std::atomic<bool>& running) {
+        auto period = std::chrono::nanoseconds(1000000000 / settings.tickRate);
+        auto next = std::chrono::steady_clock::now();
+
+        while (running.load(std::memory_order_relaxed)) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next) {
+                sendWatches();
+                next += period;
+                if (now - next > std::chrono::seconds(1)) {
+                    next = now + period;
+                }
+            }
+            poll(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count()));
+        }
+    }
+
+    const RelayStats& getStats() const {
+        return stats;
+    }
+
+    std::uint16_t getPort() const {
+        return listenPort;
+    }
+
+private:
+    static const std::uint64_t ListenerId = ~0ull;
+    static const std::uint64_t UpstreamId = ~0ull - 1;
+
+    struct QueuedFrame {
+        std::shared_ptr<RelayFrame> frame;
+        std::uint32_t offset = 0;
+    };
+
+    struct WatchedMatch {
+        std::uint32_t index = 0;
+        bool needsStandalone = true;
+    };
+
+    struct Connection {
+        int descriptor = -1;
+        std::deque<QueuedFrame> queue;
+        std::vector<WatchedMatch> watched;
+        std::uint8_t received[SpectatorWatchSize];
+        std::size_t receivedSize = 0;
+        bool dirty = false;
+    };
+
+    struct RelayedMatch {
+        SnapshotHistory upstream;
+        QuantizedMatch published;
+        bool hasPublished = false;
+        std::vector<std::uint32_t> connections;
+    };
+
+    bool watchDescriptor(int descriptor, std::uint64_t id, std::uint32_t events) {
+        epoll_event event;
+        event.events = events;
+        event.data.u64 = id;
+        return ::epoll_ctl(poller, EPOLL_CTL_ADD, descriptor, &event) == 0;
+    }
+
+    void accept() {
+        while (true) {
+            int descriptor = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+            if (descriptor < 0) {
+                return;
+            }
+
+            int enabled = 1;
+            ::setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+
+            std::uint32_t id;
+            if (!freeIds.empty()) {
+                id = freeIds.back();
+                freeIds.pop_back();
+            } else {
+                id = static_cast<std::uint32_t>(connections.size());
+                connections.emplace_back();
+            }
+            connections[id].descriptor = descriptor;
+
+            if (!watchDescriptor(descriptor, id, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)) {
+                disconnect(id);
+                continue;
+            }
+            stats.connections.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void disconnect(std::uint32_t id) {
+        Connection& connection = connections[id];
+        if (connection.descriptor < 0) {
+            return;
+        }
+
+        for (const WatchedMatch& watched : connection.watched) {
+            std::vector<std::uint32_t>& watchers = matches[watched.index].connections;
+            auto found = std::find(watchers.begin(), watchers.end(), id);
+            if (found != watchers.end()) {
+                *found = watchers.back();
+                watchers.pop_back();
+            }
+        }
+
+        ::close(connection.descriptor);
+        connection = Connection();
+        freeIds.push_back(id);
+        stats.connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Reads watch requests until the socket is drained, as edge triggering needs
+    void readWatches(std::uint32_t id) {
+        std::uint8_t buffer[512];
+        while (connections[id].descriptor >= 0) {
+            Connection& connection = connections[id];
+            auto size = ::recv(connection.descriptor, buffer, sizeof(buffer), 0);
+            if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                disconnect(id);
+                return;
+            }
+            if (size < 0) {
+                return;
+            }
+
+            for (auto i = 0; i < size; i++) {
+                connection.received[connection.receivedSize++] = buffer[i];
+                if (connection.receivedSize < SpectatorWatchSize) {
+                    continue;
+                }
+                connection.receivedSize = 0;
+
+                const std::uint8_t* cursor = connection.received + 1;
+                std::uint32_t index;
+                readFixed32(cursor, connection.received + SpectatorWatchSize, index);
+                if (connection.received[0] != 'W' || index >= settings.matchCount) {
+                    disconnect(id);
+                    return;
+                }
+
+                auto same = [index](const WatchedMatch& watched) { return watched.index == index; };
+                if (std::any_of(connection.watched.begin(), connection.watched.end(), same)) {
+                    continue;
+                }
+                WatchedMatch watched;
+                watched.index = index;
+                connection.watched.push_back(watched);
+                matches[index].connections.push_back(id);
+            }
+        }
+    }
+
+    void receiveStates() {
+        while (std::size_t count = incoming.receive(upstream)) {
+            for (std::size_t i = 0; i < count; i++) {
+                std::uint32_t index;
+                QuantizedMatch state;
+                if (!decodeServerStateMatch(incoming[i].bytes, incoming[i].size, index) ||
+                    index >= settings.matchCount ||
+                    !decodeServerState(incoming[i].bytes, incoming[i].size, codec, matches[index].upstream, state)) {
+                    continue;
+                }
+
+                RelayedMatch& match = matches[index];
+                if (!match.hasPublished || state.tick > match.published.tick) {
+                    publish(index, state);
+                }
+            }
+            stats.upstreamStates.fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    // Encodes a state once against the last one published, and once standalone if any
+    // spectator needs it, then queues one of them on every connection watching the match
+    void publish(std::uint32_t index, const QuantizedMatch& state) {
+        RelayedMatch& match = matches[index];
+        std::shared_ptr<RelayFrame> delta;
+        std::shared_ptr<RelayFrame> standalone;
+        std::uint64_t encoded = 0;
+
+        for (std::uint32_t id : match.connections) {
+            Connection& connection = connections[id];
+            if (connection.queue.size() >= settings.maxQueuedFrames) {
+                resync(connection);
+            }
+
+            WatchedMatch& watched = findWatched(connection, index);
+            std::shared_ptr<RelayFrame>* frame = &delta;
+            if (watched.needsStandalone || !match.hasPublished) {
+                frame = &standalone;
+                watched.needsStandalone = false;
+            }
+            if (!*frame) {
+                *frame = makeRelayFrame(index, codec, state, frame == &delta ? &match.published : nullptr);
+                encoded++;
+            }
+
+            QueuedFrame queued;
+            queued.frame = *frame;
+            connection.queue.push_back(std::move(queued));
+            markDirty(id);
+        }
+
+        match.published = state;
+        match.hasPublished = true;
+        stats.encodedFrames.fetch_add(encoded, std::memory_order_relaxed);
+        stats.queuedFrames.fetch_add(match.connections.size(), std::memory_order_relaxed);
+    }
+
+    // Drops the frames a slow connection has not started on, its matches start over
+    void resync(Connection& connection) {
+        std::size_t keep = !connection.queue.empty() && connection.queue.front().offset > 0 ? 1 : 0;
+        connection.queue.resize(keep);
+        for (WatchedMatch& watched : connection.watched) {
+            watched.needsStandalone = true;
+        }
+        stats.resyncs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static WatchedMatch& findWatched(Connection& connection, std::uint32_t index) {
+        for (WatchedMatch& watched : connection.watched) {
+            if (watched.index == index) {
+                return watched;
+            }
+        }
+        return connection.watched.front();
+    }
+
+    void markDirty(std::uint32_t id) {
+        if (!connections[id].dirty) {
+            connections[id].dirty = true;
+            dirty.push_back(id);
+        }
+    }
+
+    // Writes queued frames straight from their shared buffers until the socket is full.
+    // The rest goes out when epoll reports room again.
+    void flush(std::uint32_t id) {
+        const std::size_t MaxVectors = 64;
+        Connection& connection = connections[id];
+        std::uint64_t sentBytes = 0;
+        std::uint64_t writes = 0;
+
+        while (!connection.queue.empty()) {
+            iovec vectors[MaxVectors];
+            std::size_t count = std::min(MaxVectors, connection.queue.size());
+            for (std::size_t i = 0; i < count; i++) {
+                const QueuedFrame& queued = connection.queue[i];
+                vectors[i].iov_base = queued.frame->bytes + queued.offset;
+                vectors[i].iov_len = queued.frame->size - queued.offset;
+            }
+
+            msghdr message {};
+            message.msg_iov = vectors;
+            message.msg_iovlen = count;
+            auto sent = ::sendmsg(connection.descriptor, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+            writes++;
+            if (sent < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    disconnect(id);
+                }
+                break;
+            }
+
+            sentBytes += sent;
+            std::size_t remaining = static_cast<std::size_t>(sent);
+            while (remaining > 0) {
+                QueuedFrame& front = connection.queue.front();
+                std::size_t left = front.frame->size - front.offset;
+                if (remaining < left) {
+                    front.offset += static_cast<std::uint32_t>(remaining);
+                    break;
+                }
+                remaining -= left;
+                connection.queue.pop_front();
+            }
+        }
+
+        stats.sentBytes.fetch_add(sentBytes, std::memory_order_relaxed);
+        stats.writes.fetch_add(writes, std::memory_order_relaxed);
+    }
+
+    RelaySettings settings;
+    DeltaSnapshotCodec codec;
+    std::vector<RelayedMatch> matches;
+    std::vector<Connection> connections;
+    std::vector<std::uint32_t> freeIds;
+    std::vector<std::uint32_t> dirty;
+
+    int poller = -1;
+    int listener = -1;
+    std::uint16_t listenPort = 0;
+    UdpSocket upstream;
+    DatagramBatch incoming;
+    DatagramBatch outgoing;
+    RelayStats stats;
+};
+
+// A spectator connection to the relay, used by the swarm and the tests. Keeps the last
+// state of every match it watches, so frames decode against it.
+class SpectatorClient {
+public:
+    // The tick rate has to be the one the relay encodes with
+    explicit SpectatorClient(std::uint32_t tickRate) :
+        codec(tickRate) {
+    }
+
+    ~SpectatorClient() {
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+    }
+
+    SpectatorClient(const SpectatorClient&) = delete;
+    SpectatorClient& operator=(const SpectatorClient&) = delete;
+
+    // Connects blocking, then makes the socket non-blocking for receive
+    bool connect(std::uint32_t host, std::uint16_t port) {
+        descriptor = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = UdpSocket::makeAddress(host, port);
+        if (descriptor < 0 || ::connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            return false;
+        }
+        return ::fcntl(descriptor, F_SETFL, ::fcntl(descriptor, F_GETFL) | O_NONBLOCK) == 0;
+    }
+
+    bool watch(std::uint32_t matchIndex) {
+        std::uint8_t bytes[SpectatorWatchSize];
+        FixedWriter writer(bytes);
+        writer.byte('W');
+        writer.fixed32(matchIndex);
+        Watched watched;
+        watched.index = matchIndex;
+        watchedMatches.push_back(watched);
+        return ::send(descriptor, bytes, sizeof(bytes), MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(bytes));
+    }
+
+    // Reads every frame waiting and calls handler(matchIndex, state, frameSize) for each.
+    // Returns false once the connection is closed or sends a frame that does not decode.
+    template <typename Handler>
+    bool receive(Handler handler) {
+        std::uint8_t buffer[16384];
+        while (true) {
+            std::memcpy(buffer, pending, pendingSize);
+            auto size = ::recv(descriptor, buffer + pendingSize, sizeof(buffer) - pendingSize, 0);
+            if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                return false;
+            }
+            if (size < 0) {
+                return true;
+            }
+
+            std::size_t end = pendingSize + static_cast<std::size_t>(size);
+            std::size_t offset = 0;
+            while (offset < end) {
+                // The relay never sends more, and pending could not hold the rest of it
+                std::size_t frameSize = 1 + buffer[offset];
+                if (frameSize > MaxSpectatorFrameSize) {
+                    return false;
+                }
+                if (offset + frameSize > end) {
+                    break;
+                }
+                if (!decodeFrame(buffer + offset, frameSize, handler)) {
+                    return false;
+                }
+                offset += frameSize;
+            }
+
+            pendingSize = end - offset;
+            std::memmove(pending, buffer + offset, pendingSize);
+        }
+    }
+
+    int getDescriptor() const {
+        return descriptor;
+    }
+
+private:
+    struct Watched {
+        std::uint32_t index = 0;
+        QuantizedMatch last;
+        bool hasLast = false;
+    };
+
+    template <typename Handler>
+    bool decodeFrame(const std::uint8_t* bytes, std::size_t size, Handler& handler) {
+        const std::uint8_t* cursor = bytes + 1;
+        std::uint32_t matchIndex;
+        if (size <= SpectatorFrameHeaderSize || !readFixed32(cursor, bytes + size, matchIndex)) {
+            return false;
+        }
+
+        for (Watched& watched : watchedMatches) {
+            if (watched.index != matchIndex) {
+                continue;
+            }
+
+            QuantizedMatch state;
+            if (!codec.decode(cursor, size - SpectatorFrameHeaderSize, watched.hasLast ? &watched.last : nullptr, state)) {
+                return false;
+            }
+            watched.last = state;
+            watched.hasLast = true;
+            handler(matchIndex, state, size);
+            return true;
+        }
+        return false;
+    }
+
+    int descriptor = -1;
+    std::uint8_t pending[MaxSpectatorFrameSize];
+    std::size_t pendingSize = 0;
+    std::vector<Watched> watchedMatches;
+    DeltaSnapshotCodec codec;
+};
+
+#endif // PONG_RELAY_H
@@ -2,6 +2,12 @@
 #define PONG_RENDERER_H
 
 #include "Effect.h"
+#include "FrameUniforms.h"
+#include "GeometryRegistry.h"
+#include "GlObject.h"
+#include "MemoryTracker.h"
+#include "ResourceUsage.h"
+#include "StreamBuffer.h"
 #include "Texture.h"
 #include "Mesh.h"
 
@@ -16,29 +22,165 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 #include <vector>
 
+// Whether CPU copies of mesh and image data stay resident once uploaded.
+// Data is only discarded when it can be rebuilt, and dynamic meshes always keep theirs.
+enum class ResidencyPolicy {
+    KeepCpuData,
+    DiscardCpuData
+};
+
 class Renderer {
 public:
     Renderer(std::uint32_t canvasWidth, std::uint32_t canvasHeight) {
         this->canvasWidth = canvasWidth;
         this->canvasHeight = canvasHeight;
+        MemoryTagScope memoryTag(MemoryTag::Renderer);
+        streamBuffer = std::make_shared<StreamBuffer>(GL_ARRAY_BUFFER, StreamBufferFrameSize);
     }
 
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    // Resources added after prepare() are uploaded right away
     void addEffect(std::shared_ptr<Effect> effect) {
+        MemoryTagScope memoryTag(MemoryTag::Renderer);
         effects.push_back(effect);
+        if (prepared) {
+            prepareEffect(effect);
+        }
     }
 
     void addTexture(std::shared_ptr<Texture> texture) {
+        MemoryTagScope memoryTag(MemoryTag::Renderer);
         textures.push_back(texture);
+        if (prepared) {
+            prepareTexture(texture);
+        }
     }
 
+    // Geometry with the same content as an already added mesh is swapped for the shared copy
     void addMesh(std::shared_ptr<Mesh> mesh) {
+        MemoryTagScope memoryTag(MemoryTag::Renderer);
+        mesh->geometry = geometryRegistry.intern(mesh->geometry);
         meshes.push_back(mesh);
+        if (prepared) {
+            prepareMesh(mesh);
+        }
+    }
+
+    // Removing a resource releases its GPU memory, even if it is still referenced elsewhere
+    void removeEffect(std::shared_ptr<Effect> effect) {
+        if (eraseFrom(effects, effect)) {
+            effect->shaderProgram.reset();
+        }
+    }
+
+    void removeTexture(std::shared_ptr<Texture> texture) {
+        if (eraseFrom(textures, texture)) {
+            texture->textureId.reset();
+        }
+    }
+
+    void removeMesh(std::shared_ptr<Mesh> mesh) {
+        if (eraseFrom(meshes, mesh) && !geometryInUse(mesh->geometry)) {
+            mesh->geometry->vertexArrayObject.reset();
+            mesh->geometry->vertexBufferObject.reset();
+            mesh->geometry->elementBufferObject.reset();
+        }
+    }
+
+    void clear() {
+        while (!meshes.empty()) {
+            removeMesh(meshes.back());
+        }
+        while (!textures.empty()) {
+            removeTexture(textures.back());
+        }
+        while (!effects.empty()) {
+            removeEffect(effects.back());
+        }
+    }
+
+    void setResidencyPolicy(ResidencyPolicy residencyPolicy) {
+        this->residencyPolicy = residencyPolicy;
+    }
+
+    // Recreates all GPU objects once a new context is current after the previous one was lost.
+    // Old names died with their context, so they are abandoned rather than deleted.
+    void restore() {
+        for (const auto& effect : effects) {
+            effect->shaderProgram.release();
+        }
+        for (const auto& texture : textures) {
+            texture->textureId.release();
+        }
+        for (const auto& mesh : meshes) {
+            mesh->geometry->vertexArrayObject.release();
+            mesh->geometry->vertexBufferObject.release();
+            mesh->geometry->elementBufferObject.release();
+        }
+        frameUniformBufferObject.release();
+        streamBuffer->abandon();
+        memoryTracker().clearGpuObjects();
+
+        prepared = false;
+        prepare();
+    }
+
+    ResourceUsage getResourceUsage() {
+        ResourceUsage usage;
+
+        usage.effectCount = effects.size();
+        usage.textureCount = textures.size();
+        usage.meshCount = meshes.size();
+
+        std::set<std::shared_ptr<Geometry>> geometries;
+        for (const auto& mesh : meshes) {
+            geometries.insert(mesh->geometry);
+        }
+        usage.geometryCount = geometries.size();
+
+        for (const auto& texture : textures) {
+            std::uint64_t imageBytes = texture->image->width * texture->image->height;
+            if (texture->textureId) {
+                usage.gpuTextureBytes += imageBytes;
+            }
+            usage.cpuImageBytes += texture->image->data.size();
+        }
+
+        for (const auto& geometry : geometries) {
+            if (geometry->vertexBufferObject) {
+                usage.gpuVertexBytes += geometry->verticesTotalSize;
+            }
+            if (geometry->elementBufferObject) {
+                usage.gpuIndexBytes += geometry->indicesTotalSize;
+            }
+            usage.cpuVertexBytes += geometry->vertexData.size();
+            usage.cpuIndexBytes += geometry->indices.size() * sizeof(std::uint32_t);
+        }
+
+        if (frameUniformBufferObject) {
+            usage.gpuUniformBytes = sizeof(FrameUniforms);
+        }
+        usage.gpuStreamBytes = streamBuffer->getTotalSize();
+
+        return usage;
     }
 
     void prepare() {
+        MemoryTagScope memoryTag(MemoryTag::Renderer);
+        prepareFrameUniforms();
+        streamBuffer->prepare();
+        memoryTracker().addGpuObject(GpuObjectKind::StreamBuffer, streamBuffer->getBufferObject(), streamBuffer->getTotalSize());
+        prepared = true;
+
         for (auto effect : effects) {
             prepareEffect(effect);
         }
@@ -52,38 +194,79 @@ public:
         }
     }
 
-    void render() {
+    // Opens this frame's stream buffer region, call before writing dynamic vertex data
+    void beginFrame() {
+        streamBuffer->beginFrame();
+    }
+
+    std::shared_ptr<StreamBuffer> getStreamBuffer() {
+        return streamBuffer;
+    }
+
+    void render(double frameTime) {
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        for (auto mesh : meshes) {
+        updateFrameUniforms(frameTime);
+        streamBuffer->commit();
+
+        // Plain pointers, the meshes keep these alive and copying shared pointers every draw
+        // would only churn reference counts
+        const Effect* currentEffect = nullptr;
+        const Geometry* currentGeometry = nullptr;
+        std::int32_t modelParameterId = -1;
 
-            glUseProgram(mesh->effect->shaderProgram);
+        for (const auto& mesh : meshes) {
 
-            float sw = canvasWidth*0.5;
-            float sh = canvasHeight*0.5;
-            glm::mat4 orthoProjection = glm::ortho(-sw, sw, -sh, sh, -100.0f, 100.0f);
-            useMatrix(mesh->effect->effectParameters[0].id, orthoProjection);
+            if (!mesh->visible) {
+                continue;
+            }
 
-            useMatrix(mesh->effect->effectParameters[1].id, mesh->transform);
+            if (mesh->effect.get() != currentEffect) {
+                currentEffect = mesh->effect.get();
+                glUseProgram(currentEffect->shaderProgram.get());
+                modelParameterId = currentEffect->parameterId(ModelParameterName);
+            }
+
+            useMatrix(modelParameterId, mesh->transform);
 
             if (mesh->texture != nullptr) {
                 glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, mesh->texture->textureId);
-                glUniform1i(mesh->effect->effectParameters[2].id, 0);
+                glBindTexture(GL_TEXTURE_2D, mesh->texture->textureId.get());
+            }
+
+            if (mesh->geometry.get() != currentGeometry) {
+                currentGeometry = mesh->geometry.get();
+                glBindVertexArray(currentGeometry->vertexArrayObject.get());
             }
 
-            renderMesh(mesh);
+            glDrawElements(GL_TRIANGLES, currentGeometry->indexCount, GL_UNSIGNED_INT, 0);
         }
+
+        glBindVertexArray(0);
+
+        streamBuffer->endFrame();
     }
 
 private:
-    void renderMesh(std::shared_ptr<Mesh> mesh) {
+    template <typename T>
+    bool eraseFrom(std::vector<std::shared_ptr<T>>& resources, const std::shared_ptr<T>& resource) {
+        auto found = std::find(resources.begin(), resources.end(), resource);
+        if (found == resources.end()) {
+            return false;
+        }
+        resources.erase(found);
+        return true;
+    }
 
-        glBindVertexArray(mesh->vertexArrayObject);
-        glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    bool geometryInUse(const std::shared_ptr<Geometry>& geometry) {
+        for (const auto& mesh : meshes) {
+            if (mesh->geometry == geometry) {
+                return true;
+            }
+        }
+        return false;
     }
 
     void prepareEffect(std::shared_ptr<Effect> effect) {
@@ -94,35 +277,141 @@ private:
         std::uint32_t fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
         compileShader(fragmentShader, effect->fragmentShaderSource);
 
-        std::uint32_t shaderProgram = glCreateProgram();
+        GlProgram program = GlProgram::create();
+        std::uint32_t shaderProgram = program.get();
         glAttachShader(shaderProgram, vertexShader);
         glAttachShader(shaderProgram, fragmentShader);
         glLinkProgram(shaderProgram);
 
+        // The linked program keeps what it needs, shader objects are only flagged
+        // for deletion while attached and are released along with the program
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
         int success;
         glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
         if (!success) {
             printError(shaderProgram, "Shader program failed");
         }
 
-        effect->shaderProgram = shaderProgram;
+        effect->shaderProgram = std::move(program);
 
-        for (std::uint8_t i = 0; i < effect->effectParameters.size(); i++) {
-            GLint parameterId0 = glGetUniformLocation(
-                effect->shaderProgram,
-                effect->effectParameters[i].name.c_str());
-            effect->effectParameters[i].id = parameterId0;
+        auto activeUniforms = reflectUniforms(shaderProgram);
+        for (auto& effectParameter : effect->effectParameters) {
+            auto activeUniform = activeUniforms.find(effectParameter.name);
+            if (activeUniform == activeUniforms.end()) {
+                std::cout << "Effect parameter not active: " << effectParameter.name << "\n";
+                effectParameter.id = -1;
+            } else {
+                effectParameter.id = activeUniform->second;
+            }
+        }
+
+        if (effect->usesFrameUniforms) {
+            GLuint blockIndex = glGetUniformBlockIndex(shaderProgram, FrameUniformsBlockName);
+            if (blockIndex == GL_INVALID_INDEX) {
+                std::cout << "Uniform block not available: " << FrameUniformsBlockName << "\n";
+            } else {
+                glUniformBlockBinding(shaderProgram, blockIndex, FrameUniformsBinding);
+            }
+        }
+
+        // Samplers always read from texture unit 0, so this is set once rather than per draw
+        std::int32_t textureParameterId = effect->parameterId(TextureParameterName);
+        if (textureParameterId != -1) {
+            glUseProgram(shaderProgram);
+            glUniform1i(textureParameterId, 0);
+            glUseProgram(0);
         }
     }
 
+    // Maps the names of all active default-block uniforms to their locations.
+    // Members of uniform blocks are skipped since they are fed through buffers.
+    std::map<std::string, std::int32_t> reflectUniforms(std::uint32_t shaderProgram) {
+        std::map<std::string, std::int32_t> activeUniforms;
+
+        if (GLAD_GL_VERSION_4_3) {
+            GLint uniformCount = 0;
+            glGetProgramInterfaceiv(shaderProgram, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+
+            const GLenum properties[] = {GL_NAME_LENGTH, GL_BLOCK_INDEX, GL_LOCATION};
+            for (GLint i = 0; i < uniformCount; i++) {
+                GLint values[3];
+                glGetProgramResourceiv(shaderProgram, GL_UNIFORM, i, 3, properties, 3, nullptr, values);
+                if (values[1] != -1) {
+                    continue;
+                }
+
+                std::string name(values[0], '\0');
+                GLsizei nameLength = 0;
+                glGetProgramResourceName(shaderProgram, GL_UNIFORM, i, values[0], &nameLength, &name[0]);
+                name.resize(nameLength);
+                activeUniforms[name] = values[2];
+            }
+
+        } else {
+            GLint uniformCount = 0;
+            glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+            GLint maxNameLength = 0;
+            glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+            for (GLint i = 0; i < uniformCount; i++) {
+                std::string name(maxNameLength, '\0');
+                GLsizei nameLength = 0;
+                GLint size;
+                GLenum type;
+                glGetActiveUniform(shaderProgram, i, maxNameLength, &nameLength, &size, &type, &name[0]);
+                name.resize(nameLength);
+
+                GLint location = glGetUniformLocation(shaderProgram, name.c_str());
+                if (location != -1) {
+                    activeUniforms[name] = location;
+                }
+            }
+        }
+
+        return activeUniforms;
+    }
+
+    void prepareFrameUniforms() {
+        frameUniformBufferObject = GlBuffer::create();
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBufferObject.get());
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+        memoryTracker().addGpuObject(GpuObjectKind::UniformBuffer, frameUniformBufferObject.get(), sizeof(FrameUniforms));
+        glBindBufferBase(GL_UNIFORM_BUFFER, FrameUniformsBinding, frameUniformBufferObject.get());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void updateFrameUniforms(double frameTime) {
+        elapsedTime += frameTime;
+
+        float sw = canvasWidth*0.5;
+        float sh = canvasHeight*0.5;
+
+        FrameUniforms frameUniforms;
+        frameUniforms.projection = glm::ortho(-sw, sw, -sh, sh, -100.0f, 100.0f);
+        frameUniforms.viewport = glm::vec4(0.0f, 0.0f, canvasWidth, canvasHeight);
+        frameUniforms.time = static_cast<float>(elapsedTime);
+        frameUniforms.frameTime = static_cast<float>(frameTime);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBufferObject.get());
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frameUniforms);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
     void prepareTexture(std::shared_ptr<Texture> texture) {
 
+        auto image = texture->image;
+        if (image->data.empty() && image->reload) {
+            MemoryTagScope memoryTag(MemoryTag::Image);
+            image->data = image->reload();
+        }
+
         glActiveTexture(GL_TEXTURE0);
 
-        GLuint textureId;
-        glGenTextures(1, &textureId);
-    
-        glBindTexture(GL_TEXTURE_2D, textureId);
+        texture->textureId = GlTexture::create();
+        glBindTexture(GL_TEXTURE_2D, texture->textureId.get());
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -142,38 +431,79 @@ private:
             0,
             GL_RED,
             GL_UNSIGNED_BYTE,
-            texture->image->data);
+            texture->image->data.data());
+
+        // One byte per texel for GL_RED, without mipmaps
+        memoryTracker().addGpuObject(
+            GpuObjectKind::Texture,
+            texture->textureId.get(),
+            static_cast<std::uint64_t>(image->width) * image->height);
 
-        texture->textureId = textureId;
+        if (residencyPolicy == ResidencyPolicy::DiscardCpuData && image->reload) {
+            std::vector<std::uint8_t>().swap(image->data);
+        }
     }
 
     void prepareMesh(std::shared_ptr<Mesh> mesh) {
+        if (!mesh->geometry->vertexArrayObject) {
+            prepareGeometry(mesh->geometry);
+        }
+    }
 
-        glGenVertexArrays(1, &mesh->vertexArrayObject);
-        glBindVertexArray(mesh->vertexArrayObject);
+    void prepareGeometry(std::shared_ptr<Geometry> geometry) {
 
-        glGenBuffers(1, &mesh->vertexBufferObject);
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBufferObject);
-        glBufferData(GL_ARRAY_BUFFER, mesh->verticesTotalSize, mesh->vertices, GL_STATIC_DRAW);
+        if (geometry->vertexData.empty() && geometry->rebuild) {
+            MemoryTagScope memoryTag(MemoryTag::Mesh);
+            geometry->rebuild(*geometry);
+        }
 
-        glGenBuffers(1, &mesh->elementBufferObject);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->elementBufferObject);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->indicesTotalSize, mesh->indices, GL_STATIC_DRAW);
+        geometry->vertexArrayObject = GlVertexArray::create();
+        glBindVertexArray(geometry->vertexArrayObject.get());
+
+        geometry->vertexBufferObject = GlBuffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBufferObject.get());
+        glBufferData(GL_ARRAY_BUFFER, geometry->verticesTotalSize, geometry->vertexData.data(), GL_STATIC_DRAW);
+        memoryTracker().addGpuObject(GpuObjectKind::VertexBuffer, geometry->vertexBufferObject.get(), geometry->verticesTotalSize);
+
+        geometry->elementBufferObject = GlBuffer::create();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBufferObject.get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry->indicesTotalSize, geometry->indices.data(), GL_STATIC_DRAW);
+        memoryTracker().addGpuObject(
+            GpuObjectKind::IndexBuffer,
+            geometry->elementBufferObject.get(),
+            static_cast<std::uint64_t>(geometry->indicesTotalSize));
+
+        const VertexLayout& layout = geometry->layout;
+        for (const auto& attribute : layout.attributes) {
+            glVertexAttribPointer(
+                attribute.location,
+                attribute.componentCount,
+                toGlType(attribute.type),
+                attribute.normalized ? GL_TRUE : GL_FALSE,
+                layout.stride,
+                reinterpret_cast<void*>(static_cast<std::uintptr_t>(attribute.offset)));
+            glEnableVertexAttribArray(attribute.location);
+        }
 
-        // position attribute
-        glVertexAttribPointer(0, VertexComponentCount, GL_FLOAT, GL_FALSE, VertexStride * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
 
-        // color attribute
-        glVertexAttribPointer(1, ColorComponentCount, GL_FLOAT, GL_FALSE, VertexStride * sizeof(float), (void*)(3* sizeof(float)));
-        glEnableVertexAttribArray(1);
+        if (residencyPolicy == ResidencyPolicy::DiscardCpuData && !geometry->dynamic && geometry->rebuild) {
+            std::vector<std::uint8_t>().swap(geometry->vertexData);
+            std::vector<std::uint32_t>().swap(geometry->indices);
+        }
+    }
 
-        // tex coord attribute
-        glVertexAttribPointer(2, TexCoordComponentCount, GL_FLOAT, GL_FALSE, VertexStride * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
+    GLenum toGlType(VertexAttributeType type) {
+        switch (type) {
+            case VertexAttributeType::Float : return GL_FLOAT;
+            case VertexAttributeType::Int16 : return GL_SHORT;
+            case VertexAttributeType::UInt16 : return GL_UNSIGNED_SHORT;
+            case VertexAttributeType::UInt8 : return GL_UNSIGNED_BYTE;
+        }
+        return GL_FLOAT;
     }
 
-    void compileShader(std::uint32_t shader, std::string shaderSource) {
+    void compileShader(std::uint32_t shader, const std::string& shaderSource) {
 
         const char *source = shaderSource.c_str();
         glShaderSource(shader, 1, &source, nullptr);
@@ -187,11 +517,11 @@ private:
         }
     }
 
-    void printError(std::uint32_t shader, std::string message) {
+    void printError(std::uint32_t shader, const char* message) {
         const int InfoLogSize = 512;
         char infoLog[InfoLogSize];
         glGetShaderInfoLog(shader, InfoLogSize, nullptr, infoLog);
-        std::cout << message << ": " << std::string(infoLog);
+        std::cout << message << ": " << infoLog;
     }
 
     void useMatrix(std::int32_t effectParameterId, glm::mat4 matrix) {
@@ -201,9 +531,18 @@ private:
     std::uint32_t canvasWidth;
     std::uint32_t canvasHeight;
 
+    bool prepared = false;
+    ResidencyPolicy residencyPolicy = ResidencyPolicy::DiscardCpuData;
+
+    GlBuffer frameUniformBufferObject;
+    std::shared_ptr<StreamBuffer> streamBuffer;
+    double elapsedTime = 0.0;
+
     std::vector<std::shared_ptr<Effect>> effects;
     std::vector<std::shared_ptr<Texture>> textures;
     std::vector<std::shared_ptr<Mesh>> meshes;
+
+    GeometryRegistry geometryRegistry;
 };
 
 #endif // PONG_RENDERER_H
@@ -0,0 +1,425 @@
+#ifndef PONG_REPLAY_H
+#define PONG_REPLAY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Unsigned LEB128, seven bits per byte with the high bit set on all but the last
+void writeVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+bool readVarint(const std::uint8_t*& data, const std::uint8_t* end, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        std::uint8_t byte = *data++;
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void writeFixed32(std::vector<std::uint8_t>& out, std::uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+    }
+}
+
+bool readFixed32(const std::uint8_t*& data, const std::uint8_t* end, std::uint32_t& value) {
+    if (end - data < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= static_cast<std::uint32_t>(*data++) << (i * 8);
+    }
+    return true;
+}
+
+void writeFixed64(std::vector<std::uint8_t>& out, std::uint64_t value) {
+    writeFixed32(out, static_cast<std::uint32_t>(value));
+    writeFixed32(out, static_cast<std::uint32_t>(value >> 32));
+}
+
+bool readFixed64(const std::uint8_t*& data, const std::uint8_t* end, std::uint64_t& value) {
+    std::uint32_t low;
+    std::uint32_t high;
+    if (!readFixed32(data, end, low) || !readFixed32(data, end, high)) {
+        return false;
+    }
+    value = static_cast<std::uint64_t>(high) << 32 | low;
+    return true;
+}
+
+std::uint32_t floatBits(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bitsToFloat(std::uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Version 3 stores keyframes as GameSnapshot encodings
+const std::uint32_t ReplayVersion = 3;
+
+// What is needed to set up the same game again
+struct ReplayHeader {
+    std::uint64_t seed = 0;
+    std::uint32_t ballCount = 1;
+    float tickTime = 0.0;
+};
+
+// A full copy of the game state at the start of a tick, with where the action stream
+// stands at that point so playback can carry on from it
+struct ReplayKeyframe {
+    std::uint32_t tick = 0;
+    std::uint64_t eventOffset = 0;
+    std::uint32_t eventTick = 0;
+    float actions[2] = {0.0, 0.0};
+    std::uint64_t stateOffset = 0;
+    std::uint64_t stateSize = 0;
+};
+
+// Records the actions both paddles took on every tick. Human and computer controlled paddles
+// are recorded alike, so playback needs neither the keyboard nor the controllers.
+//
+// Only changes are stored. Each is one varint holding the ticks since the previous change,
+// the paddle and an action code, which for the -1, 0 and 1 of keyboard and state machine
+// controllers fits in a single byte. Any other action is followed by its exact float bits.
+//
+// Keyframes of the game state can be added along the way. Their states follow the
+// actions, and an index of them goes in a footer that ends in its own offset and a magic,
+// so a viewer can find it from the end of the file and seek without reading the actions.
+class ReplayRecorder {
+public:
+    explicit ReplayRecorder(ReplayHeader header) :
+        header(header) {
+    }
+
+    void record(std::uint32_t tick, float leftAction, float rightAction) {
+        float actions[] = {leftAction, rightAction};
+        for (std::uint32_t paddle = 0; paddle < 2; paddle++) {
+            if (floatBits(actions[paddle]) != floatBits(lastActions[paddle])) {
+                std::uint32_t code = actionCode(actions[paddle]);
+                writeVarint(events, (static_cast<std::uint64_t>(tick - lastTick) << 3) | (paddle << 2) | code);
+                if (code == ExactAction) {
+                    writeFixed32(events, floatBits(actions[paddle]));
+                }
+                lastActions[paddle] = actions[paddle];
+                lastTick = tick;
+            }
+        }
+    }
+
+    // The state is opaque to the replay, it is whatever the game needs to carry on from the
+    // start of the tick. Keyframes have to be added before the actions of their tick.
+    void addKeyframe(std::uint32_t tick, const void* state, std::size_t stateSize) {
+        ReplayKeyframe keyframe;
+        keyframe.tick = tick;
+        keyframe.eventOffset = events.size();
+        keyframe.eventTick = lastTick;
+        keyframe.actions[0] = lastActions[0];
+        keyframe.actions[1] = lastActions[1];
+        keyframe.stateOffset = states.size();
+        keyframe.stateSize = stateSize;
+        keyframes.push_back(keyframe);
+
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(state);
+        states.insert(states.end(), bytes, bytes + stateSize);
+    }
+
+    // Ends the recording with the number of ticks played and a checksum of the final state,
+    // which playback compares against its own
+    std::vector<std::uint8_t> finish(std::uint32_t tickCount, std::uint64_t checksum) const {
+        std::vector<std::uint8_t> bytes {'P', 'R', 'E', 'P'};
+        writeVarint(bytes, ReplayVersion);
+        writeFixed64(bytes, header.seed);
+        writeVarint(bytes, header.ballCount);
+        writeFixed32(bytes, floatBits(header.tickTime));
+        writeVarint(bytes, events.size());
+        bytes.insert(bytes.end(), events.begin(), events.end());
+        writeVarint(bytes, tickCount);
+        writeFixed64(bytes, checksum);
+
+        std::uint64_t statesBegin = bytes.size();
+        bytes.insert(bytes.end(), states.begin(), states.end());
+
+        std::uint64_t indexOffset = bytes.size();
+        writeVarint(bytes, keyframes.size());
+        for (const ReplayKeyframe& keyframe : keyframes) {
+            writeVarint(bytes, keyframe.tick);
+            writeVarint(bytes, keyframe.eventOffset);
+            writeVarint(bytes, keyframe.eventTick);
+            writeFixed32(bytes, floatBits(keyframe.actions[0]));
+            writeFixed32(bytes, floatBits(keyframe.actions[1]));
+            writeVarint(bytes, statesBegin + keyframe.stateOffset);
+            writeVarint(bytes, keyframe.stateSize);
+        }
+        writeFixed64(bytes, indexOffset);
+        bytes.insert(bytes.end(), {'P', 'I', 'D', 'X'});
+        return bytes;
+    }
+
+    bool save(const std::string& path, std::uint32_t tickCount, std::uint64_t checksum) const {
+        std::vector<std::uint8_t> bytes = finish(tickCount, checksum);
+        std::ofstream ofs(path, std::ios::out | std::ios::binary);
+        ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        return static_cast<bool>(ofs);
+    }
+
+    static std::uint32_t actionCode(float action) {
+        if (action == -1.0f) {
+            return 0;
+        }
+        if (floatBits(action) == floatBits(0.0f)) {
+            return 1;
+        }
+        if (action == 1.0f) {
+            return 2;
+        }
+        return ExactAction;
+    }
+
+    static constexpr std::uint32_t ExactAction = 3;
+
+private:
+    ReplayHeader header;
+    std::vector<std::uint8_t> events;
+    std::vector<std::uint8_t> states;
+    std::vector<ReplayKeyframe> keyframes;
+    std::uint32_t lastTick = 0;
+    float lastActions[2] = {0.0, 0.0};
+};
+
+// Reads a recording back and hands out the actions of each tick in order
+class ReplayPlayer {
+public:
+    // Returns false if the data is not a complete recording
+    bool parse(std::vector<std::uint8_t> data) {
+        bytes = std::move(data);
+        const std::uint8_t* cursor = bytes.data();
+        const std::uint8_t* end = cursor + bytes.size();
+
+        std::uint64_t version;
+        std::uint64_t ballCount;
+        std::uint32_t tickTimeBits;
+        std::uint64_t eventsSize;
+        if (bytes.size() < 4 || std::memcmp(cursor, "PREP", 4) != 0) {
+            return false;
+        }
+        cursor += 4;
+
+        if (!readVarint(cursor, end, version) || version != ReplayVersion ||
+            !readFixed64(cursor, end, header.seed) ||
+            !readVarint(cursor, end, ballCount) ||
+            !readFixed32(cursor, end, tickTimeBits) ||
+            !readVarint(cursor, end, eventsSize) ||
+            eventsSize > static_cast<std::uint64_t>(end - cursor)) {
+            return false;
+        }
+        header.ballCount = static_cast<std::uint32_t>(ballCount);
+        header.tickTime = bitsToFloat(tickTimeBits);
+
+        eventsBegin = cursor - bytes.data();
+        eventsEnd = eventsBegin + eventsSize;
+        cursor += eventsSize;
+
+        std::uint64_t ticks;
+        if (!readVarint(cursor, end, ticks) || !readFixed64(cursor, end, checksum)) {
+            return false;
+        }
+        tickCount = static_cast<std::uint32_t>(ticks);
+
+        if (!parseIndex()) {
+            return false;
+        }
+
+        rewind();
+        return true;
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if (!ifs.is_open()) {
+            return false;
+        }
+        return parse(std::vector<std::uint8_t> {
+            std::istreambuf_iterator<char>(ifs),
+            std::istreambuf_iterator<char>()
+        });
+    }
+
+    // Starts handing out actions from the first tick again
+    void rewind() {
+        cursor = eventsBegin;
+        nextTick = 0;
+        actions[0] = 0.0;
+        actions[1] = 0.0;
+        readEvent();
+    }
+
+    // Goes to the last keyframe at or before the tick and returns it, or returns nullptr and
+    // rewinds if there is none. The caller restores the keyframe state and simulates on from
+    // the keyframe tick, asking for actions as usual.
+    const ReplayKeyframe* seek(std::uint32_t tick) {
+        auto after = std::upper_bound(keyframes.begin(), keyframes.end(), tick,
+            [](std::uint32_t value, const ReplayKeyframe& keyframe) {
+                return value < keyframe.tick;
+            });
+
+        if (after == keyframes.begin()) {
+            rewind();
+            return nullptr;
+        }
+
+        const ReplayKeyframe& keyframe = *(after - 1);
+        cursor = eventsBegin + keyframe.eventOffset;
+        nextTick = keyframe.eventTick;
+        actions[0] = keyframe.actions[0];
+        actions[1] = keyframe.actions[1];
+        readEvent();
+        return &keyframe;
+    }
+
+    const std::uint8_t* keyframeState(const ReplayKeyframe& keyframe) const {
+        return bytes.data() + keyframe.stateOffset;
+    }
+
+    const std::vector<ReplayKeyframe>& getKeyframes() const {
+        return keyframes;
+    }
+
+    // Ticks have to be asked for in increasing order
+    void actionsAt(std::uint32_t tick, float& leftAction, float& rightAction) {
+        while (hasEvent && nextTick <= tick) {
+            actions[nextPaddle] = nextAction;
+            readEvent();
+        }
+        leftAction = actions[0];
+        rightAction = actions[1];
+    }
+
+    const ReplayHeader& getHeader() const {
+        return header;
+    }
+
+    std::uint32_t getTickCount() const {
+        return tickCount;
+    }
+
+    std::uint64_t getChecksum() const {
+        return checksum;
+    }
+
+private:
+    // Reads the keyframe index through the footer at the very end
+    bool parseIndex() {
+        const std::uint8_t* end = bytes.data() + bytes.size();
+        if (bytes.size() < 12 || std::memcmp(end - 4, "PIDX", 4) != 0) {
+            return false;
+        }
+
+        const std::uint8_t* footer = end - 12;
+        std::uint64_t indexOffset;
+        std::uint64_t count;
+        readFixed64(footer, end, indexOffset);
+        if (indexOffset > bytes.size() - 12) {
+            return false;
+        }
+
+        const std::uint8_t* cursor = bytes.data() + indexOffset;
+        end -= 12;
+        if (!readVarint(cursor, end, count) || count > static_cast<std::uint64_t>(end - cursor)) {
+            return false;
+        }
+
+        keyframes.clear();
+        keyframes.reserve(count);
+        for (std::uint64_t i = 0; i < count; i++) {
+            std::uint64_t tick;
+            std::uint64_t eventTick;
+            std::uint32_t left;
+            std::uint32_t right;
+            ReplayKeyframe keyframe;
+            if (!readVarint(cursor, end, tick) ||
+                !readVarint(cursor, end, keyframe.eventOffset) ||
+                !readVarint(cursor, end, eventTick) ||
+                !readFixed32(cursor, end, left) ||
+                !readFixed32(cursor, end, right) ||
+                !readVarint(cursor, end, keyframe.stateOffset) ||
+                !readVarint(cursor, end, keyframe.stateSize)) {
+                return false;
+            }
+
+            keyframe.tick = static_cast<std::uint32_t>(tick);
+            keyframe.eventTick = static_cast<std::uint32_t>(eventTick);
+            keyframe.actions[0] = bitsToFloat(left);
+            keyframe.actions[1] = bitsToFloat(right);
+
+            bool ordered = keyframes.empty() || keyframes.back().tick < keyframe.tick;
+            if (!ordered || keyframe.eventOffset > eventsEnd - eventsBegin ||
+                keyframe.stateOffset > indexOffset || keyframe.stateSize > indexOffset - keyframe.stateOffset) {
+                return false;
+            }
+            keyframes.push_back(keyframe);
+        }
+        return true;
+    }
+
+    void readEvent() {
+        const std::uint8_t* data = bytes.data() + cursor;
+        const std::uint8_t* end = bytes.data() + eventsEnd;
+
+        std::uint64_t event;
+        hasEvent = readVarint(data, end, event);
+        if (hasEvent) {
+            std::uint32_t code = event & 3;
+            nextPaddle = (event >> 2) & 1;
+            nextTick += static_cast<std::uint32_t>(event >> 3);
+
+            static const float CodedActions[] = {-1.0, 0.0, 1.0};
+            std::uint32_t bits;
+            if (code != ReplayRecorder::ExactAction) {
+                nextAction = CodedActions[code];
+            } else if (readFixed32(data, end, bits)) {
+                nextAction = bitsToFloat(bits);
+            } else {
+                hasEvent = false;
+            }
+        }
+        cursor = data - bytes.data();
+    }
+
+    std::vector<std::uint8_t> bytes;
+    ReplayHeader header;
+    std::uint32_t tickCount = 0;
+    std::uint64_t checksum = 0;
+    std::vector<ReplayKeyframe> keyframes;
+
+    std::size_t eventsBegin = 0;
+    std::size_t eventsEnd = 0;
+    std::size_t cursor = 0;
+    bool hasEvent = false;
+    std::uint32_t nextTick = 0;
+    std::uint32_t nextPaddle = 0;
+    float nextAction = 0.0;
+    float actions[2] = {0.0, 0.0};
+};
+
+#endif // PONG_REPLAY_H
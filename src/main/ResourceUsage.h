@@ -0,0 +1,33 @@
+#ifndef PONG_RESOURCE_USAGE_H
+#define PONG_RESOURCE_USAGE_H
+
+#include <cstdint>
+
+// Snapshot of memory held by the renderer, split by category.
+// GPU sizes are estimates derived from the data uploaded, drivers may pad them.
+struct ResourceUsage {
+    std::uint32_t effectCount = 0;
+    std::uint32_t textureCount = 0;
+    std::uint32_t meshCount = 0;
+    std::uint32_t geometryCount = 0;
+
+    std::uint64_t gpuVertexBytes = 0;
+    std::uint64_t gpuIndexBytes = 0;
+    std::uint64_t gpuTextureBytes = 0;
+    std::uint64_t gpuUniformBytes = 0;
+    std::uint64_t gpuStreamBytes = 0;
+
+    std::uint64_t cpuVertexBytes = 0;
+    std::uint64_t cpuIndexBytes = 0;
+    std::uint64_t cpuImageBytes = 0;
+
+    std::uint64_t gpuTotalBytes() const {
+        return gpuVertexBytes + gpuIndexBytes + gpuTextureBytes + gpuUniformBytes + gpuStreamBytes;
+    }
+
+    std::uint64_t cpuTotalBytes() const {
+        return cpuVertexBytes + cpuIndexBytes + cpuImageBytes;
+    }
+};
+
+#endif // PONG_RESOURCE_USAGE_H
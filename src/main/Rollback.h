@@ -0,0 +1,336 @@
+#ifndef PONG_ROLLBACK_H
+#define PONG_ROLLBACK_H
+
+#include "Match.h"
+#include "Replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+struct RollbackSettings {
+    // Local inputs are applied this many ticks after they are made, which hides that much
+    // latency without any rollback
+    std::uint32_t inputDelay = 2;
+
+    // How far the local game may run ahead of the last input known from the peer. It bounds
+    // both the rollback depth and the ticks simulated again in one frame.
+    std::uint32_t maxPrediction = 12;
+
+    // Whatever both peers have to start from alike, such as a hash of the seed. A session
+    // does not advance before the peer has sent the same value.
+    std::uint64_t configuration = 0;
+
+    // Both peers checksum the game every this many confirmed ticks and compare, so a desync
+    // is reported rather than played out
+    std::uint32_t checksumInterval = 60;
+};
+
+// The last advance, and totals since the session started
+struct RollbackStats {
+    std::uint32_t rollbackDepth = 0;
+    double resimulationTime = 0.0;
+
+    std::uint64_t rollbacks = 0;
+    std::uint64_t resimulatedTicks = 0;
+    std::uint32_t maxRollbackDepth = 0;
+    double maxResimulationTime = 0.0;
+    std::uint64_t comparedChecksums = 0;
+};
+
+// Two player network play with rollback, in the style of GGPO. Each peer simulates at once
+// with its own input and a prediction of the other's, the last input the other sent. When
+// the real input turns out different, the game goes back to the snapshot before that tick
+// and simulates the ticks since again with the right inputs.
+//
+// The session knows nothing about sockets. The game loop hands it every datagram from the
+// peer and sends what writePacket gives it after each advance. Packets repeat every input
+// the peer has not acknowledged, so lost datagrams need no resending.
+//
+//     'P', 'R', fixed32 tick of the first input, u8 input count, inputs as int8,
+//     fixed32 inputs known from the peer, fixed64 configuration,
+//     fixed32 tick of the newest checksum or 0, fixed64 checksum
+//
+// Game provides a State type and
+//     void saveState(State& state)
+//     void loadState(const State& state)
+//     void advance(float leftAction, float rightAction)
+//     std::uint64_t checksum()
+// where actions are paddle velocities from -1 to 1 as for stepMatch.
+template <typename Game>
+class RollbackSession {
+public:
+    using State = typename Game::State;
+
+    // Inputs and states are kept for this many ticks, far more than a rollback can reach
+    static constexpr std::uint32_t HistorySize = 256;
+
+    static constexpr std::uint32_t MaxPacketInputs = 64;
+
+    // Checksums are kept for this many intervals, peers never drift that far apart
+    static constexpr std::uint32_t ChecksumHistory = 16;
+
+    RollbackSession(Game& game, PaddleSide localSide, RollbackSettings settings = RollbackSettings()) :
+        game(game),
+        localSide(localSide),
+        settings(settings),
+        states(HistorySize),
+        localInputs(HistorySize),
+        remoteInputs(HistorySize),
+        predictedInputs(HistorySize),
+        pendingChecksums(ChecksumHistory),
+        localChecksums(ChecksumHistory),
+        peerChecksums(ChecksumHistory),
+        localInputCount(settings.inputDelay),
+        remoteInputCount(settings.inputDelay),
+        peerInputCount(settings.inputDelay) {
+
+        this->settings.maxPrediction = std::min(settings.maxPrediction, HistorySize / 4);
+        this->settings.checksumInterval = std::max(1u, settings.checksumInterval);
+        nextChecksumTick = this->settings.checksumInterval;
+    }
+
+    // Takes in a datagram from the peer, returns false if it is not a session packet. The
+    // inputs of a peer that started from another configuration are ignored.
+    bool receive(const std::uint8_t* data, std::size_t size) {
+        const std::uint8_t* end = data + size;
+        std::uint32_t first = 0;
+        std::uint32_t acknowledged = 0;
+        std::uint64_t configuration = 0;
+        std::uint32_t checksumTick = 0;
+        std::uint64_t checksum = 0;
+        if (size < 7 || data[0] != 'P' || data[1] != 'R') {
+            return false;
+        }
+        data += 2;
+        readFixed32(data, end, first);
+
+        std::uint8_t count = *data++;
+        if (end - data != count + 24) {
+            return false;
+        }
+        const std::int8_t* inputs = reinterpret_cast<const std::int8_t*>(data);
+        data += count;
+        readFixed32(data, end, acknowledged);
+        readFixed64(data, end, configuration);
+        readFixed32(data, end, checksumTick);
+        readFixed64(data, end, checksum);
+
+        if (configuration != settings.configuration) {
+            mismatchedStart = true;
+            return true;
+        }
+        peerAgreed = true;
+        if (checksumTick != 0) {
+            addChecksum(peerChecksums, checksumTick, checksum);
+        }
+
+        peerInputCount = std::max(peerInputCount, std::min(acknowledged, localInputCount));
+
+        for (std::uint32_t i = 0; i < count; i++) {
+            std::uint32_t inputTick = first + i;
+            if (inputTick != remoteInputCount || remoteInputCount >= tick + HistorySize / 2) {
+                continue;
+            }
+
+            std::int8_t input = std::max<std::int8_t>(-1, std::min<std::int8_t>(1, inputs[i]));
+            remoteInputs[inputTick % HistorySize] = input;
+            remoteInputCount++;
+
+            if (inputTick < tick && predictedInputs[inputTick % HistorySize] != input) {
+                rollbackTick = std::min(rollbackTick, inputTick);
+            }
+        }
+        return true;
+    }
+
+    // The local inputs the peer still lacks, up to MaxPacketInputs, and how many of its
+    // inputs are known here
+    void writePacket(std::vector<std::uint8_t>& packet) const {
+        std::uint32_t count = std::min(localInputCount - peerInputCount, MaxPacketInputs);
+
+        packet.clear();
+        packet.push_back('P');
+        packet.push_back('R');
+        writeFixed32(packet, peerInputCount);
+        packet.push_back(static_cast<std::uint8_t>(count));
+        for (std::uint32_t i = 0; i < count; i++) {
+            packet.push_back(static_cast<std::uint8_t>(localInputs[(peerInputCount + i) % HistorySize]));
+        }
+        writeFixed32(packet, remoteInputCount);
+        writeFixed64(packet, settings.configuration);
+        writeFixed32(packet, newestChecksum.tick);
+        writeFixed64(packet, newestChecksum.hash);
+    }
+
+    // False until the peer has shown it starts from the same configuration, and while the
+    // game is as far ahead of the peer as predictions may go. The caller then waits for
+    // packets.
+    bool canAdvance() const {
+        return peerAgreed && !mismatchedStart && tick < remoteInputCount + settings.maxPrediction;
+    }
+
+    // The peer started from another configuration, the session can never advance
+    bool hasMismatchedStart() const {
+        return mismatchedStart;
+    }
+
+    // The peers computed different games from the same inputs
+    bool hasDesynced() const {
+        return desyncTick != NoRollback;
+    }
+
+    // The first tick after which the checksums differed
+    std::uint32_t getDesyncTick() const {
+        return desyncTick;
+    }
+
+    // Simulates again from any tick that was mispredicted, then one new tick. The local
+    // input, -1, 0 or 1, is applied after the input delay.
+    void advance(std::int8_t localInput) {
+        stats.rollbackDepth = 0;
+        stats.resimulationTime = 0.0;
+
+        localInputs[localInputCount % HistorySize] = localInput;
+        localInputCount++;
+
+        synchronize();
+        simulate(tick);
+        tick++;
+        confirmChecksums();
+    }
+
+    // Corrects mispredicted ticks without simulating a new one
+    void synchronize() {
+        if (rollbackTick >= tick) {
+            rollbackTick = NoRollback;
+            confirmChecksums();
+            return;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        game.loadState(states[rollbackTick % HistorySize]);
+        for (std::uint32_t resimulated = rollbackTick; resimulated < tick; resimulated++) {
+            simulate(resimulated);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        std::uint32_t depth = tick - rollbackTick;
+        stats.rollbackDepth += depth;
+        stats.resimulationTime += elapsed.count();
+        stats.rollbacks++;
+        stats.resimulatedTicks += depth;
+        stats.maxRollbackDepth = std::max(stats.maxRollbackDepth, depth);
+        stats.maxResimulationTime = std::max(stats.maxResimulationTime, elapsed.count());
+        rollbackTick = NoRollback;
+        confirmChecksums();
+    }
+
+    // The next tick to simulate
+    std::uint32_t getTick() const {
+        return tick;
+    }
+
+    // Ticks before this one were simulated with the real inputs of both players
+    std::uint32_t getConfirmedTick() const {
+        return std::min(std::min(tick, remoteInputCount), rollbackTick);
+    }
+
+    const RollbackStats& getStats() const {
+        return stats;
+    }
+
+private:
+    static constexpr std::uint32_t NoRollback = std::numeric_limits<std::uint32_t>::max();
+
+    struct Checksum {
+        std::uint32_t tick = 0;
+        std::uint64_t hash = 0;
+    };
+
+    // Compares once both peers have a checksum for the tick, the peer repeats its newest in
+    // every packet so each is only taken the first time
+    void addChecksum(std::vector<Checksum>& checksums, std::uint32_t checksumTick, std::uint64_t hash) {
+        std::size_t slot = (checksumTick / settings.checksumInterval) % ChecksumHistory;
+        if (checksums[slot].tick == checksumTick) {
+            return;
+        }
+        checksums[slot].tick = checksumTick;
+        checksums[slot].hash = hash;
+
+        const Checksum& local = localChecksums[slot];
+        const Checksum& peer = peerChecksums[slot];
+        if (local.tick == checksumTick && peer.tick == checksumTick) {
+            stats.comparedChecksums++;
+            if (local.hash != peer.hash) {
+                desyncTick = std::min(desyncTick, checksumTick);
+            }
+        }
+    }
+
+    void simulate(std::uint32_t simulated) {
+        game.saveState(states[simulated % HistorySize]);
+        if (simulated > 0 && simulated % settings.checksumInterval == 0) {
+            Checksum& pending = pendingChecksums[(simulated / settings.checksumInterval) % ChecksumHistory];
+            pending.tick = simulated;
+            pending.hash = game.checksum();
+        }
+
+        std::int8_t remote = 0;
+        if (simulated < remoteInputCount) {
+            remote = remoteInputs[simulated % HistorySize];
+        } else if (remoteInputCount > 0) {
+            remote = remoteInputs[(remoteInputCount - 1) % HistorySize];
+        }
+        predictedInputs[simulated % HistorySize] = remote;
+
+        std::int8_t local = localInputs[simulated % HistorySize];
+        if (localSide == PaddleSide::Left) {
+            game.advance(local, remote);
+        } else {
+            game.advance(remote, local);
+        }
+    }
+
+    // A checksum is taken as the state of its tick is saved, possibly from predicted inputs.
+    // It counts once every input before the tick is known and any rollback has been
+    // simulated again, nothing can change that state any more.
+    void confirmChecksums() {
+        while (nextChecksumTick < tick && nextChecksumTick <= remoteInputCount) {
+            const Checksum& pending = pendingChecksums[(nextChecksumTick / settings.checksumInterval) % ChecksumHistory];
+            newestChecksum = pending;
+            addChecksum(localChecksums, pending.tick, pending.hash);
+            nextChecksumTick += settings.checksumInterval;
+        }
+    }
+
+    Game& game;
+    PaddleSide localSide;
+    RollbackSettings settings;
+
+    std::vector<State> states;
+    std::vector<std::int8_t> localInputs;
+    std::vector<std::int8_t> remoteInputs;
+    std::vector<std::int8_t> predictedInputs;
+    std::vector<Checksum> pendingChecksums;
+    std::vector<Checksum> localChecksums;
+    std::vector<Checksum> peerChecksums;
+    Checksum newestChecksum;
+    std::uint32_t nextChecksumTick;
+
+    std::uint32_t tick = 0;
+    std::uint32_t localInputCount;
+    std::uint32_t remoteInputCount;
+    std::uint32_t peerInputCount;
+    std::uint32_t rollbackTick = NoRollback;
+    std::uint32_t desyncTick = NoRollback;
+    bool peerAgreed = false;
+    bool mismatchedStart = false;
+    RollbackStats stats;
+};
+
+#endif // PONG_ROLLBACK_H
@@ -0,0 +1,125 @@
+#ifndef PONG_SNAPSHOT_H
+#define PONG_SNAPSHOT_H
+
+#include "PaddleController.h"
+#include "World.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+const std::uint32_t GameSnapshotVersion = 1;
+
+// Starts every snapshot. The transform and velocity arrays follow it in that order.
+struct GameSnapshotHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t size;
+    std::uint32_t transformCount;
+    std::uint32_t velocityCount;
+    std::uint32_t tick;
+    std::uint32_t pointsLeft;
+    std::uint32_t pointsRight;
+    std::uint64_t randomState;
+    PaddleControllerState controllers[2];
+};
+
+static_assert(std::is_trivially_copyable<GameSnapshotHeader>::value, "Snapshots are copied as bytes");
+static_assert(std::is_trivially_copyable<Transform>::value, "Snapshots are copied as bytes");
+static_assert(std::is_trivially_copyable<Velocity>::value, "Snapshots are copied as bytes");
+
+// The complete simulation state of a game in one flat buffer, without pointers, so it can
+// be copied, stored or sent as it is. Snapshots are only read back by the same build on the
+// same kind of machine, they are not a portable file format.
+//
+// The buffer keeps its capacity, so taking a snapshot every tick allocates only the first
+// time or when the number of bodies grows.
+class GameSnapshot {
+public:
+    // Sizes the snapshot for the given bodies and fills in the header, leaving the
+    // rest for the caller
+    GameSnapshotHeader& reset(std::uint32_t transformCount, std::uint32_t velocityCount) {
+        bytes.resize(sizeFor(transformCount, velocityCount));
+
+        GameSnapshotHeader& header = getHeader();
+        header = GameSnapshotHeader();
+        std::memcpy(header.magic, "PSNP", 4);
+        header.version = GameSnapshotVersion;
+        header.size = static_cast<std::uint32_t>(bytes.size());
+        header.transformCount = transformCount;
+        header.velocityCount = velocityCount;
+        return header;
+    }
+
+    // Takes a snapshot from raw bytes, returns false if they are not one
+    bool assign(const std::uint8_t* data, std::size_t size) {
+        GameSnapshotHeader header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, "PSNP", 4) != 0 ||
+            header.version != GameSnapshotVersion ||
+            header.size != size ||
+            header.transformCount > size / sizeof(Transform) ||
+            header.velocityCount > size / sizeof(Velocity) ||
+            sizeFor(header.transformCount, header.velocityCount) != size) {
+            return false;
+        }
+
+        bytes.assign(data, data + size);
+        return true;
+    }
+
+    GameSnapshotHeader& getHeader() {
+        return *reinterpret_cast<GameSnapshotHeader*>(bytes.data());
+    }
+
+    const GameSnapshotHeader& getHeader() const {
+        return *reinterpret_cast<const GameSnapshotHeader*>(bytes.data());
+    }
+
+    Transform* transforms() {
+        return reinterpret_cast<Transform*>(bytes.data() + sizeof(GameSnapshotHeader));
+    }
+
+    const Transform* transforms() const {
+        return reinterpret_cast<const Transform*>(bytes.data() + sizeof(GameSnapshotHeader));
+    }
+
+    Velocity* velocities() {
+        return reinterpret_cast<Velocity*>(transforms() + getHeader().transformCount);
+    }
+
+    const Velocity* velocities() const {
+        return reinterpret_cast<const Velocity*>(transforms() + getHeader().transformCount);
+    }
+
+    const std::uint8_t* data() const {
+        return bytes.data();
+    }
+
+    std::size_t size() const {
+        return bytes.size();
+    }
+
+    bool empty() const {
+        return bytes.empty();
+    }
+
+    static std::size_t sizeFor(std::uint32_t transformCount, std::uint32_t velocityCount) {
+        return sizeof(GameSnapshotHeader) +
+            static_cast<std::size_t>(transformCount) * sizeof(Transform) +
+            static_cast<std::size_t>(velocityCount) * sizeof(Velocity);
+    }
+
+private:
+    // Heap blocks are aligned for any fundamental type, and the header size is a multiple
+    // of its eight byte alignment, so the arrays after it are aligned as well
+    std::vector<std::uint8_t> bytes;
+};
+
+#endif // PONG_SNAPSHOT_H
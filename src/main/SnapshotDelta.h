@@ -0,0 +1,288 @@
+#ifndef PONG_SNAPSHOT_DELTA_H
+#define PONG_SNAPSHOT_DELTA_H
+
+#include "Match.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Appends values of any width up to 32 bits, least significant bit first, to a buffer the
+// caller makes large enough. Whole bytes are written as the bits fill them.
+class BitWriter {
+public:
+    explicit BitWriter(std::uint8_t* bytes) :
+        bytes(bytes) {
+    }
+
+    void write(std::uint32_t value, std::uint32_t bitCount) {
+        pending |= static_cast<std::uint64_t>(value & mask(bitCount)) << pendingBits;
+        pendingBits += bitCount;
+        while (pendingBits >= 8) {
+            bytes[size++] = static_cast<std::uint8_t>(pending);
+            pending >>= 8;
+            pendingBits -= 8;
+        }
+    }
+
+    // Writes out the last partial byte and returns the size in bytes
+    std::size_t finish() {
+        if (pendingBits > 0) {
+            bytes[size++] = static_cast<std::uint8_t>(pending);
+            pending = 0;
+            pendingBits = 0;
+        }
+        return size;
+    }
+
+    static std::uint32_t mask(std::uint32_t bitCount) {
+        return bitCount >= 32 ? 0xFFFFFFFFu : (1u << bitCount) - 1;
+    }
+
+private:
+    std::uint8_t* bytes;
+    std::size_t size = 0;
+    std::uint64_t pending = 0;
+    std::uint32_t pendingBits = 0;
+};
+
+// Reads back what BitWriter wrote. Reading past the end gives zeros and makes isGood false.
+class BitReader {
+public:
+    BitReader(const std::uint8_t* bytes, std::size_t size) :
+        bytes(bytes),
+        end(bytes + size) {
+    }
+
+    std::uint32_t read(std::uint32_t bitCount) {
+        while (pendingBits < bitCount) {
+            if (bytes == end) {
+                good = false;
+                return 0;
+            }
+            pending |= static_cast<std::uint64_t>(*bytes++) << pendingBits;
+            pendingBits += 8;
+        }
+
+        std::uint32_t value = static_cast<std::uint32_t>(pending) & BitWriter::mask(bitCount);
+        pending >>= bitCount;
+        pendingBits -= bitCount;
+        return value;
+    }
+
+    bool isGood() const {
+        return good;
+    }
+
+private:
+    const std::uint8_t* bytes;
+    const std::uint8_t* end;
+    std::uint64_t pending = 0;
+    std::uint32_t pendingBits = 0;
+    bool good = true;
+};
+
+// Quanta per unit of distance or speed, a sixteenth of a pixel is far finer than
+// anything drawn
+const float SnapshotPrecision = 16.0;
+
+// A match as players and spectators see it, rounded to SnapshotPrecision. Only the server
+// keeps the full state with its generator.
+struct QuantizedMatch {
+    std::uint32_t tick = 0;
+    std::int32_t ballX = 0;
+    std::int32_t ballY = 0;
+    std::int32_t velocityX = 0;
+    std::int32_t velocityY = 0;
+    std::int32_t leftPaddleY = 0;
+    std::int32_t rightPaddleY = 0;
+    std::int32_t pointsLeft = 0;
+    std::int32_t pointsRight = 0;
+};
+
+std::int32_t quantize(float value) {
+    return static_cast<std::int32_t>(std::lround(value * SnapshotPrecision));
+}
+
+float dequantize(std::int32_t value) {
+    return value / SnapshotPrecision;
+}
+
+QuantizedMatch quantizeMatch(const MatchState& match) {
+    QuantizedMatch quantized;
+    quantized.tick = match.tick;
+    quantized.ballX = quantize(match.ballPosition.x);
+    quantized.ballY = quantize(match.ballPosition.y);
+    quantized.velocityX = quantize(match.ballVelocity.x);
+    quantized.velocityY = quantize(match.ballVelocity.y);
+    quantized.leftPaddleY = quantize(match.leftPaddleY);
+    quantized.rightPaddleY = quantize(match.rightPaddleY);
+    quantized.pointsLeft = match.pointsLeft;
+    quantized.pointsRight = match.pointsRight;
+    return quantized;
+}
+
+// Fills in what a quantized match carries, the generator is left alone
+void dequantizeMatch(const QuantizedMatch& quantized, MatchState& match) {
+    match.tick = quantized.tick;
+    match.ballPosition = glm::vec2(dequantize(quantized.ballX), dequantize(quantized.ballY));
+    match.ballVelocity = glm::vec2(dequantize(quantized.velocityX), dequantize(quantized.velocityY));
+    match.leftPaddleY = dequantize(quantized.leftPaddleY);
+    match.rightPaddleY = dequantize(quantized.rightPaddleY);
+    match.pointsLeft = quantized.pointsLeft;
+    match.pointsRight = quantized.pointsRight;
+}
+
+// A delta takes one bit when a value is as predicted. Otherwise the zigzag encoded
+// difference follows in one of four widths, picked by a two bit class.
+void writeDelta(BitWriter& writer, std::int32_t value, std::int32_t predicted) {
+    std::uint32_t difference = static_cast<std::uint32_t>(value) - static_cast<std::uint32_t>(predicted);
+    std::uint32_t zigzag = (difference << 1) ^ static_cast<std::uint32_t>(static_cast<std::int32_t>(difference) >> 31);
+    if (zigzag == 0) {
+        writer.write(0, 1);
+        return;
+    }
+
+    static const std::uint32_t Widths[] = {4, 8, 12, 32};
+    std::uint32_t sizeClass = zigzag < 16 ? 0 : (zigzag < 256 ? 1 : (zigzag < 4096 ? 2 : 3));
+    writer.write(1 | sizeClass << 1, 3);
+    writer.write(zigzag, Widths[sizeClass]);
+}
+
+std::int32_t readDelta(BitReader& reader, std::int32_t predicted) {
+    if (reader.read(1) == 0) {
+        return predicted;
+    }
+
+    static const std::uint32_t Widths[] = {4, 8, 12, 32};
+    std::uint32_t zigzag = reader.read(Widths[reader.read(2)]);
+    std::uint32_t difference = (zigzag >> 1) ^ (0u - (zigzag & 1));
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(predicted) + difference);
+}
+
+// Room for any snapshot, every field at its widest
+const std::size_t MaxDeltaSnapshotSize = 48;
+
+// Encodes a match against a baseline the receiver already has, usually the last snapshot
+// it acknowledged. Without a baseline the match is encoded against an empty one, which
+// costs more but needs nothing on the other side.
+//
+// The ball is predicted to have carried on at its baseline velocity, so between bounces its
+// position costs a bit per axis. The low byte of the baseline tick tells the receiver which
+// of its recent snapshots the delta is against.
+class DeltaSnapshotCodec {
+public:
+    explicit DeltaSnapshotCodec(std::uint32_t tickRate) :
+        tickRate(tickRate) {
+    }
+
+    std::size_t encode(const QuantizedMatch& match, const QuantizedMatch* baseline, std::uint8_t* bytes) const {
+        BitWriter writer(bytes);
+        QuantizedMatch empty;
+        if (baseline) {
+            writer.write(1, 1);
+            writer.write(baseline->tick & 0xFF, 8);
+        } else {
+            writer.write(0, 1);
+            baseline = &empty;
+        }
+
+        writeDelta(writer, static_cast<std::int32_t>(match.tick), static_cast<std::int32_t>(baseline->tick + 1));
+        std::int32_t elapsed = static_cast<std::int32_t>(match.tick - baseline->tick);
+        writeDelta(writer, match.ballX, predictPosition(baseline->ballX, baseline->velocityX, elapsed));
+        writeDelta(writer, match.ballY, predictPosition(baseline->ballY, baseline->velocityY, elapsed));
+        writeDelta(writer, match.velocityX, baseline->velocityX);
+        writeDelta(writer, match.velocityY, baseline->velocityY);
+        writeDelta(writer, match.leftPaddleY, baseline->leftPaddleY);
+        writeDelta(writer, match.rightPaddleY, baseline->rightPaddleY);
+        writeDelta(writer, match.pointsLeft, baseline->pointsLeft);
+        writeDelta(writer, match.pointsRight, baseline->pointsRight);
+        return writer.finish();
+    }
+
+    // Reads whether the snapshot has a baseline and the low byte of its tick, so the caller
+    // can find it before decoding
+    static bool peekBaseline(const std::uint8_t* bytes, std::size_t size, std::uint8_t& baselineTick) {
+        BitReader reader(bytes, size);
+        bool hasBaseline = reader.read(1) != 0;
+        baselineTick = static_cast<std::uint8_t>(reader.read(8));
+        return hasBaseline && reader.isGood();
+    }
+
+    // The baseline has to be the one the snapshot was encoded against, or nullptr if it
+    // has none. Returns false if the bytes run out.
+    bool decode(const std::uint8_t* bytes, std::size_t size, const QuantizedMatch* baseline, QuantizedMatch& match) const {
+        BitReader reader(bytes, size);
+        QuantizedMatch empty;
+        if (reader.read(1) != 0) {
+            if (!baseline || reader.read(8) != (baseline->tick & 0xFF)) {
+                return false;
+            }
+        } else {
+            baseline = &empty;
+        }
+
+        match.tick = static_cast<std::uint32_t>(readDelta(reader, static_cast<std::int32_t>(baseline->tick + 1)));
+        std::int32_t elapsed = static_cast<std::int32_t>(match.tick - baseline->tick);
+        match.ballX = readDelta(reader, predictPosition(baseline->ballX, baseline->velocityX, elapsed));
+        match.ballY = readDelta(reader, predictPosition(baseline->ballY, baseline->velocityY, elapsed));
+        match.velocityX = readDelta(reader, baseline->velocityX);
+        match.velocityY = readDelta(reader, baseline->velocityY);
+        match.leftPaddleY = readDelta(reader, baseline->leftPaddleY);
+        match.rightPaddleY = readDelta(reader, baseline->rightPaddleY);
+        match.pointsLeft = readDelta(reader, baseline->pointsLeft);
+        match.pointsRight = readDelta(reader, baseline->pointsRight);
+        return reader.isGood();
+    }
+
+private:
+    // Integer arithmetic only, so both sides predict exactly the same
+    std::int32_t predictPosition(std::int32_t position, std::int32_t velocity, std::int32_t elapsed) const {
+        return position + static_cast<std::int32_t>(static_cast<std::int64_t>(velocity) * elapsed / tickRate);
+    }
+
+    std::int32_t tickRate;
+};
+
+const std::uint32_t SnapshotHistorySize = 32;
+
+// The recent snapshots of one match by tick, kept by both ends so either can find the
+// baseline of a delta
+class SnapshotHistory {
+public:
+    void add(const QuantizedMatch& match) {
+        Slot& slot = slots[match.tick % SnapshotHistorySize];
+        slot.match = match;
+        slot.filled = true;
+        if (match.tick > newest) {
+            newest = match.tick;
+        }
+    }
+
+    const QuantizedMatch* find(std::uint32_t tick) const {
+        const Slot& slot = slots[tick % SnapshotHistorySize];
+        return slot.filled && slot.match.tick == tick ? &slot.match : nullptr;
+    }
+
+    // Finds a snapshot by the low byte of its tick, as deltas name their baseline
+    const QuantizedMatch* findByLowByte(std::uint8_t lowByte) const {
+        const Slot& slot = slots[lowByte % SnapshotHistorySize];
+        return slot.filled && (slot.match.tick & 0xFF) == lowByte ? &slot.match : nullptr;
+    }
+
+    // The tick of the newest snapshot added, 0 before any
+    std::uint32_t getNewest() const {
+        return newest;
+    }
+
+private:
+    struct Slot {
+        QuantizedMatch match;
+        bool filled = false;
+    };
+
+    Slot slots[SnapshotHistorySize];
+    std::uint32_t newest = 0;
+};
+
+#endif // PONG_SNAPSHOT_DELTA_H
@@ -0,0 +1,91 @@
+#ifndef PONG_SPATIAL_GRID_H
+#define PONG_SPATIAL_GRID_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Uniform grid over a rectangular area, rebuilt from scratch with a counting sort.
+// Items are binned by their center, so queries must be grown by the largest item
+// half extents to find everything overlapping a box. Positions outside the area are
+// clamped to the border cells. Storage only grows, rebuilding with the same or
+// fewer items does not allocate.
+class SpatialGrid {
+public:
+    SpatialGrid(glm::vec2 areaMin, glm::vec2 areaMax, float cellSize) :
+        areaMin(areaMin),
+        cellSize(cellSize) {
+
+        columns = std::max(1, static_cast<int>(std::ceil((areaMax.x - areaMin.x) / cellSize)));
+        rows = std::max(1, static_cast<int>(std::ceil((areaMax.y - areaMin.y) / cellSize)));
+        cellStart.resize(columns * rows + 1);
+    }
+
+    void build(const glm::vec2 *positions, std::uint32_t count) {
+        itemCell.resize(count);
+        cellItems.resize(count);
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+
+        // Count items per cell, shifted by one so the prefix sum yields start offsets
+        for (std::uint32_t i = 0; i < count; i++) {
+            std::uint32_t cell = cellIndex(column(positions[i].x), row(positions[i].y));
+            itemCell[i] = cell;
+            cellStart[cell + 1]++;
+        }
+
+        for (std::size_t cell = 1; cell < cellStart.size(); cell++) {
+            cellStart[cell] += cellStart[cell - 1];
+        }
+
+        cellCursor.assign(cellStart.begin(), cellStart.end() - 1);
+        for (std::uint32_t i = 0; i < count; i++) {
+            cellItems[cellCursor[itemCell[i]]++] = i;
+        }
+    }
+
+    // Calls visit(item) for every item binned in a cell overlapping [boxMin, boxMax]
+    template <typename Visit>
+    void query(glm::vec2 boxMin, glm::vec2 boxMax, Visit visit) const {
+        int columnMin = column(boxMin.x);
+        int columnMax = column(boxMax.x);
+        int rowMin = row(boxMin.y);
+        int rowMax = row(boxMax.y);
+
+        for (int r = rowMin; r <= rowMax; r++) {
+            for (int c = columnMin; c <= columnMax; c++) {
+                std::uint32_t cell = cellIndex(c, r);
+                for (std::uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+                    visit(cellItems[i]);
+                }
+            }
+        }
+    }
+
+private:
+    int column(float x) const {
+        return std::min(columns - 1, std::max(0, static_cast<int>((x - areaMin.x) / cellSize)));
+    }
+
+    int row(float y) const {
+        return std::min(rows - 1, std::max(0, static_cast<int>((y - areaMin.y) / cellSize)));
+    }
+
+    std::uint32_t cellIndex(int c, int r) const {
+        return r * columns + c;
+    }
+
+    glm::vec2 areaMin;
+    float cellSize;
+    int columns;
+    int rows;
+
+    std::vector<std::uint32_t> cellStart;
+    std::vector<std::uint32_t> cellCursor;
+    std::vector<std::uint32_t> cellItems;
+    std::vector<std::uint32_t> itemCell;
+};
+
+#endif // PONG_SPATIAL_GRID_H
@@ -0,0 +1,195 @@
+#ifndef PONG_STREAM_BUFFER_H
+#define PONG_STREAM_BUFFER_H
+
+#include "GlObject.h"
+
+#include "glad.h"
+
+#include <cstdint>
+
+static const std::uint32_t StreamBufferFrameCount = 3;
+static const std::uint32_t StreamBufferFrameSize = 1 << 20;
+
+std::uint32_t alignUp(std::uint32_t value, std::uint32_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// A region handed out for writing during the current frame.
+// offset is relative to the start of the GL buffer and can be passed
+// straight to glVertexAttribPointer or glDrawElementsBaseVertex.
+struct StreamRegion {
+    void *data = nullptr;
+    std::uint32_t offset = 0;
+    std::uint32_t size = 0;
+};
+
+// Bookkeeping for a ring of equally sized frame segments.
+// Kept free of GL calls so it can be unit tested.
+struct StreamRing {
+    StreamRing(std::uint32_t frameSize, std::uint32_t frameCount) :
+        frameSize(frameSize),
+        frameCount(frameCount) {}
+
+    std::uint32_t frameOffset() const {
+        return frame * frameSize;
+    }
+
+    bool reserve(std::uint32_t size, std::uint32_t alignment, std::uint32_t& offset) {
+        std::uint32_t start = alignUp(cursor, alignment);
+        if (start + size > frameSize) {
+            return false;
+        }
+        offset = frameOffset() + start;
+        cursor = start + size;
+        return true;
+    }
+
+    void advance() {
+        frame = (frame + 1) % frameCount;
+        cursor = 0;
+    }
+
+    std::uint32_t frameSize;
+    std::uint32_t frameCount;
+    std::uint32_t frame = 0;
+    std::uint32_t cursor = 0;
+};
+
+// Streams per-frame data such as batched or particle vertices to the GPU.
+//
+// With GL 4.4 the buffer is mapped once, persistently and coherently, and split
+// into StreamBufferFrameCount segments. A fence is placed after each frame's
+// draws and waited on before that segment is written again, so the CPU writes
+// straight into GPU visible memory without driver side copies.
+//
+// On older contexts the buffer holds a single segment that is orphaned and
+// re-mapped every frame, which lets the driver hand out fresh storage instead.
+//
+// Usage per frame: beginFrame, allocate and write, commit, draw, endFrame.
+class StreamBuffer {
+public:
+    StreamBuffer(std::uint32_t target, std::uint32_t frameSize) :
+        target(target),
+        ring(frameSize, StreamBufferFrameCount) {}
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    ~StreamBuffer() {
+        for (GLsync fence : fences) {
+            if (fence != nullptr) {
+                glDeleteSync(fence);
+            }
+        }
+    }
+
+    void prepare() {
+        persistent = GLAD_GL_VERSION_4_4;
+        if (!persistent) {
+            ring.frameCount = 1;
+        }
+
+        bufferObject = GlBuffer::create();
+        glBindBuffer(target, bufferObject.get());
+
+        std::uint32_t totalSize = ring.frameSize * ring.frameCount;
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, totalSize, nullptr, flags);
+            mappedData = static_cast<std::uint8_t*>(glMapBufferRange(target, 0, totalSize, flags));
+        } else {
+            glBufferData(target, totalSize, nullptr, GL_STREAM_DRAW);
+        }
+
+        glBindBuffer(target, 0);
+    }
+
+    void beginFrame() {
+        if (persistent) {
+            waitForFence(fences[ring.frame]);
+            fences[ring.frame] = nullptr;
+
+        } else {
+            glBindBuffer(target, bufferObject.get());
+            glBufferData(target, ring.frameSize, nullptr, GL_STREAM_DRAW);
+            mappedData = static_cast<std::uint8_t*>(glMapBufferRange(
+                target,
+                0,
+                ring.frameSize,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+            glBindBuffer(target, 0);
+        }
+    }
+
+    // Returns a region with data set to nullptr when the frame segment is full
+    StreamRegion allocate(std::uint32_t size, std::uint32_t alignment = 16) {
+        StreamRegion region;
+        std::uint32_t offset;
+        if (mappedData != nullptr && ring.reserve(size, alignment, offset)) {
+            region.data = mappedData + offset;
+            region.offset = offset;
+            region.size = size;
+        }
+        return region;
+    }
+
+    // Must be called after writing and before issuing draws that source the buffer
+    void commit() {
+        if (!persistent) {
+            glBindBuffer(target, bufferObject.get());
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            mappedData = nullptr;
+        }
+    }
+
+    void endFrame() {
+        if (persistent) {
+            fences[ring.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        ring.advance();
+    }
+
+    // Forgets the buffer and fences without deleting them, for use after the context was lost
+    void abandon() {
+        bufferObject.release();
+        for (GLsync& fence : fences) {
+            fence = nullptr;
+        }
+        mappedData = nullptr;
+        ring.frame = 0;
+        ring.cursor = 0;
+    }
+
+    std::uint32_t getBufferObject() {
+        return bufferObject.get();
+    }
+
+    std::uint32_t getTotalSize() {
+        return bufferObject ? ring.frameSize * ring.frameCount : 0;
+    }
+
+private:
+    void waitForFence(GLsync fence) {
+        if (fence == nullptr) {
+            return;
+        }
+
+        const GLuint64 TimeoutNanoseconds = 1000000;
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, TimeoutNanoseconds);
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(fence, 0, TimeoutNanoseconds);
+        }
+        glDeleteSync(fence);
+    }
+
+    std::uint32_t target;
+    GlBuffer bufferObject;
+    bool persistent = false;
+    std::uint8_t *mappedData = nullptr;
+    GLsync fences[StreamBufferFrameCount] = {};
+
+    StreamRing ring;
+};
+
+#endif // PONG_STREAM_BUFFER_H
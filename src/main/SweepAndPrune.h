@@ -0,0 +1,128 @@
+#ifndef PONG_SWEEP_AND_PRUNE_H
+#define PONG_SWEEP_AND_PRUNE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Sort and sweep broadphase along x between two groups of boxes, for example
+// static obstacles (group 0) against moving balls (group 1). Pairs within a group
+// are never reported.
+//
+// Endpoints stay sorted between calls, and since boxes only move a little per tick
+// an insertion sort restores the order in close to linear time. A full sort is only
+// done after proxies have been added.
+class SweepAndPrune {
+public:
+    std::uint32_t add(glm::vec2 min, glm::vec2 max, std::uint8_t group) {
+        std::uint32_t proxy = proxies.size();
+        proxies.push_back({min, max, group, 0});
+        endpoints.push_back({min.x, proxy, true});
+        endpoints.push_back({max.x, proxy, false});
+        unsorted = true;
+        return proxy;
+    }
+
+    void update(std::uint32_t proxy, glm::vec2 min, glm::vec2 max) {
+        proxies[proxy].min = min;
+        proxies[proxy].max = max;
+    }
+
+    void clear() {
+        proxies.clear();
+        endpoints.clear();
+    }
+
+    std::size_t size() const {
+        return proxies.size();
+    }
+
+    // Fills pairs with (group 0 proxy, group 1 proxy) for every pair of overlapping boxes,
+    // into a vector with any allocator so the pairs can live in a frame arena
+    template <typename Allocator>
+    void findPairs(std::vector<std::pair<std::uint32_t, std::uint32_t>, Allocator>& pairs) {
+        pairs.clear();
+        sortEndpoints();
+
+        active[0].clear();
+        active[1].clear();
+
+        for (const Endpoint& endpoint : endpoints) {
+            Proxy& proxy = proxies[endpoint.proxy];
+            std::vector<std::uint32_t>& own = active[proxy.group];
+
+            if (endpoint.isMin) {
+                for (std::uint32_t other : active[1 - proxy.group]) {
+                    const Proxy& otherProxy = proxies[other];
+                    if (proxy.min.y <= otherProxy.max.y && proxy.max.y >= otherProxy.min.y) {
+                        if (proxy.group == 0) {
+                            pairs.emplace_back(endpoint.proxy, other);
+                        } else {
+                            pairs.emplace_back(other, endpoint.proxy);
+                        }
+                    }
+                }
+                proxy.activeSlot = own.size();
+                own.push_back(endpoint.proxy);
+
+            } else {
+                std::uint32_t last = own.back();
+                own[proxy.activeSlot] = last;
+                proxies[last].activeSlot = proxy.activeSlot;
+                own.pop_back();
+            }
+        }
+    }
+
+private:
+    struct Proxy {
+        glm::vec2 min;
+        glm::vec2 max;
+        std::uint8_t group;
+        std::uint32_t activeSlot;
+    };
+
+    struct Endpoint {
+        float value;
+        std::uint32_t proxy;
+        bool isMin;
+    };
+
+    // Min endpoints go first on ties so touching boxes count as overlapping
+    static bool before(const Endpoint& a, const Endpoint& b) {
+        return a.value < b.value || (a.value == b.value && a.isMin && !b.isMin);
+    }
+
+    void sortEndpoints() {
+        for (Endpoint& endpoint : endpoints) {
+            const Proxy& proxy = proxies[endpoint.proxy];
+            endpoint.value = endpoint.isMin ? proxy.min.x : proxy.max.x;
+        }
+
+        if (unsorted) {
+            std::sort(endpoints.begin(), endpoints.end(), before);
+            unsorted = false;
+            return;
+        }
+
+        for (std::size_t i = 1; i < endpoints.size(); i++) {
+            Endpoint endpoint = endpoints[i];
+            std::size_t j = i;
+            while (j > 0 && before(endpoint, endpoints[j - 1])) {
+                endpoints[j] = endpoints[j - 1];
+                j--;
+            }
+            endpoints[j] = endpoint;
+        }
+    }
+
+    std::vector<Proxy> proxies;
+    std::vector<Endpoint> endpoints;
+    std::vector<std::uint32_t> active[2];
+    bool unsorted = false;
+};
+
+#endif // PONG_SWEEP_AND_PRUNE_H
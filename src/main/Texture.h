@@ -1,15 +1,17 @@
 #ifndef PONG_TEXTURE_H
 #define PONG_TEXTURE_H
 
+#include "GlObject.h"
 #include "Image.h"
 
 #include <cstdint>
+#include <memory>
 
 struct Texture {
     Texture(std::shared_ptr<Image> image) : image(image) {}
 
     std::shared_ptr<Image> image;
-    std::uint32_t textureId;
+    GlTexture textureId;
 };
 
 #endif // PONG_TEXTURE_H
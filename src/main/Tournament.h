@@ -0,0 +1,196 @@
+#ifndef PONG_TOURNAMENT_H
+#define PONG_TOURNAMENT_H
+
+#include "Match.h"
+#include "PaddleController.h"
+#include "WorkStealingPool.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A controller taking part in a tournament. Every match gets a controller of its own from
+// create, so controllers that keep state between ticks start afresh.
+struct TournamentEntrant {
+    std::string name;
+    std::function<std::shared_ptr<PaddleController>()> create;
+};
+
+struct TournamentSettings {
+    std::uint32_t matchesPerPairing = 100;
+    std::uint32_t pointsToWin = 5;
+    std::uint32_t maxTicks = 60 * 60 * 10;
+    float tickTime = 1.0 / 60.0;
+    std::uint64_t seed = 1;
+};
+
+enum class MatchOutcome {
+    LeftWon,
+    RightWon,
+    Draw
+};
+
+// Win and draw counts between every pair of entrants, indexed [a * entrantCount + b]
+struct TournamentResults {
+    explicit TournamentResults(std::size_t entrantCount = 0) :
+        entrantCount(entrantCount),
+        wins(entrantCount * entrantCount),
+        draws(entrantCount * entrantCount) {
+    }
+
+    void add(std::size_t a, std::size_t b, MatchOutcome outcome) {
+        if (outcome == MatchOutcome::LeftWon) {
+            wins[a * entrantCount + b]++;
+        } else if (outcome == MatchOutcome::RightWon) {
+            wins[b * entrantCount + a]++;
+        } else {
+            draws[a * entrantCount + b]++;
+            draws[b * entrantCount + a]++;
+        }
+        matchCount++;
+    }
+
+    void merge(const TournamentResults& other) {
+        for (std::size_t i = 0; i < wins.size(); i++) {
+            wins[i] += other.wins[i];
+            draws[i] += other.draws[i];
+        }
+        matchCount += other.matchCount;
+        tickCount += other.tickCount;
+    }
+
+    // Counts a draw as half a win
+    double score(std::size_t a, std::size_t b) const {
+        return wins[a * entrantCount + b] + 0.5 * draws[a * entrantCount + b];
+    }
+
+    double games(std::size_t a, std::size_t b) const {
+        return static_cast<double>(wins[a * entrantCount + b]) + wins[b * entrantCount + a] +
+            draws[a * entrantCount + b];
+    }
+
+    std::size_t entrantCount;
+    std::vector<std::uint64_t> wins;
+    std::vector<std::uint64_t> draws;
+    std::uint64_t matchCount = 0;
+    std::uint64_t tickCount = 0;
+};
+
+// Plays until one side reaches the points to win. A match running out of ticks goes to
+// whoever leads, or is drawn.
+MatchOutcome playMatch(
+    PaddleController& left,
+    PaddleController& right,
+    std::uint64_t seed,
+    const TournamentSettings& settings,
+    std::uint64_t& tickCount) {
+
+    MatchState match;
+    resetMatch(match, seed);
+
+    while (match.tick < settings.maxTicks &&
+        !gameWon(match.pointsLeft, match.pointsRight, settings.pointsToWin)) {
+
+        float leftAction = left.act(observeMatch(match, PaddleSide::Left));
+        float rightAction = right.act(observeMatch(match, PaddleSide::Right));
+        stepMatch(match, leftAction, rightAction, settings.tickTime);
+    }
+
+    tickCount += match.tick;
+    if (match.pointsLeft == match.pointsRight) {
+        return MatchOutcome::Draw;
+    }
+    return match.pointsLeft > match.pointsRight ? MatchOutcome::LeftWon : MatchOutcome::RightWon;
+}
+
+// Results of one worker on cache lines of their own, so workers counting matches and ticks
+// do not keep taking the same line from each other
+struct alignas(64) WorkerTournamentResults {
+    explicit WorkerTournamentResults(std::size_t entrantCount) :
+        results(entrantCount) {
+    }
+
+    TournamentResults results;
+};
+
+// Plays every entrant against every other on both sides. Each worker records into results
+// of its own, which are only merged once all matches are over.
+TournamentResults runTournament(
+    const std::vector<TournamentEntrant>& entrants,
+    const TournamentSettings& settings,
+    WorkStealingPool& pool) {
+
+    std::size_t entrantCount = entrants.size();
+    if (entrantCount < 2) {
+        return TournamentResults(entrantCount);
+    }
+
+    std::uint64_t pairingCount = entrantCount * (entrantCount - 1);
+    std::uint32_t matchCount = static_cast<std::uint32_t>(pairingCount * settings.matchesPerPairing);
+
+    std::vector<WorkerTournamentResults> workerResults(pool.size(), WorkerTournamentResults(entrantCount));
+
+    pool.parallelFor(matchCount, 16, [&](std::size_t worker, std::uint32_t begin, std::uint32_t end) {
+        TournamentResults& results = workerResults[worker].results;
+
+        for (std::uint32_t m = begin; m < end; m++) {
+            std::size_t pairing = m / settings.matchesPerPairing;
+            std::size_t a = pairing / (entrantCount - 1);
+            std::size_t b = pairing % (entrantCount - 1);
+            b += b >= a;
+
+            auto left = entrants[a].create();
+            auto right = entrants[b].create();
+            results.add(a, b, playMatch(*left, *right, settings.seed + m, settings, results.tickCount));
+        }
+    });
+
+    TournamentResults results(entrantCount);
+    for (const WorkerTournamentResults& worker : workerResults) {
+        results.merge(worker.results);
+    }
+    return results;
+}
+
+// Fits Bradley-Terry strengths to the results with minorization-maximization and puts them
+// on the Elo scale around 1500. Every pair is given one extra drawn game, so an entrant
+// that never wins still gets a finite rating.
+std::vector<double> fitEloRatings(const TournamentResults& results, std::uint32_t iterations = 1000) {
+    std::size_t count = results.entrantCount;
+    std::vector<double> strengths(count, 1.0);
+
+    for (std::uint32_t iteration = 0; iteration < iterations; iteration++) {
+        std::vector<double> next(count);
+        double logSum = 0.0;
+
+        for (std::size_t a = 0; a < count; a++) {
+            double score = 0.0;
+            double denominator = 0.0;
+            for (std::size_t b = 0; b < count; b++) {
+                if (a != b) {
+                    score += results.score(a, b) + 0.5;
+                    denominator += (results.games(a, b) + 1.0) / (strengths[a] + strengths[b]);
+                }
+            }
+            next[a] = denominator > 0.0 ? score / denominator : 1.0;
+            logSum += std::log(next[a]);
+        }
+
+        double scale = std::exp(logSum / count);
+        for (std::size_t a = 0; a < count; a++) {
+            strengths[a] = next[a] / scale;
+        }
+    }
+
+    std::vector<double> ratings(count);
+    for (std::size_t a = 0; a < count; a++) {
+        ratings[a] = 1500.0 + 400.0 * std::log10(strengths[a]);
+    }
+    return ratings;
+}
+
+#endif // PONG_TOURNAMENT_H
@@ -0,0 +1,33 @@
+#ifndef PONG_TRAJECTORY_H
+#define PONG_TRAJECTORY_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// Folds a y coordinate travelled in a straight line back into [minY, maxY], as if
+// reflected off walls at both ends. Unfolding the reflections this way turns any
+// number of wall bounces into a single modulo.
+float foldIntoRange(float y, float minY, float maxY) {
+    float range = maxY - minY;
+    if (range <= 0.0f) {
+        return minY;
+    }
+
+    float period = 2.0f * range;
+    float travelled = std::fmod(y - minY, period);
+    if (travelled < 0.0f) {
+        travelled += period;
+    }
+
+    return travelled <= range ? minY + travelled : maxY - (travelled - range);
+}
+
+// Returns the y where a ball at position moving with velocity crosses targetX,
+// bouncing between minY and maxY on the way. The ball must be moving towards targetX.
+float predictInterceptY(glm::vec2 position, glm::vec2 velocity, float targetX, float minY, float maxY) {
+    float time = (targetX - position.x) / velocity.x;
+    return foldIntoRange(position.y + velocity.y * time, minY, maxY);
+}
+
+#endif // PONG_TRAJECTORY_H
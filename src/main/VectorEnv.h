@@ -0,0 +1,206 @@
+#ifndef PONG_VECTOR_ENV_H
+#define PONG_VECTOR_ENV_H
+
+#include "Match.h"
+#include "PaddleController.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Many independent matches stepped together for training paddle agents, in the style of a
+// gym vector environment. The agent plays the right paddle against a batched opponent.
+//
+// Observations are written straight into a caller owned buffer of
+// PaddleObservationSize * size() floats, one array per feature as PaddleObservationBatch
+// reads them, so a policy can act on them without a copy. A match that ends is reset at
+// once, and the observation returned for it is the first of the next episode.
+//
+// Matches are split into one contiguous slice per thread. The calling thread steps the first
+// slice itself, so a single thread environment never starts a worker.
+class VectorEnv {
+public:
+    VectorEnv(
+        std::size_t envCount,
+        std::size_t threadCount = std::thread::hardware_concurrency(),
+        float tickTime = 1.0 / 60.0,
+        std::uint32_t maxEpisodeTicks = 60 * 60) :
+
+        matches(envCount),
+        opponentObservations(PaddleObservationSize * envCount),
+        opponentActions(envCount),
+        opponent(std::make_shared<InterceptBatchController>(matchField())),
+        tickTime(tickTime),
+        maxEpisodeTicks(maxEpisodeTicks) {
+
+        threadCount = std::max<std::size_t>(1, std::min(threadCount, envCount));
+        for (std::size_t i = 1; i < threadCount; i++) {
+            workers.emplace_back([this, i, threadCount]() {
+                work(i, threadCount);
+            });
+        }
+    }
+
+    ~VectorEnv() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    VectorEnv(const VectorEnv&) = delete;
+    VectorEnv& operator=(const VectorEnv&) = delete;
+
+    // The opponent is called from every thread at once with a slice of the matches,
+    // so it must not keep state per match
+    void setOpponent(std::shared_ptr<BatchPaddleController> newOpponent) {
+        opponent = std::move(newOpponent);
+    }
+
+    // Starts every match from its seed
+    void reset(const std::uint64_t* seeds, float* observations) {
+        job = {seeds, nullptr, observations, nullptr, nullptr};
+        run();
+    }
+
+    // Applies one action per match, as a paddle velocity from -1 to 1. Rewards are 1 when
+    // the agent scores and -1 when it concedes. Done is set when a point is scored or the
+    // episode runs out of ticks.
+    void step(const float* actions, float* observations, float* rewards, std::uint8_t* dones) {
+        job = {nullptr, actions, observations, rewards, dones};
+        run();
+    }
+
+    std::size_t size() const {
+        return matches.size();
+    }
+
+    const MatchState& getMatch(std::size_t i) const {
+        return matches[i];
+    }
+
+private:
+    struct Job {
+        const std::uint64_t* seeds;
+        const float* actions;
+        float* observations;
+        float* rewards;
+        std::uint8_t* dones;
+    };
+
+    void run() {
+        std::size_t threadCount = workers.size() + 1;
+        if (threadCount > 1) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending = workers.size();
+                generation++;
+            }
+            wake.notify_all();
+        }
+
+        runSlice(0, threadCount);
+
+        if (threadCount > 1) {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this]() {
+                return pending == 0;
+            });
+        }
+    }
+
+    void work(std::size_t slice, std::size_t threadCount) {
+        std::uint64_t seen = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() {
+                    return generation != seen;
+                });
+                seen = generation;
+                if (stopping) {
+                    return;
+                }
+            }
+
+            runSlice(slice, threadCount);
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                last = --pending == 0;
+            }
+            if (last) {
+                finished.notify_one();
+            }
+        }
+    }
+
+    void runSlice(std::size_t slice, std::size_t threadCount) {
+        std::size_t count = matches.size();
+        std::size_t begin = count * slice / threadCount;
+        std::size_t end = count * (slice + 1) / threadCount;
+
+        if (job.seeds) {
+            for (std::size_t i = begin; i < end; i++) {
+                resetMatch(matches[i], job.seeds[i]);
+                storePaddleObservation(observeMatch(matches[i], PaddleSide::Right), job.observations, count, i);
+            }
+            return;
+        }
+
+        for (std::size_t i = begin; i < end; i++) {
+            storePaddleObservation(observeMatch(matches[i], PaddleSide::Left), opponentObservations.data(), count, i);
+        }
+        auto batch = PaddleObservationBatch::fromBuffer(opponentObservations.data(), count);
+        opponent->act(batch.slice(begin, end), opponentActions.data() + begin);
+
+        for (std::size_t i = begin; i < end; i++) {
+            MatchState& match = matches[i];
+            MatchEvent event = stepMatch(match, opponentActions[i], job.actions[i], tickTime);
+
+            job.rewards[i] = event == MatchEvent::RightScored ? 1.0f : (event == MatchEvent::LeftScored ? -1.0f : 0.0f);
+            job.dones[i] = event != MatchEvent::None || match.tick >= maxEpisodeTicks;
+
+            // The generator carries on, so the next episode differs from this one
+            if (job.dones[i]) {
+                Randomizer random = match.random;
+                match = MatchState();
+                match.random = random;
+                serveBall(match);
+            }
+
+            storePaddleObservation(observeMatch(match, PaddleSide::Right), job.observations, count, i);
+        }
+    }
+
+    std::vector<MatchState> matches;
+    std::vector<float> opponentObservations;
+    std::vector<float> opponentActions;
+    std::shared_ptr<BatchPaddleController> opponent;
+    float tickTime;
+    std::uint32_t maxEpisodeTicks;
+
+    Job job {};
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::uint64_t generation = 0;
+    std::size_t pending = 0;
+    bool stopping = false;
+};
+
+#endif // PONG_VECTOR_ENV_H
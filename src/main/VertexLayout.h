@@ -0,0 +1,133 @@
+#ifndef PONG_VERTEX_LAYOUT_H
+#define PONG_VERTEX_LAYOUT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Attribute locations shared with the vertex shaders
+static const std::uint32_t PositionLocation = 0;
+static const std::uint32_t ColorLocation = 1;
+static const std::uint32_t TexCoordLocation = 2;
+
+enum class VertexAttributeType {
+    Float,
+    Int16,
+    UInt16,
+    UInt8
+};
+
+std::uint32_t vertexAttributeTypeSize(VertexAttributeType type) {
+    switch (type) {
+        case VertexAttributeType::Float : return sizeof(float);
+        case VertexAttributeType::Int16 : return sizeof(std::int16_t);
+        case VertexAttributeType::UInt16 : return sizeof(std::uint16_t);
+        case VertexAttributeType::UInt8 : return sizeof(std::uint8_t);
+    }
+    return 0;
+}
+
+struct VertexAttribute {
+    std::uint32_t location;
+    std::uint8_t componentCount;
+    VertexAttributeType type;
+    bool normalized;
+    std::uint32_t offset;
+
+    bool operator==(const VertexAttribute& other) const {
+        return location == other.location &&
+            componentCount == other.componentCount &&
+            type == other.type &&
+            normalized == other.normalized &&
+            offset == other.offset;
+    }
+};
+
+// Describes how the attributes of one vertex are packed into a vertex buffer.
+// Attributes start on 4 byte boundaries as recommended for GPU vertex fetch.
+struct VertexLayout {
+    VertexLayout& add(
+        std::uint32_t location,
+        std::uint8_t componentCount,
+        VertexAttributeType type,
+        bool normalized = false) {
+
+        std::uint32_t offset = stride;
+        attributes.push_back({location, componentCount, type, normalized, offset});
+        std::uint32_t size = componentCount * vertexAttributeTypeSize(type);
+        stride = (offset + size + 3) / 4 * 4;
+        return *this;
+    }
+
+    const VertexAttribute* find(std::uint32_t location) const {
+        for (const auto& attribute : attributes) {
+            if (attribute.location == location) {
+                return &attribute;
+            }
+        }
+        return nullptr;
+    }
+
+    bool operator==(const VertexLayout& other) const {
+        return stride == other.stride && attributes == other.attributes;
+    }
+
+    std::vector<VertexAttribute> attributes;
+    std::uint32_t stride = 0;
+};
+
+// Position 3, color 3 and texture coords 2, all as floats
+VertexLayout standardVertexLayout() {
+    return VertexLayout()
+        .add(PositionLocation, 3, VertexAttributeType::Float)
+        .add(ColorLocation, 3, VertexAttributeType::Float)
+        .add(TexCoordLocation, 2, VertexAttributeType::Float);
+}
+
+// Position 2 as floats and texture coords 2 as normalized shorts. z defaults
+// to 0 and w to 1 in the shader, and the unused color attribute is dropped.
+VertexLayout compactVertexLayout() {
+    return VertexLayout()
+        .add(PositionLocation, 2, VertexAttributeType::Float)
+        .add(TexCoordLocation, 2, VertexAttributeType::UInt16, true);
+}
+
+// Converts float values to the attribute's component type and stores them at destination.
+// Normalized values are expected in [0, 1] for unsigned and [-1, 1] for signed types.
+void packVertexAttribute(const VertexAttribute& attribute, const float *values, std::uint8_t *destination) {
+    destination += attribute.offset;
+
+    for (std::uint8_t i = 0; i < attribute.componentCount; i++) {
+        float value = values[i];
+
+        switch (attribute.type) {
+            case VertexAttributeType::Float :
+                std::memcpy(destination + i * sizeof(float), &value, sizeof(float));
+                break;
+
+            case VertexAttributeType::Int16 : {
+                float scaled = attribute.normalized ? std::max(-1.0f, std::min(1.0f, value)) * 32767.0f : value;
+                std::int16_t packed = static_cast<std::int16_t>(std::lround(scaled));
+                std::memcpy(destination + i * sizeof(std::int16_t), &packed, sizeof(std::int16_t));
+                break;
+            }
+
+            case VertexAttributeType::UInt16 : {
+                float scaled = attribute.normalized ? std::max(0.0f, std::min(1.0f, value)) * 65535.0f : value;
+                std::uint16_t packed = static_cast<std::uint16_t>(std::lround(scaled));
+                std::memcpy(destination + i * sizeof(std::uint16_t), &packed, sizeof(std::uint16_t));
+                break;
+            }
+
+            case VertexAttributeType::UInt8 : {
+                float scaled = attribute.normalized ? std::max(0.0f, std::min(1.0f, value)) * 255.0f : value;
+                destination[i] = static_cast<std::uint8_t>(std::lround(scaled));
+                break;
+            }
+        }
+    }
+}
+
+#endif // PONG_VERTEX_LAYOUT_H
@@ -0,0 +1,198 @@
+#ifndef PONG_WORK_STEALING_POOL_H
+#define PONG_WORK_STEALING_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs index ranges on a fixed set of threads. Each thread starts with an equal share of the
+// indices and takes them from the front of its own range in chunks. A thread that runs out
+// steals the back half of another thread's range. Ranges are packed into one atomic word
+// each, so neither taking nor stealing needs a lock.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(std::size_t threadCount = std::thread::hardware_concurrency()) :
+        threadCount(std::max<std::size_t>(1, threadCount)),
+        ranges(new WorkerRange[this->threadCount]) {
+
+        for (std::size_t i = 1; i < this->threadCount; i++) {
+            workers.emplace_back([this, i]() {
+                work(i);
+            });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Threads including the caller, workers are numbered from 0 to size() - 1
+    std::size_t size() const {
+        return threadCount;
+    }
+
+    // Calls task(worker, begin, end) on ranges that together cover every index below count
+    // exactly once, with at most grain indices in each. Returns when all calls are done.
+    void parallelFor(
+        std::uint32_t count,
+        std::uint32_t grain,
+        std::function<void(std::size_t, std::uint32_t, std::uint32_t)> task) {
+
+        this->task = std::move(task);
+        this->grain = std::max<std::uint32_t>(1, grain);
+
+        for (std::size_t i = 0; i < threadCount; i++) {
+            std::uint32_t begin = static_cast<std::uint64_t>(count) * i / threadCount;
+            std::uint32_t end = static_cast<std::uint64_t>(count) * (i + 1) / threadCount;
+            ranges[i].range.store(pack(begin, end), std::memory_order_relaxed);
+        }
+
+        if (!workers.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending = workers.size();
+                generation++;
+            }
+            wake.notify_all();
+        }
+
+        drain(0);
+
+        if (!workers.empty()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this]() {
+                return pending == 0;
+            });
+        }
+
+        this->task = nullptr;
+    }
+
+private:
+    // Kept on separate cache lines so threads taking from their own range do not
+    // invalidate each other
+    struct alignas(64) WorkerRange {
+        std::atomic<std::uint64_t> range {0};
+    };
+
+    static std::uint64_t pack(std::uint32_t begin, std::uint32_t end) {
+        return static_cast<std::uint64_t>(begin) << 32 | end;
+    }
+
+    static std::uint32_t rangeBegin(std::uint64_t range) {
+        return static_cast<std::uint32_t>(range >> 32);
+    }
+
+    static std::uint32_t rangeEnd(std::uint64_t range) {
+        return static_cast<std::uint32_t>(range);
+    }
+
+    bool takeOwn(std::size_t worker, std::uint32_t& begin, std::uint32_t& end) {
+        std::atomic<std::uint64_t>& own = ranges[worker].range;
+        std::uint64_t current = own.load(std::memory_order_acquire);
+
+        while (rangeBegin(current) < rangeEnd(current)) {
+            begin = rangeBegin(current);
+            end = begin + std::min(grain, rangeEnd(current) - begin);
+            if (own.compare_exchange_weak(current, pack(end, rangeEnd(current)), std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moves the back half of another thread's range into this thread's own, which is empty.
+    // Non-empty ranges never overlap, so a stale compare cannot succeed on a reused value.
+    bool steal(std::size_t worker) {
+        for (std::size_t offset = 1; offset < threadCount; offset++) {
+            std::atomic<std::uint64_t>& victim = ranges[(worker + offset) % threadCount].range;
+            std::uint64_t current = victim.load(std::memory_order_acquire);
+
+            while (rangeBegin(current) < rangeEnd(current)) {
+                std::uint32_t begin = rangeBegin(current);
+                std::uint32_t end = rangeEnd(current);
+                std::uint32_t middle = begin + (end - begin) / 2;
+                if (victim.compare_exchange_weak(current, pack(begin, middle), std::memory_order_acq_rel)) {
+                    ranges[worker].range.store(pack(middle, end), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void drain(std::size_t worker) {
+        std::uint32_t begin;
+        std::uint32_t end;
+
+        while (true) {
+            if (takeOwn(worker, begin, end)) {
+                task(worker, begin, end);
+            } else if (!steal(worker)) {
+                return;
+            }
+        }
+    }
+
+    void work(std::size_t worker) {
+        std::uint64_t seen = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() {
+                    return generation != seen;
+                });
+                seen = generation;
+                if (stopping) {
+                    return;
+                }
+            }
+
+            drain(worker);
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                last = --pending == 0;
+            }
+            if (last) {
+                finished.notify_one();
+            }
+        }
+    }
+
+    std::size_t threadCount;
+    std::unique_ptr<WorkerRange[]> ranges;
+    std::function<void(std::size_t, std::uint32_t, std::uint32_t)> task;
+    std::uint32_t grain = 1;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::uint64_t generation = 0;
+    std::size_t pending = 0;
+    bool stopping = false;
+};
+
+#endif // PONG_WORK_STEALING_POOL_H
@@ -0,0 +1,182 @@
+#ifndef PONG_WORLD_H
+#define PONG_WORLD_H
+
+#include "Mesh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Handle to an entity. The generation tells apart entities reusing the same index,
+// so handles to destroyed entities are never mistaken for live ones.
+struct Entity {
+    std::uint32_t index = std::numeric_limits<std::uint32_t>::max();
+    std::uint32_t generation = 0;
+
+    bool operator==(const Entity& other) const {
+        return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const Entity& other) const {
+        return !(*this == other);
+    }
+};
+
+struct Transform {
+    glm::vec2 position;
+};
+
+struct Aabb {
+    glm::vec2 halfExtents;
+};
+
+struct Velocity {
+    glm::vec2 value;
+};
+
+struct Renderable {
+    std::shared_ptr<Mesh> mesh;
+};
+
+// Static or kinematic body that moving bodies bounce off.
+// Paddles deflect the bounce depending on where along them they were hit.
+struct Collider {
+    glm::vec2 normal;
+    bool paddle = false;
+};
+
+// Marks bodies that bounce off colliders and each other
+struct Ball {
+};
+
+// Sparse set: components are stored densely in insertion order and looked up by
+// entity index through a sparse array, removal swaps the last component into the gap.
+// System passes iterate components() and entities() side by side.
+template <typename T>
+class ComponentPool {
+public:
+    T& add(Entity entity, T component) {
+        if (entity.index >= sparse.size()) {
+            sparse.resize(entity.index + 1, Absent);
+        }
+
+        if (has(entity)) {
+            return dense[sparse[entity.index]] = component;
+        }
+
+        sparse[entity.index] = dense.size();
+        dense.push_back(component);
+        denseEntities.push_back(entity);
+        return dense.back();
+    }
+
+    void remove(Entity entity) {
+        if (!has(entity)) {
+            return;
+        }
+
+        std::uint32_t removed = sparse[entity.index];
+        std::uint32_t last = dense.size() - 1;
+        if (removed != last) {
+            dense[removed] = std::move(dense[last]);
+            denseEntities[removed] = denseEntities[last];
+            sparse[denseEntities[removed].index] = removed;
+        }
+
+        dense.pop_back();
+        denseEntities.pop_back();
+        sparse[entity.index] = Absent;
+    }
+
+    bool has(Entity entity) const {
+        return entity.index < sparse.size() &&
+            sparse[entity.index] != Absent &&
+            denseEntities[sparse[entity.index]] == entity;
+    }
+
+    T& get(Entity entity) {
+        return dense[sparse[entity.index]];
+    }
+
+    const T& get(Entity entity) const {
+        return dense[sparse[entity.index]];
+    }
+
+    std::size_t size() const {
+        return dense.size();
+    }
+
+    std::vector<T>& components() {
+        return dense;
+    }
+
+    const std::vector<Entity>& entities() const {
+        return denseEntities;
+    }
+
+    void clear() {
+        dense.clear();
+        denseEntities.clear();
+        sparse.clear();
+    }
+
+private:
+    static constexpr std::uint32_t Absent = std::numeric_limits<std::uint32_t>::max();
+
+    std::vector<T> dense;
+    std::vector<Entity> denseEntities;
+    std::vector<std::uint32_t> sparse;
+};
+
+class World {
+public:
+    Entity create() {
+        Entity entity;
+        if (!freeIndices.empty()) {
+            entity.index = freeIndices.back();
+            freeIndices.pop_back();
+        } else {
+            entity.index = generations.size();
+            generations.push_back(0);
+        }
+        entity.generation = generations[entity.index];
+        return entity;
+    }
+
+    void destroy(Entity entity) {
+        if (!alive(entity)) {
+            return;
+        }
+
+        transforms.remove(entity);
+        aabbs.remove(entity);
+        velocities.remove(entity);
+        renderables.remove(entity);
+        colliders.remove(entity);
+        balls.remove(entity);
+
+        generations[entity.index]++;
+        freeIndices.push_back(entity.index);
+    }
+
+    bool alive(Entity entity) const {
+        return entity.index < generations.size() && generations[entity.index] == entity.generation;
+    }
+
+    ComponentPool<Transform> transforms;
+    ComponentPool<Aabb> aabbs;
+    ComponentPool<Velocity> velocities;
+    ComponentPool<Renderable> renderables;
+    ComponentPool<Collider> colliders;
+    ComponentPool<Ball> balls;
+
+private:
+    std::vector<std::uint32_t> generations;
+    std::vector<std::uint32_t> freeIndices;
+};
+
+#endif // PONG_WORLD_H
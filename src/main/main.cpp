@@ -1,175 +1,283 @@
+#include "AllocationTracking.h"
+#include "Bvh.h"
 #include "Helper.h"
 #include "Effect.h"
+#include "FrameArena.h"
+#include "JitterBuffer.h"
+#include "GeometryRegistry.h"
+#include "Match.h"
+#include "MatchServer.h"
+#include "MemoryTracker.h"
 #include "Mesh.h"
+#include "Network.h"
+#include "MlpPolicy.h"
+#include "PaddleController.h"
 #include "Renderer.h"
 #include "Window.h"
 #include "Randomizer.h"
+#include "Replay.h"
+#include "Rollback.h"
+#if defined(__linux__)
+#include "Relay.h"
+#endif
+#include "Snapshot.h"
 #include "Gui.h"
+#include "SpatialGrid.h"
+#include "SweepAndPrune.h"
+#include "World.h"
 
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <algorithm>
+#include <cassert>
 #include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
 #include <iostream>
 #include <map>
 #include <memory>
-
-struct Body {
-    Body(glm::vec2 position, float width, float height) :
-        position(position), width(width), height(height) {}
-
-    glm::vec2 position;
-    float width;
-    float height;
-};
-
-struct Obstacle {
-    Obstacle(std::shared_ptr<Body> body, glm::vec2 normal) : body(body), normal(normal) {}
-
-    std::shared_ptr<Body> body;
-    glm::vec2 normal;
-};
-
-struct Paddle : public Obstacle {
-    Paddle(std::shared_ptr<Body> body, glm::vec2 normal, std::shared_ptr<Mesh> mesh) :
-        Obstacle(body, normal), mesh(mesh) {}
-
-    std::shared_ptr<Mesh> mesh;
-};
-
-struct Ball {
-    Ball(std::shared_ptr<Body> body, std::shared_ptr<Mesh> mesh) : body(body), mesh(mesh) {}
-
-    glm::vec2 direction;
-    std::shared_ptr<Body> body;
-    std::shared_ptr<Mesh> mesh;
-};
-
-enum class PaddleAiState {
-    Idle,
-    GoingToIdle,
-    CatchingBall
-};
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 const std::uint32_t WINDOW_WIDTH = 1280;
 const std::uint32_t WINDOW_HEIGHT = 720;
-const float SIGHT_DISTANCE = 350.0;
-const float SURFACE_DISTANCE = 4.0;
-const float PADDLE_SPEED = 300.0;
-const float BALL_SPEED = 400.0;
-const float LIMIT_X = 600.0;
-const float LIMIT_Y = 300.0;
-const float DISTANCE_TO_IDLE_Y = 30.0;
-const float BALL_PADDLE_DIFF_Y = 30.0;
-const float PADDLE_HEIGHT = 50.0;
+const float SPAWN_AREA_X = 100.0;
+const double TICK_TIME = 1.0 / 120.0;
+const double MAX_FRAME_TIME = 0.25;
+const std::uint32_t KEYFRAME_INTERVAL = 240;
+const std::size_t FRAME_ARENA_SIZE = 4 << 20;
+// Builds that track allocations check that frames after this many, when every reused buffer
+// has grown to size, allocate nothing
+const std::uint64_t STEADY_STATE_FRAME = 600;
 
 std::shared_ptr<Window> window;
 std::shared_ptr<Renderer> renderer;
 std::shared_ptr<Effect> orthoEffect;
-std::uint8_t whitePixel = 255;
 std::shared_ptr<Texture> whiteTexture;
 
-std::shared_ptr<Obstacle> topWall;
-std::shared_ptr<Obstacle> bottomWall;
-std::shared_ptr<Paddle> paddleLeft;
-std::shared_ptr<Paddle> paddleRight;
-std::vector<std::shared_ptr<Obstacle>> obstacles;
-std::shared_ptr<Ball> ball;
+World world;
+Entity topWall;
+Entity bottomWall;
+Entity paddleLeft;
+Entity paddleRight;
+Entity ball;
+
+// Multi-ball mode is enabled with --balls N, ball is then the one the computer follows
+std::uint32_t ballCount = 1;
+SpatialGrid ballGrid(
+    glm::vec2(-WINDOW_WIDTH * 0.5, -(WINDOW_HEIGHT * 0.5)),
+    glm::vec2(WINDOW_WIDTH * 0.5, WINDOW_HEIGHT * 0.5),
+    BallSize * 2.0);
+
+// Colliders are in group 0 and balls in group 1, proxies are indexed like broadphaseEntities
+SweepAndPrune broadphase;
+std::vector<Entity> broadphaseEntities;
+
+// Scratch data of a tick lives here and is gone when the tick ends
+FrameArena frameArena(FRAME_ARENA_SIZE);
+
+// Colliders that never move, items are indexed like staticEntities
+Bvh staticBvh;
+std::vector<Entity> staticEntities;
+
+// The keyboard drives any paddle set to human, ball is what the controllers look at
+std::shared_ptr<HumanController> keyboard = std::make_shared<HumanController>();
+std::shared_ptr<PaddleController> leftController;
+std::shared_ptr<PaddleController> rightController;
 
-bool movingUp = false;
-bool movingDown = false;
 std::uint8_t pointsLeft = 0;
 std::uint8_t pointsRight = 0;
 
+// The simulation advances in fixed ticks from a known seed, so a recording of the paddle
+// actions is enough to play a game again exactly
 Randomizer randomizer;
-PaddleAiState paddleAiState = PaddleAiState::Idle;
+std::uint64_t seed = 0;
+std::uint32_t tick = 0;
+double tickAccumulator = 0.0;
+std::shared_ptr<ReplayRecorder> recorder;
+GameSnapshot replaySnapshot;
 auto currentTime = std::chrono::high_resolution_clock::now();
 
 std::shared_ptr<Gui> gui;
 
+// Written as JSON on exit when given with --memory-report
+std::string memoryReportPath;
+
+// Heap use per tag needs a build that tracks allocations, GPU use is always known
+void printMemoryUsage() {
+    MemoryTracker& tracker = memoryTracker();
+    std::printf("%12s %14s %14s %12s %14s %14s\n",
+        "tag", "heap bytes", "heap peak", "heap allocs", "gpu bytes", "gpu peak");
+    for (std::size_t i = 0; i <= MemoryTagCount; i++) {
+        MemoryTag tag = static_cast<MemoryTag>(i);
+        MemoryTagStats heap = i < MemoryTagCount ? tracker.getHeapStats(tag) : tracker.getHeapTotal();
+        GpuMemoryStats gpu = i < MemoryTagCount ? tracker.getGpuStats(tag) : tracker.getGpuTotal();
+        std::printf("%12s %14lld %14lld %12lld %14llu %14llu\n",
+            i < MemoryTagCount ? memoryTagName(tag) : "total",
+            static_cast<long long>(heap.liveBytes),
+            static_cast<long long>(heap.highWaterBytes),
+            static_cast<long long>(heap.liveAllocations),
+            static_cast<unsigned long long>(gpu.bytes),
+            static_cast<unsigned long long>(gpu.highWaterBytes));
+    }
+    if (!MemoryTracker::tracksHeap()) {
+        std::printf("Heap use is only tracked in Debug builds\n");
+    }
+}
+
+void saveMemoryReport() {
+    if (!memoryReportPath.empty() && !memoryTracker().saveJson(memoryReportPath)) {
+        std::cerr << "Could not write memory report " << memoryReportPath << std::endl;
+    }
+}
+
 void keyCallback(GLFWwindow* glfwWindow, int key, int scanCode, int action, int mods) {
 
     if (action == GLFW_PRESS) {
 
         if (key == GLFW_KEY_W || key == GLFW_KEY_UP) {
-            movingUp = true;
+            keyboard->movingUp = true;
         }
 
         if (key == GLFW_KEY_S || key == GLFW_KEY_DOWN) {
-            movingDown = true;
+            keyboard->movingDown = true;
         }
 
         if (key == GLFW_KEY_ESCAPE) {
             window->setShouldClose();
         }
+
+        if (key == GLFW_KEY_M) {
+            printMemoryUsage();
+        }
     }
 
     if (action == GLFW_RELEASE) {
 
         if (key == GLFW_KEY_W || key == GLFW_KEY_UP) {
-            movingUp = false;
+            keyboard->movingUp = false;
         }
 
         if (key == GLFW_KEY_S || key == GLFW_KEY_DOWN) {
-            movingDown = false;
+            keyboard->movingDown = false;
         }
     }
 }
 
+void addToBroadphase(Entity entity, std::uint8_t group) {
+    glm::vec2 position = world.transforms.get(entity).position;
+    glm::vec2 halfExtents = world.aabbs.get(entity).halfExtents;
+    broadphase.add(position - halfExtents, position + halfExtents, group);
+    broadphaseEntities.push_back(entity);
+}
+
+Entity createWall(glm::vec2 position, glm::vec2 normal) {
+    Entity wall = world.create();
+    world.transforms.add(wall, {position});
+    world.aabbs.add(wall, {glm::vec2(WallWidth, WallThickness) * 0.5f});
+    world.colliders.add(wall, {normal});
+    addToBroadphase(wall, 0);
+    return wall;
+}
+
 void createWalls() {
-    topWall = std::make_shared<Obstacle>(
-        std::make_shared<Body>(glm::vec2(0.0, 340.0), 1280.0f, 20.0f),
-        glm::vec2(0.0, -1.0));
-    obstacles.push_back(topWall);
+    topWall = createWall(glm::vec2(0.0, WallY), glm::vec2(0.0, -1.0));
+    bottomWall = createWall(glm::vec2(0.0, -WallY), glm::vec2(0.0, 1.0));
+}
 
-    bottomWall = std::make_shared<Obstacle>(
-        std::make_shared<Body>(glm::vec2(0.0, -340.0), 1280.0f, 20.0f),
-        glm::vec2(0.0, 1.0));
-    obstacles.push_back(bottomWall);
+// Gives an entity a white quad, unless the game runs without graphics
+void addQuadRenderable(Entity entity, float width, float height) {
+    if (!renderer) {
+        return;
+    }
+
+    auto mesh = buildQuadMesh(width, height, orthoEffect);
+    mesh->texture = whiteTexture;
+    renderer->addMesh(mesh);
+    world.renderables.add(entity, {mesh});
 }
 
 void createWhiteTexture() {
-    auto image = std::make_shared<Image>(1, 1, &whitePixel);
+    auto image = std::make_shared<Image>(1, 1, std::vector<std::uint8_t> {255});
+    image->reload = []() {
+        return std::vector<std::uint8_t> {255};
+    };
     whiteTexture = std::make_shared<Texture>(image);
     renderer->addTexture(whiteTexture);
 }
 
-void createBall() {
-    auto ballMesh = buildQuadMesh(10.0, 10.0, orthoEffect);
-    ballMesh->texture = whiteTexture;
-    ballMesh->transform = createTranslation(glm::vec2(0.0, 0.0));
-    renderer->addMesh(ballMesh);
+// A single ball starts in the middle, multiple balls are spread out so they do not collide at once
+glm::vec2 spawnPosition() {
+    if (ballCount == 1) {
+        return glm::vec2();
+    }
+    return randomizer.randomPosition(
+        glm::vec2(-SPAWN_AREA_X, -LimitY),
+        glm::vec2(SPAWN_AREA_X, LimitY));
+}
+
+Entity createBall() {
+    Entity newBall = world.create();
+    world.transforms.add(newBall, {spawnPosition()});
+    world.aabbs.add(newBall, {glm::vec2(BallSize * 0.5)});
+    world.velocities.add(newBall, {randomizer.randomDirection() * BallSpeed});
+    addQuadRenderable(newBall, BallSize, BallSize);
+    world.balls.add(newBall, {});
+    addToBroadphase(newBall, 1);
+    return newBall;
+}
+
+void createBalls() {
+    ball = createBall();
+    for (std::uint32_t i = 1; i < ballCount; i++) {
+        createBall();
+    }
+}
 
-    ball = std::make_shared<Ball>(
-        std::make_shared<Body>(glm::vec2(0.0, 0.0), 10.0f, 10.0f),
-        ballMesh);
-    ball->direction = randomizer.randomDirection();
+Entity createPaddle(glm::vec2 position, glm::vec2 normal) {
+    Entity paddle = world.create();
+    world.transforms.add(paddle, {position});
+    world.aabbs.add(paddle, {glm::vec2(PaddleWidth, PaddleHeight) * 0.5f});
+    world.velocities.add(paddle, {glm::vec2(0.0, 0.0)});
+    world.colliders.add(paddle, {normal, true});
+    addQuadRenderable(paddle, PaddleWidth, PaddleHeight);
+    addToBroadphase(paddle, 0);
+    return paddle;
 }
 
 void createPaddles() {
-    auto paddleLeftMesh = buildQuadMesh(20.0, 50.0, orthoEffect);
-    paddleLeftMesh->texture = whiteTexture;
-    paddleLeftMesh->transform = createTranslation(glm::vec2(-500.0, 0.0));
-    renderer->addMesh(paddleLeftMesh);
+    paddleLeft = createPaddle(glm::vec2(-PaddleX, 0.0), glm::vec2(1.0, 0.0));
+    paddleRight = createPaddle(glm::vec2(PaddleX, 0.0), glm::vec2(-1.0, 0.0));
+}
+
+void buildStaticBvh() {
+    std::vector<BvhBox> boxes;
+    const auto& colliderEntities = world.colliders.entities();
 
-    paddleLeft = std::make_shared<Paddle>(
-        std::make_shared<Body>(glm::vec2(-500.0, 0.0), 20.0f, PADDLE_HEIGHT),
-        glm::vec2(1.0, 0.0),
-        paddleLeftMesh);
-    obstacles.push_back(paddleLeft);
+    for (Entity entity : colliderEntities) {
+        if (!world.velocities.has(entity)) {
+            glm::vec2 position = world.transforms.get(entity).position;
+            glm::vec2 halfExtents = world.aabbs.get(entity).halfExtents;
+            boxes.push_back({position - halfExtents, position + halfExtents});
+            staticEntities.push_back(entity);
+        }
+    }
 
-    auto paddleRightMesh = buildQuadMesh(20.0, 50.0, orthoEffect);
-    paddleRightMesh->texture = whiteTexture;
-    paddleRightMesh->transform = createTranslation(glm::vec2(500.0, 0.0));
-    renderer->addMesh(paddleRightMesh);
+    staticBvh.build(boxes);
+}
 
-    paddleRight = std::make_shared<Paddle>(
-        std::make_shared<Body>(glm::vec2(500.0, 0.0), 20.0f, 50.0f),
-        glm::vec2(-1.0, 0.0),
-        paddleRightMesh);
-    obstacles.push_back(paddleRight);
+// Creates everything the simulation needs, which is all a replay uses
+void setupWorld() {
+    MemoryTagScope memoryTag(MemoryTag::Simulation);
+    randomizer = Randomizer(seed);
+    createWalls();
+    createBalls();
+    createPaddles();
+    buildStaticBvh();
 }
 
 void setupGame() {
@@ -180,158 +288,760 @@ void setupGame() {
     renderer->addEffect(orthoEffect);
 
     createWhiteTexture();
-    createWalls();
-    createBall();
-    createPaddles();
+    setupWorld();
 
     gui = std::make_shared<Gui>(renderer, orthoEffect);
 
     renderer->prepare();
 }
 
-bool overlaps(std::shared_ptr<Body> bodyA, std::shared_ptr<Body> bodyB) {
-    glm::vec2 t0 = bodyA->position;
-    glm::vec2 aabbMin0 = t0 - glm::vec2(bodyA->width*0.5, bodyA->height*0.5);
-    glm::vec2 aabbMax0 = t0 + glm::vec2(bodyA->width*0.5, bodyA->height*0.5);
+bool overlaps(
+    const Transform& transformA,
+    const Aabb& aabbA,
+    const Transform& transformB,
+    const Aabb& aabbB) {
 
-    glm::vec2 t1 = bodyB->position;
-    glm::vec2 aabbMin1 = t1 - glm::vec2(bodyB->width*0.5, bodyB->height*0.5);
-    glm::vec2 aabbMax1 = t1 + glm::vec2(bodyB->width*0.5, bodyB->height*0.5);
+    glm::vec2 aabbMin0 = transformA.position - aabbA.halfExtents;
+    glm::vec2 aabbMax0 = transformA.position + aabbA.halfExtents;
+
+    glm::vec2 aabbMin1 = transformB.position - aabbB.halfExtents;
+    glm::vec2 aabbMax1 = transformB.position + aabbB.halfExtents;
 
     return (aabbMin0.x <= aabbMax1.x && aabbMax0.x >= aabbMin1.x) &&
         (aabbMin0.y <= aabbMax1.y && aabbMax0.y >= aabbMin1.y);
 }
 
-void updateBall(double frameTime) {
+void bounceOffObstacle(
+    Transform& ballTransform,
+    Velocity& ballVelocity,
+    const Collider& collider,
+    const Transform& obstacleTransform) {
+
+    if (collider.paddle) {
+        bounceBallOffPaddle(ballTransform.position, ballVelocity.value, collider.normal, obstacleTransform.position.y);
+    } else {
+        bounceBall(ballTransform.position, ballVelocity.value, collider.normal);
+    }
+}
+
+// Exchanges the velocity components along the line between the centers, as for an
+// elastic collision between equal masses. Speeds are then reset so balls never stall.
+void bounceOffBall(
+    Transform& transformA,
+    Velocity& velocityA,
+    Transform& transformB,
+    Velocity& velocityB) {
+
+    glm::vec2 offset = transformB.position - transformA.position;
+    float distance = glm::length(offset);
+    glm::vec2 normal = distance > 0.0f ? offset / distance : glm::vec2(1.0, 0.0);
+
+    float approach = glm::dot(velocityA.value - velocityB.value, normal);
+    if (approach <= 0.0f) {
+        return;
+    }
+
+    velocityA.value -= normal * approach;
+    velocityB.value += normal * approach;
+
+    for (Velocity* velocity : {&velocityA, &velocityB}) {
+        float speed = glm::length(velocity->value);
+        velocity->value = speed > 0.0f ? velocity->value * (BallSpeed / speed) : -normal * BallSpeed;
+    }
+}
+
+void collideBalls(const ArenaVector<glm::vec2>& ballPositions) {
+    const auto& ballEntities = world.balls.entities();
+    glm::vec2 reach = glm::vec2(BallSize);
+
+    for (std::uint32_t i = 0; i < ballEntities.size(); i++) {
+        ballGrid.query(ballPositions[i] - reach, ballPositions[i] + reach, [&](std::uint32_t j) {
+            if (j <= i) {
+                return;
+            }
 
-    for (auto obstacle : obstacles) {
-        if (overlaps(ball->body, obstacle->body)) {
-            ball->body->position += (obstacle->normal * SURFACE_DISTANCE);
-            auto normal = obstacle->normal;
-            if (obstacle == paddleLeft || obstacle == paddleRight) {
-                float diffY = ball->body->position.y - obstacle->body->position.y;
-                float pctY = diffY / (PADDLE_HEIGHT * 0.5);
-                normal = glm::normalize(glm::vec2(obstacle->normal.x, pctY * 0.1));
+            Entity ballA = ballEntities[i];
+            Entity ballB = ballEntities[j];
+            Transform& transformA = world.transforms.get(ballA);
+            Transform& transformB = world.transforms.get(ballB);
+
+            if (overlaps(transformA, world.aabbs.get(ballA), transformB, world.aabbs.get(ballB))) {
+                bounceOffBall(
+                    transformA,
+                    world.velocities.get(ballA),
+                    transformB,
+                    world.velocities.get(ballB));
             }
-            ball->direction = glm::reflect(ball->direction, normal);
+        });
+    }
+}
+
+// Runs the narrow phase on candidate pairs from the sweep and prune broadphase
+void collideObstacles() {
+    for (std::size_t proxy = 0; proxy < broadphaseEntities.size(); proxy++) {
+        Entity entity = broadphaseEntities[proxy];
+        glm::vec2 position = world.transforms.get(entity).position;
+        glm::vec2 halfExtents = world.aabbs.get(entity).halfExtents;
+        broadphase.update(proxy, position - halfExtents, position + halfExtents);
+    }
+
+    ArenaVector<std::pair<std::uint32_t, std::uint32_t>> broadphasePairs {
+        ArenaAllocator<std::pair<std::uint32_t, std::uint32_t>>(frameArena)};
+    broadphasePairs.reserve(broadphaseEntities.size());
+    broadphase.findPairs(broadphasePairs);
+
+    // The broadphase reports pairs in an order that depends on how its endpoints were sorted
+    // before, so a game restored from a keyframe would see ties the other way around
+    std::sort(broadphasePairs.begin(), broadphasePairs.end(), [](const auto& a, const auto& b) {
+        return a.second < b.second || (a.second == b.second && a.first < b.first);
+    });
+
+    for (const auto& pair : broadphasePairs) {
+        Entity obstacle = broadphaseEntities[pair.first];
+        Entity ballEntity = broadphaseEntities[pair.second];
+
+        Transform& ballTransform = world.transforms.get(ballEntity);
+        const Transform& obstacleTransform = world.transforms.get(obstacle);
+
+        if (overlaps(ballTransform, world.aabbs.get(ballEntity), obstacleTransform, world.aabbs.get(obstacle))) {
+            bounceOffObstacle(
+                ballTransform,
+                world.velocities.get(ballEntity),
+                world.colliders.get(obstacle),
+                obstacleTransform);
         }
     }
+}
+
+// Bounces balls off each other using the grid, and off colliders using the sweep and prune
+void updateBalls() {
+    const auto& ballEntities = world.balls.entities();
+    ArenaScope scratch(frameArena);
+
+    ArenaVector<glm::vec2> ballPositions(ballEntities.size(), ArenaAllocator<glm::vec2>(frameArena));
+    for (std::size_t i = 0; i < ballEntities.size(); i++) {
+        ballPositions[i] = world.transforms.get(ballEntities[i]).position;
+    }
+    ballGrid.build(ballPositions.data(), ballPositions.size());
+
+    collideBalls(ballPositions);
+    collideObstacles();
+}
+
+// A won game starts over at once, as the score is all there is to a game
+void updateScore() {
+    for (Entity ballEntity : world.balls.entities()) {
+        Transform& ballTransform = world.transforms.get(ballEntity);
+        MatchEvent event = ballScored(ballTransform.position);
+
+        if (event != MatchEvent::None) {
+            event == MatchEvent::LeftScored ? pointsLeft++ : pointsRight++;
+
+            if (gameWon(pointsLeft, pointsRight, GamePoints)) {
+                pointsLeft = 0;
+                pointsRight = 0;
+            }
 
-    ball->body->position += (ball->direction * BALL_SPEED * static_cast<float>(frameTime));
-    bool missedLeft = ball->body->position.x < -LIMIT_X;
-    bool missedRight = ball->body->position.x > LIMIT_X;
-    
-    if (missedLeft || missedRight) {
-        missedLeft ? pointsRight++ : pointsLeft++;
+            ballTransform.position = spawnPosition();
+            world.velocities.get(ballEntity).value = randomizer.randomDirection() * BallSpeed;
+        }
+    }
+}
 
-        if (pointsLeft > 9 || pointsRight > 9) {
-            pointsLeft = 0;
-            pointsRight = 0;
+// Integrates every body with a velocity. Balls are swept against the static colliders
+// and stopped where they touch, so long frames cannot carry them through a wall.
+// The bounce then happens on the next tick as for any other contact.
+void updateMovement(double frameTime) {
+    auto& velocities = world.velocities.components();
+    const auto& entities = world.velocities.entities();
+
+    for (std::size_t i = 0; i < velocities.size(); i++) {
+        Transform& transform = world.transforms.get(entities[i]);
+        glm::vec2 displacement = velocities[i].value * static_cast<float>(frameTime);
+
+        if (world.balls.has(entities[i])) {
+            BvhHit hit;
+            if (staticBvh.sweep(world.aabbs.get(entities[i]).halfExtents, transform.position, displacement, hit)) {
+                displacement *= hit.t;
+            }
         }
 
-        ball->body->position = glm::vec2();
-        ball->direction = randomizer.randomDirection();
+        transform.position += displacement;
+    }
+}
+
+void updatePaddle(Entity paddle, float velocityY) {
+    world.velocities.get(paddle).value = glm::vec2(0.0, velocityY);
+}
+
+// Keeps paddles within the playing field after they have moved
+void constrainPaddles() {
+    for (Entity paddle : {paddleLeft, paddleRight}) {
+        glm::vec2& position = world.transforms.get(paddle).position;
+        position.y = constrainPaddleY(position.y);
     }
+}
+
+// Copies positions of renderable entities to their meshes
+void updateRenderables() {
+    const auto& renderables = world.renderables.components();
+    const auto& entities = world.renderables.entities();
 
-    ball->mesh->transform = createTranslation(ball->body->position);
+    for (std::size_t i = 0; i < renderables.size(); i++) {
+        renderables[i].mesh->transform = createTranslation(world.transforms.get(entities[i]).position);
+    }
 }
 
-void updatePaddle(std::shared_ptr<Paddle> paddle, glm::vec2 velocity) {
-    glm::vec2 newPosition = paddle->body->position + velocity;
-    glm::vec2 cappedPosition = glm::vec2(
-        newPosition.x,
-        std::min(LIMIT_Y, std::max(-LIMIT_Y, newPosition.y)));
-    paddle->body->position = cappedPosition;
-    paddle->mesh->transform = createTranslation(cappedPosition);
+// Describes the field as seen from the right paddle, which is also the mirrored view of the left
+PaddleField paddleField() {
+    glm::vec2 ballHalfExtents = world.aabbs.get(ball).halfExtents;
+
+    PaddleField field;
+    field.paddleX = world.transforms.get(paddleRight).position.x;
+    field.paddleFaceX = field.paddleX - world.aabbs.get(paddleRight).halfExtents.x - ballHalfExtents.x;
+    field.ballMinY = world.transforms.get(bottomWall).position.y +
+        world.aabbs.get(bottomWall).halfExtents.y + ballHalfExtents.y;
+    field.ballMaxY = world.transforms.get(topWall).position.y -
+        world.aabbs.get(topWall).halfExtents.y - ballHalfExtents.y;
+    return field;
 }
 
-void updateLeftPaddle(double frameTime) {
-    float velocityY = 0.0;
-    if (movingUp) {
-        velocityY += PADDLE_SPEED * frameTime;
+std::shared_ptr<PaddleController> selectController(const std::string& name) {
+    if (name == "human") {
+        return keyboard;
     }
-    if (movingDown) {
-        velocityY -= PADDLE_SPEED * frameTime;
+
+    const std::string mlpPrefix = "mlp:";
+    std::shared_ptr<PaddleController> controller;
+    if (name.compare(0, mlpPrefix.size(), mlpPrefix) == 0) {
+        controller = MlpPolicy::load(name.substr(mlpPrefix.size()));
+    } else {
+        controller = createPaddleController(name, paddleField());
     }
 
-    updatePaddle(paddleLeft, glm::vec2(0.0, velocityY));
+    if (!controller) {
+        std::cerr << "Unknown controller " << name << ", using predictive" << std::endl;
+        controller = createPaddleController("predictive", paddleField());
+    }
+    return controller;
 }
 
-bool ballIsInSight() {
-    return std::abs(ball->body->position.x - paddleRight->body->position.x) < SIGHT_DISTANCE;
+PaddleObservation observe(Entity paddle, Entity opponent) {
+    float mirror = world.transforms.get(paddle).position.x < 0.0 ? -1.0 : 1.0;
+
+    PaddleObservation observation;
+    observation.ballPosition = world.transforms.get(ball).position;
+    observation.ballVelocity = world.velocities.get(ball).value;
+    observation.ballPosition.x *= mirror;
+    observation.ballVelocity.x *= mirror;
+    observation.paddleY = world.transforms.get(paddle).position.y;
+    observation.opponentY = world.transforms.get(opponent).position.y;
+    return observation;
 }
 
-void updateRightPaddle(double frameTime) {
+// Advances the simulation by one tick. Actions are paddle velocities as a fraction of full
+// speed, decided by the controllers before the tick or read from a replay.
+void simulateTick(float leftAction, float rightAction, double tickTime) {
+    MemoryTagScope memoryTag(MemoryTag::Simulation);
+    updateBalls();
+    updatePaddle(paddleLeft, paddleVelocity(leftAction));
+    updatePaddle(paddleRight, paddleVelocity(rightAction));
+    updateMovement(tickTime);
+    constrainPaddles();
+    updateScore();
+    tick++;
+}
 
-    float velocityY = 0.0;
+// Hashes everything that moves or counts, so a replay can tell if it went the same way
+std::uint64_t simulationChecksum() {
+    std::uint64_t hash = 14695981039346656037ull;
+    const auto& transforms = world.transforms.components();
+    const auto& velocities = world.velocities.components();
+    hash = hashBytes(hash, transforms.data(), transforms.size() * sizeof(Transform));
+    hash = hashBytes(hash, velocities.data(), velocities.size() * sizeof(Velocity));
+    hash = hashBytes(hash, &pointsLeft, sizeof(pointsLeft));
+    hash = hashBytes(hash, &pointsRight, sizeof(pointsRight));
+    return hash;
+}
 
-    switch (paddleAiState) {
+// Copies the whole simulation into a snapshot. Entities are never created or destroyed once
+// the game runs, so the dense component arrays are copied as they are.
+void saveSnapshot(GameSnapshot& snapshot) {
+    MemoryTagScope memoryTag(MemoryTag::Simulation);
+    const auto& transforms = world.transforms.components();
+    const auto& velocities = world.velocities.components();
+
+    GameSnapshotHeader& header = snapshot.reset(transforms.size(), velocities.size());
+    header.tick = tick;
+    header.pointsLeft = pointsLeft;
+    header.pointsRight = pointsRight;
+    header.randomState = randomizer.getState();
+    if (leftController) {
+        header.controllers[0] = leftController->saveState();
+    }
+    if (rightController) {
+        header.controllers[1] = rightController->saveState();
+    }
 
-        case PaddleAiState::Idle :
-            if (ballIsInSight() && ball->direction.x > 0.0) {
-                paddleAiState = PaddleAiState::CatchingBall;
-            }
-            break;
+    std::memcpy(snapshot.transforms(), transforms.data(), transforms.size() * sizeof(Transform));
+    std::memcpy(snapshot.velocities(), velocities.data(), velocities.size() * sizeof(Velocity));
+}
 
-        case PaddleAiState::CatchingBall :
-            if (ballIsInSight() && ball->direction.x > 0.0) {
-                if (ball->body->position.y - paddleRight->body->position.y > BALL_PADDLE_DIFF_Y) {
-                    velocityY = PADDLE_SPEED * frameTime;
-                } else if (ball->body->position.y - paddleRight->body->position.y < -BALL_PADDLE_DIFF_Y) {
-                    velocityY = -PADDLE_SPEED * frameTime;
-                }
+// Returns false, changing nothing, if the snapshot was taken of a game with other bodies
+bool restoreSnapshot(const GameSnapshot& snapshot) {
+    auto& transforms = world.transforms.components();
+    auto& velocities = world.velocities.components();
 
-            } else {
-                paddleAiState = PaddleAiState::GoingToIdle;
-            }
-            break;
+    const GameSnapshotHeader& header = snapshot.getHeader();
+    if (header.transformCount != transforms.size() || header.velocityCount != velocities.size()) {
+        return false;
+    }
 
-        case PaddleAiState::GoingToIdle :
-            if (paddleRight->body->position.y > DISTANCE_TO_IDLE_Y) {
-                velocityY = -PADDLE_SPEED * frameTime;
+    tick = header.tick;
+    pointsLeft = header.pointsLeft;
+    pointsRight = header.pointsRight;
+    randomizer.setState(header.randomState);
+    if (leftController) {
+        leftController->restoreState(header.controllers[0]);
+    }
+    if (rightController) {
+        rightController->restoreState(header.controllers[1]);
+    }
 
-            } else if (paddleRight->body->position.y < -DISTANCE_TO_IDLE_Y) {
-                velocityY = PADDLE_SPEED * frameTime;
+    std::memcpy(transforms.data(), snapshot.transforms(), transforms.size() * sizeof(Transform));
+    std::memcpy(velocities.data(), snapshot.velocities(), velocities.size() * sizeof(Velocity));
+    return true;
+}
 
-            } else {
-                paddleAiState = PaddleAiState::Idle;
-            }
-            break;
+// The game as a rollback session sees it
+struct NetworkGame {
+    using State = GameSnapshot;
+
+    void saveState(State& state) {
+        saveSnapshot(state);
+    }
+
+    void loadState(const State& state) {
+        restoreSnapshot(state);
+    }
+
+    void advance(float leftAction, float rightAction) {
+        simulateTick(leftAction, rightAction, TICK_TIME);
+    }
+
+    std::uint64_t checksum() {
+        return simulationChecksum();
+    }
+};
+
+// Network play is enabled with --port and --peer. The keyboard plays the side given with
+// --side and the peer plays the other, the link shim can make the network worse.
+NetworkGame networkGame;
+std::shared_ptr<RollbackSession<NetworkGame>> session;
+UdpSocket networkSocket;
+std::shared_ptr<LinkShim> linkShim;
+sockaddr_in peerAddress;
+std::vector<std::uint8_t> networkPacket;
+auto networkStart = std::chrono::steady_clock::now();
+bool networkFailed = false;
+
+// Both peers have to build the same world, the session checks they do before it starts
+std::uint64_t networkConfiguration() {
+    std::uint64_t hash = hashBytes(14695981039346656037ull, &seed, sizeof(seed));
+    return hashBytes(hash, &ballCount, sizeof(ballCount));
+}
+
+// Rollback per frame, summed up and printed once a second
+struct NetworkReport {
+    std::uint32_t frames = 0;
+    std::uint32_t rollbackFrames = 0;
+    std::uint32_t maxDepth = 0;
+    double resimulationTime = 0.0;
+    double maxResimulationTime = 0.0;
+    std::uint32_t stalls = 0;
+};
+
+NetworkReport networkReport;
+
+void updateNetworkPlay() {
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - networkStart).count();
+
+    std::uint8_t buffer[512];
+    sockaddr_in from;
+    while (std::size_t size = networkSocket.receive(buffer, sizeof(buffer), from)) {
+        session->receive(buffer, size);
+    }
+
+    if (session->hasMismatchedStart()) {
+        std::cerr << "The peer plays with another --seed or --balls" << std::endl;
+        networkFailed = true;
+        return;
+    }
+    if (session->hasDesynced()) {
+        std::cerr << "The game went different ways on the two peers after tick " << session->getDesyncTick() << std::endl;
+        networkFailed = true;
+        return;
+    }
 
-        default:
+    std::uint32_t frameDepth = 0;
+    double frameResimulationTime = 0.0;
+    while (tickAccumulator >= TICK_TIME) {
+        // Waiting for the peer slows this side down to its pace
+        if (!session->canAdvance()) {
+            session->synchronize();
+            tickAccumulator = 0.0;
+            networkReport.stalls++;
             break;
+        }
+
+        session->advance(static_cast<std::int8_t>(keyboard->act(PaddleObservation())));
+        frameDepth += session->getStats().rollbackDepth;
+        frameResimulationTime += session->getStats().resimulationTime;
+        tickAccumulator -= TICK_TIME;
     }
 
-    updatePaddle(paddleRight, glm::vec2(0.0, velocityY));
+    session->writePacket(networkPacket);
+    linkShim->send(peerAddress, networkPacket.data(), networkPacket.size(), now);
+    linkShim->flush(now);
+
+    networkReport.frames++;
+    networkReport.rollbackFrames += frameDepth > 0;
+    networkReport.maxDepth = std::max(networkReport.maxDepth, frameDepth);
+    networkReport.resimulationTime += frameResimulationTime;
+    networkReport.maxResimulationTime = std::max(networkReport.maxResimulationTime, frameResimulationTime);
+
+    if (networkReport.frames == 60) {
+        std::printf(
+            "tick %u, confirmed %u, rollback in %u of %u frames, max depth %u, "
+            "resimulation %.3f ms average %.3f ms max per frame, %u stalls, %llu datagrams dropped\n",
+            session->getTick(),
+            session->getConfirmedTick(),
+            networkReport.rollbackFrames,
+            networkReport.frames,
+            networkReport.maxDepth,
+            networkReport.resimulationTime * 1000.0 / networkReport.frames,
+            networkReport.maxResimulationTime * 1000.0,
+            networkReport.stalls,
+            static_cast<unsigned long long>(linkShim->getDropped()));
+        networkReport = NetworkReport();
+    }
+}
+
+#if defined(__linux__)
+// Spectating is enabled with --spectate and a match index. The match comes from a
+// pong-relay and is drawn from the jitter buffer rather than simulated here.
+std::shared_ptr<SpectatorClient> spectator;
+std::shared_ptr<JitterBuffer> jitterBuffer;
+std::uint32_t spectatorFrames = 0;
+
+void updateSpectating() {
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - networkStart).count();
+
+    bool open = spectator->receive([now](std::uint32_t, const QuantizedMatch& state, std::size_t) {
+        jitterBuffer->add(state, now);
+    });
+    if (!open) {
+        std::cerr << "Lost the relay" << std::endl;
+        spectator.reset();
+        return;
+    }
+
+    RemoteMatchView view;
+    if (jitterBuffer->sample(now, view)) {
+        world.transforms.get(ball).position = view.ballPosition;
+        world.transforms.get(paddleLeft).position.y = view.leftPaddleY;
+        world.transforms.get(paddleRight).position.y = view.rightPaddleY;
+        pointsLeft = static_cast<std::uint8_t>(view.pointsLeft);
+        pointsRight = static_cast<std::uint8_t>(view.pointsRight);
+    }
+
+    if (++spectatorFrames == 60) {
+        std::printf("delay %.1f ms, target %.1f ms, jitter %.1f ms, %zu buffered, %llu underflows, %llu late\n",
+            jitterBuffer->getDelay() * 1000.0,
+            jitterBuffer->getTargetDelay() * 1000.0,
+            jitterBuffer->getJitter() * 1000.0,
+            jitterBuffer->getBuffered(),
+            static_cast<unsigned long long>(jitterBuffer->getUnderflows()),
+            static_cast<unsigned long long>(jitterBuffer->getLateSnapshots()));
+        spectatorFrames = 0;
+    }
+}
+
+bool spectating() {
+    return spectator != nullptr;
+}
+#else
+void updateSpectating() {
 }
 
+bool spectating() {
+    return false;
+}
+#endif
+
+// Runs as many ticks as real time has passed. A long stall is cut short rather than caught
+// up with, so the game does not spiral when it falls behind.
 void updateGame(double frameTime) {
 
-    updateBall(frameTime);
-    updateLeftPaddle(frameTime);
-    updateRightPaddle(frameTime);
+    frameArena.reset();
+    renderer->beginFrame();
+
+    tickAccumulator += std::min(frameTime, MAX_FRAME_TIME);
+    while (!session && !spectating() && tickAccumulator >= TICK_TIME) {
+        float leftAction = leftController->act(observe(paddleLeft, paddleRight));
+        float rightAction = rightController->act(observe(paddleRight, paddleLeft));
+        if (recorder) {
+            if (tick % KEYFRAME_INTERVAL == 0) {
+                saveSnapshot(replaySnapshot);
+                recorder->addKeyframe(tick, replaySnapshot.data(), replaySnapshot.size());
+            }
+            recorder->record(tick, leftAction, rightAction);
+        }
+
+        simulateTick(leftAction, rightAction, TICK_TIME);
+        tickAccumulator -= TICK_TIME;
+    }
+
+    if (session) {
+        updateNetworkPlay();
+    }
+
+    if (spectating()) {
+        updateSpectating();
+    }
+
+    updateRenderables();
 
     gui->update(pointsLeft, pointsRight);
 
-    renderer->render();
+    renderer->render(frameTime);
+}
+
+// Simulates a recorded game again as fast as possible, without a window. Given a tick to
+// seek to, it first jumps there from the nearest keyframe and then plays on to the end.
+int playReplay(const std::string& path, std::int64_t seekTick) {
+    ReplayPlayer player;
+    if (!player.load(path)) {
+        std::cerr << "Could not read replay " << path << std::endl;
+        return 1;
+    }
+
+    const ReplayHeader& header = player.getHeader();
+    seed = header.seed;
+    ballCount = header.ballCount;
+    setupWorld();
+
+    if (seekTick >= 0) {
+        auto seekStart = std::chrono::high_resolution_clock::now();
+        std::uint32_t target = static_cast<std::uint32_t>(std::min<std::int64_t>(seekTick, player.getTickCount()));
+        const ReplayKeyframe* keyframe = player.seek(target);
+        if (keyframe && !(replaySnapshot.assign(player.keyframeState(*keyframe), keyframe->stateSize) &&
+            restoreSnapshot(replaySnapshot))) {
+            std::cerr << "Keyframe at tick " << keyframe->tick << " does not fit this game" << std::endl;
+            return 1;
+        }
+
+        while (tick < target) {
+            float leftAction;
+            float rightAction;
+            player.actionsAt(tick, leftAction, rightAction);
+            simulateTick(leftAction, rightAction, header.tickTime);
+        }
+        std::chrono::duration<double, std::milli> seekTime = std::chrono::high_resolution_clock::now() - seekStart;
+
+        std::cout << "Seeked to tick " << tick << " from the keyframe at tick " << (keyframe ? keyframe->tick : 0)
+            << " in " << seekTime.count() << " ms" << std::endl;
+    }
+
+    std::uint32_t startTick = tick;
+    auto start = std::chrono::high_resolution_clock::now();
+    while (tick < player.getTickCount()) {
+        float leftAction;
+        float rightAction;
+        player.actionsAt(tick, leftAction, rightAction);
+        simulateTick(leftAction, rightAction, header.tickTime);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    bool identical = simulationChecksum() == player.getChecksum();
+    std::uint32_t replayedTicks = tick - startTick;
+    std::cout << "Replayed " << replayedTicks << " ticks (" << replayedTicks * header.tickTime << " s of play) in "
+        << elapsed.count() << " ms, score " << static_cast<int>(pointsLeft) << " - "
+        << static_cast<int>(pointsRight) << ", " << (identical ? "identical" : "DIVERGED") << std::endl;
+
+    return identical ? 0 : 1;
 }
 
-int main() {
+void printUsage() {
+    std::printf("Usage: pong-app [--balls N] [--left CONTROLLER] [--right CONTROLLER] [--seed N]\n");
+    std::printf("    [--record PATH] [--replay PATH] [--seek TICK]\n");
+    std::printf("    [--port N] [--peer N] [--peer-host ADDRESS] [--side left|right] [--latency MS] [--jitter MS] [--loss PERCENT]\n");
+    std::printf("    [--spectate MATCH] [--relay-host ADDRESS] [--relay-port N] [--server-rate N] [--memory-report PATH]\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    std::string leftName = "human";
+    std::string rightName = "predictive";
+    std::string recordPath;
+    std::string replayPath;
+    std::int64_t seekTick = -1;
+    std::int32_t port = -1;
+    std::int32_t peerPort = -1;
+    std::string peerHost = "127.0.0.1";
+    PaddleSide side = PaddleSide::Left;
+    LinkConditions conditions;
+    std::int64_t spectateMatch = -1;
+    std::string relayHost = "127.0.0.1";
+    std::uint32_t relayPort = 7800;
+    std::uint32_t serverTickRate = MatchServerSettings().tickRate;
+    seed = static_cast<std::uint64_t>(std::time(0));
+    bool seedGiven = false;
+
+    // Unknown options, missing values and numbers that do not parse or fit end the program
+    // with its usage
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string option = argv[i];
+            if (i + 1 >= argc) {
+                printUsage();
+                return 1;
+            }
+
+            std::string value = argv[++i];
+            if (option == "--balls") {
+                ballCount = std::max(1, std::stoi(value));
+            } else if (option == "--left") {
+                leftName = value;
+            } else if (option == "--right") {
+                rightName = value;
+            } else if (option == "--seed") {
+                seed = std::stoull(value);
+                seedGiven = true;
+            } else if (option == "--record") {
+                recordPath = value;
+            } else if (option == "--replay") {
+                replayPath = value;
+            } else if (option == "--seek") {
+                seekTick = std::max<std::int64_t>(0, std::stoll(value));
+            } else if (option == "--port") {
+                port = std::stoi(value);
+            } else if (option == "--peer") {
+                peerPort = std::stoi(value);
+            } else if (option == "--peer-host") {
+                peerHost = value;
+            } else if (option == "--side" && (value == "left" || value == "right")) {
+                side = value == "right" ? PaddleSide::Right : PaddleSide::Left;
+            } else if (option == "--latency") {
+                conditions.latency = std::stod(value) / 1000.0;
+            } else if (option == "--jitter") {
+                conditions.jitter = std::stod(value) / 1000.0;
+            } else if (option == "--loss") {
+                conditions.loss = std::stof(value) / 100.0f;
+            } else if (option == "--spectate") {
+                spectateMatch = std::max<std::int64_t>(0, std::stoll(value));
+            } else if (option == "--relay-host") {
+                relayHost = value;
+            } else if (option == "--relay-port") {
+                relayPort = std::stoi(value);
+            } else if (option == "--server-rate") {
+                serverTickRate = std::max(1, std::stoi(value));
+            } else if (option == "--memory-report") {
+                memoryReportPath = value;
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+    } catch (const std::invalid_argument&) {
+        printUsage();
+        return 1;
+    } catch (const std::out_of_range&) {
+        printUsage();
+        return 1;
+    }
+
+    if (!replayPath.empty()) {
+        int result = playReplay(replayPath, seekTick);
+        saveMemoryReport();
+        return result;
+    }
+
+    if (port >= 0 && peerPort >= 0) {
+        if (!seedGiven) {
+            std::cerr << "Network play needs the same --seed on both sides" << std::endl;
+            return 1;
+        }
+
+        in_addr host;
+        if (inet_pton(AF_INET, peerHost.c_str(), &host) != 1 || !networkSocket.open(port, INADDR_ANY)) {
+            std::cerr << "Could not open port " << port << " for " << peerHost << std::endl;
+            return 1;
+        }
+
+        peerAddress = UdpSocket::makeAddress(ntohl(host.s_addr), peerPort);
+        linkShim = std::make_shared<LinkShim>(networkSocket, conditions, seed + port);
+        RollbackSettings settings;
+        settings.configuration = networkConfiguration();
+        session = std::make_shared<RollbackSession<NetworkGame>>(networkGame, side, settings);
+    }
+
+    if (spectateMatch >= 0) {
+#if defined(__linux__)
+        in_addr host;
+        spectator = std::make_shared<SpectatorClient>(serverTickRate);
+        if (inet_pton(AF_INET, relayHost.c_str(), &host) != 1 ||
+            !spectator->connect(ntohl(host.s_addr), relayPort) ||
+            !spectator->watch(static_cast<std::uint32_t>(spectateMatch))) {
+            std::cerr << "Could not reach the relay at " << relayHost << ":" << relayPort << std::endl;
+            return 1;
+        }
+        jitterBuffer = std::make_shared<JitterBuffer>(1.0 / serverTickRate);
+        ballCount = 1;
+#else
+        std::cerr << "Spectating needs the relay, which is only built on Linux" << std::endl;
+        return 1;
+#endif
+    }
 
     window = std::make_shared<Window>(WINDOW_WIDTH, WINDOW_HEIGHT);
     glfwSetKeyCallback(window->getGlfwWindow(), keyCallback);
 
     setupGame();
+    leftController = selectController(leftName);
+    rightController = selectController(rightName);
+
+    if (!recordPath.empty()) {
+        ReplayHeader header;
+        header.seed = seed;
+        header.ballCount = ballCount;
+        header.tickTime = TICK_TIME;
+        recorder = std::make_shared<ReplayRecorder>(header);
+    }
 
-    while (!window->shouldClose()) {
+    std::uint64_t frame = 0;
+    while (!window->shouldClose() && !networkFailed) {
 
         auto newTime = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> frameTime = newTime - currentTime;
         currentTime = newTime;
+
+        // A recording is exempt, its log of actions grows for as long as the game runs
+        AllocationWatch frameAllocations;
         updateGame(frameTime.count());
+        std::uint64_t allocations = frameAllocations.count();
+        if (AllocationTrackingEnabled && !recorder && ++frame > STEADY_STATE_FRAME && allocations > 0) {
+            std::cerr << "Frame " << frame << " allocated " << allocations << " times in steady state" << std::endl;
+            assert(allocations == 0);
+        }
 
         window->update();
     }
 
-    return 0;
+    if (recorder && !recorder->save(recordPath, tick, simulationChecksum())) {
+        std::cerr << "Could not write replay " << recordPath << std::endl;
+    }
+    saveMemoryReport();
+
+    return networkFailed ? 1 : 0;
 }
@@ -0,0 +1,120 @@
+#include "Relay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+std::atomic<bool> running {true};
+
+void stop(int) {
+    running.store(false);
+}
+
+void printUsage() {
+    std::printf("Usage: pong-relay [--matches N] [--shards N] [--server-host ADDRESS] [--server-port N] [--port N] [--rate N] [--seconds N]\n");
+    std::printf("Watches N matches on a pong-server and passes them on to spectators connecting to port.\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    RelaySettings settings;
+    std::uint32_t port = 7800;
+    std::uint32_t seconds = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (option == "--matches") {
+            settings.matchCount = std::max(1, std::stoi(value));
+        } else if (option == "--shards") {
+            settings.shardCount = std::max(1, std::stoi(value));
+        } else if (option == "--server-host") {
+            in_addr host;
+            if (inet_pton(AF_INET, value.c_str(), &host) != 1) {
+                printUsage();
+                return 1;
+            }
+            settings.serverHost = ntohl(host.s_addr);
+        } else if (option == "--server-port") {
+            settings.serverPort = std::stoi(value);
+        } else if (option == "--port") {
+            port = std::stoi(value);
+        } else if (option == "--rate") {
+            settings.tickRate = std::max(1, std::stoi(value));
+        } else if (option == "--seconds") {
+            seconds = std::max(0, std::stoi(value));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    raiseDescriptorLimit();
+
+    SpectatorRelay relay(settings);
+    if (!relay.open(port)) {
+        std::fprintf(stderr, "Could not open port %u\n", port);
+        return 1;
+    }
+
+    std::printf("Relaying %u matches from port %u on, spectators on port %u\n",
+        settings.matchCount,
+        settings.serverPort,
+        port);
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    std::thread thread([&relay]() {
+        relay.run(running);
+    });
+
+    // Reads the counters once a second, the relay never waits on this
+    const RelayStats& stats = relay.getStats();
+    std::uint64_t lastUpstream = 0;
+    std::uint64_t lastEncoded = 0;
+    std::uint64_t lastQueued = 0;
+    std::uint64_t lastBytes = 0;
+    std::uint64_t lastWrites = 0;
+    for (std::uint32_t second = 1; running.load() && (seconds == 0 || second <= seconds); second++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::uint64_t upstream = stats.upstreamStates.load(std::memory_order_relaxed);
+        std::uint64_t encoded = stats.encodedFrames.load(std::memory_order_relaxed);
+        std::uint64_t queued = stats.queuedFrames.load(std::memory_order_relaxed);
+        std::uint64_t bytes = stats.sentBytes.load(std::memory_order_relaxed);
+        std::uint64_t writes = stats.writes.load(std::memory_order_relaxed);
+
+        std::printf("%u s: %llu spectators, %llu states in, %llu frames encoded, %llu sent in %llu writes, %.1f MB, %llu resyncs\n",
+            second,
+            static_cast<unsigned long long>(stats.connections.load(std::memory_order_relaxed)),
+            static_cast<unsigned long long>(upstream - lastUpstream),
+            static_cast<unsigned long long>(encoded - lastEncoded),
+            static_cast<unsigned long long>(queued - lastQueued),
+            static_cast<unsigned long long>(writes - lastWrites),
+            (bytes - lastBytes) / 1000000.0,
+            static_cast<unsigned long long>(stats.resyncs.load(std::memory_order_relaxed)));
+        std::fflush(stdout);
+
+        lastUpstream = upstream;
+        lastEncoded = encoded;
+        lastQueued = queued;
+        lastBytes = bytes;
+        lastWrites = writes;
+    }
+
+    running.store(false);
+    thread.join();
+
+    return 0;
+}
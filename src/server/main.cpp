@@ -0,0 +1,133 @@
+#include "MatchServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> running {true};
+
+void stop(int) {
+    running.store(false);
+}
+
+void printUsage() {
+    std::printf("Usage: pong-server [--matches N] [--shards N] [--port N] [--rate N] [--seconds N]\n");
+    std::printf("Hosts N matches, match M on shard M %% shards listening on port + shard.\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    MatchServerSettings settings;
+    settings.shardCount = std::max(1u, std::thread::hardware_concurrency());
+    std::uint32_t basePort = 7700;
+    std::uint32_t seconds = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (option == "--matches") {
+            settings.matchCount = std::max(1, std::stoi(value));
+        } else if (option == "--shards") {
+            settings.shardCount = std::max(1, std::stoi(value));
+        } else if (option == "--port") {
+            basePort = std::stoi(value);
+        } else if (option == "--rate") {
+            settings.tickRate = std::max(1, std::stoi(value));
+        } else if (option == "--seconds") {
+            seconds = std::max(0, std::stoi(value));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<std::shared_ptr<MatchShard>> shards;
+    for (std::uint32_t shard = 0; shard < settings.shardCount; shard++) {
+        shards.push_back(std::make_shared<MatchShard>(shard, settings));
+        if (!shards.back()->open(basePort + shard)) {
+            std::fprintf(stderr, "Could not open port %u\n", basePort + shard);
+            return 1;
+        }
+    }
+
+    std::printf("%u matches on %u shards, ports %u to %u, %u ticks/s\n",
+        settings.matchCount,
+        settings.shardCount,
+        basePort,
+        basePort + settings.shardCount - 1,
+        settings.tickRate);
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    std::vector<std::thread> threads;
+    for (auto& shard : shards) {
+        MatchShard* owned = shard.get();
+        threads.emplace_back([owned]() {
+            owned->run(running);
+        });
+    }
+
+    // Reads the counters of every shard once a second, the shards never wait on this
+    std::uint64_t lastTicks = 0;
+    std::uint64_t lastReceived = 0;
+    std::uint64_t lastSent = 0;
+    std::uint64_t lastSentBytes = 0;
+    std::uint64_t lastNanoseconds = 0;
+    for (std::uint32_t second = 1; running.load() && (seconds == 0 || second <= seconds); second++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::uint64_t ticks = 0;
+        std::uint64_t received = 0;
+        std::uint64_t sent = 0;
+        std::uint64_t sentBytes = 0;
+        std::uint64_t nanoseconds = 0;
+        std::uint64_t maxNanoseconds = 0;
+        for (const auto& shard : shards) {
+            const MatchShardStats& stats = shard->getStats();
+            ticks += stats.ticks.load(std::memory_order_relaxed);
+            received += stats.received.load(std::memory_order_relaxed);
+            sent += stats.sent.load(std::memory_order_relaxed);
+            sentBytes += stats.sentBytes.load(std::memory_order_relaxed);
+            nanoseconds += stats.tickNanoseconds.load(std::memory_order_relaxed);
+            maxNanoseconds = std::max(maxNanoseconds, stats.maxTickNanoseconds.load(std::memory_order_relaxed));
+        }
+
+        std::uint64_t tickDelta = ticks - lastTicks;
+        std::uint64_t sentDelta = sent - lastSent;
+        std::printf("%u s: %llu shard ticks, %llu inputs, %llu states of %.1f bytes, tick %.1f us average %.1f us max\n",
+            second,
+            static_cast<unsigned long long>(tickDelta),
+            static_cast<unsigned long long>(received - lastReceived),
+            static_cast<unsigned long long>(sentDelta),
+            sentDelta > 0 ? static_cast<double>(sentBytes - lastSentBytes) / sentDelta : 0.0,
+            tickDelta > 0 ? (nanoseconds - lastNanoseconds) / 1000.0 / tickDelta : 0.0,
+            maxNanoseconds / 1000.0);
+        std::fflush(stdout);
+
+        lastTicks = ticks;
+        lastReceived = received;
+        lastSent = sent;
+        lastSentBytes = sentBytes;
+        lastNanoseconds = nanoseconds;
+    }
+
+    running.store(false);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return 0;
+}
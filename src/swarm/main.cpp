@@ -0,0 +1,187 @@
+#include "Relay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+void printUsage() {
+    std::printf("Usage: pong-swarm [--spectators N] [--matches N] [--host ADDRESS] [--port N] [--threads N] [--rate N] [--seconds N]\n");
+    std::printf("Connects N spectators to a pong-relay, spectator S watching match S %% matches.\n");
+}
+
+struct SwarmSettings {
+    std::uint32_t spectatorCount = 5000;
+    std::uint32_t matchCount = 1000;
+    std::uint32_t host = INADDR_LOOPBACK;
+    std::uint32_t port = 7800;
+    std::uint32_t threadCount = 1;
+    std::uint32_t tickRate = 60;
+    std::uint32_t seconds = 10;
+};
+
+struct alignas(64) SwarmStats {
+    std::atomic<std::uint64_t> connected {0};
+    std::atomic<std::uint64_t> frames {0};
+    std::atomic<std::uint64_t> bytes {0};
+    std::atomic<std::uint64_t> skippedTicks {0};
+    std::atomic<std::uint64_t> failures {0};
+};
+
+// Runs the spectators with index % threadCount == thread on one epoll set
+void watch(std::uint32_t thread, const SwarmSettings& settings, const std::atomic<bool>& running, SwarmStats& stats) {
+    int poller = ::epoll_create1(0);
+    std::vector<std::unique_ptr<SpectatorClient>> spectators;
+    std::vector<std::uint32_t> lastTicks;
+
+    for (std::uint32_t index = thread; index < settings.spectatorCount; index += settings.threadCount) {
+        auto spectator = std::make_unique<SpectatorClient>(settings.tickRate);
+        if (!spectator->connect(settings.host, settings.port) || !spectator->watch(index % settings.matchCount)) {
+            stats.failures.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = static_cast<std::uint32_t>(spectators.size());
+        ::epoll_ctl(poller, EPOLL_CTL_ADD, spectator->getDescriptor(), &event);
+        spectators.push_back(std::move(spectator));
+        lastTicks.push_back(0);
+        stats.connected.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    epoll_event events[256];
+    while (running.load(std::memory_order_relaxed)) {
+        int count = ::epoll_wait(poller, events, 256, 100);
+        std::uint64_t frames = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t skipped = 0;
+
+        for (int i = 0; i < count; i++) {
+            std::uint32_t slot = events[i].data.u32;
+            std::uint32_t& lastTick = lastTicks[slot];
+            bool open = spectators[slot]->receive([&](std::uint32_t, const QuantizedMatch& state, std::size_t size) {
+                if (lastTick > 0 && state.tick > lastTick + 1) {
+                    skipped += state.tick - lastTick - 1;
+                }
+                lastTick = state.tick;
+                frames++;
+                bytes += size;
+            });
+
+            if (!open) {
+                ::epoll_ctl(poller, EPOLL_CTL_DEL, spectators[slot]->getDescriptor(), nullptr);
+                stats.failures.fetch_add(1, std::memory_order_relaxed);
+                stats.connected.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        stats.frames.fetch_add(frames, std::memory_order_relaxed);
+        stats.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        stats.skippedTicks.fetch_add(skipped, std::memory_order_relaxed);
+    }
+
+    ::close(poller);
+}
+
+int main(int argc, char *argv[]) {
+
+    SwarmSettings settings;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (option == "--spectators") {
+            settings.spectatorCount = std::max(1, std::stoi(value));
+        } else if (option == "--matches") {
+            settings.matchCount = std::max(1, std::stoi(value));
+        } else if (option == "--host") {
+            in_addr host;
+            if (inet_pton(AF_INET, value.c_str(), &host) != 1) {
+                printUsage();
+                return 1;
+            }
+            settings.host = ntohl(host.s_addr);
+        } else if (option == "--port") {
+            settings.port = std::stoi(value);
+        } else if (option == "--threads") {
+            settings.threadCount = std::max(1, std::stoi(value));
+        } else if (option == "--rate") {
+            settings.tickRate = std::max(1, std::stoi(value));
+        } else if (option == "--seconds") {
+            settings.seconds = std::max(1, std::stoi(value));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    raiseDescriptorLimit();
+
+    std::printf("%u spectators of %u matches on %u threads\n",
+        settings.spectatorCount,
+        settings.matchCount,
+        settings.threadCount);
+
+    std::atomic<bool> running {true};
+    std::vector<std::shared_ptr<SwarmStats>> stats;
+    std::vector<std::thread> threads;
+    for (std::uint32_t thread = 0; thread < settings.threadCount; thread++) {
+        stats.push_back(std::make_shared<SwarmStats>());
+        SwarmStats* threadStats = stats.back().get();
+        threads.emplace_back([thread, &settings, &running, threadStats]() {
+            watch(thread, settings, running, *threadStats);
+        });
+    }
+
+    std::uint64_t lastFrames = 0;
+    std::uint64_t lastBytes = 0;
+    std::uint64_t lastSkipped = 0;
+    for (std::uint32_t second = 1; second <= settings.seconds; second++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::uint64_t connected = 0;
+        std::uint64_t frames = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t skipped = 0;
+        std::uint64_t failures = 0;
+        for (const auto& threadStats : stats) {
+            connected += threadStats->connected.load(std::memory_order_relaxed);
+            frames += threadStats->frames.load(std::memory_order_relaxed);
+            bytes += threadStats->bytes.load(std::memory_order_relaxed);
+            skipped += threadStats->skippedTicks.load(std::memory_order_relaxed);
+            failures += threadStats->failures.load(std::memory_order_relaxed);
+        }
+
+        std::uint64_t frameDelta = frames - lastFrames;
+        std::printf("%u s: %llu connected, %llu frames of %.1f bytes, %llu match ticks missed, %llu failures\n",
+            second,
+            static_cast<unsigned long long>(connected),
+            static_cast<unsigned long long>(frameDelta),
+            frameDelta > 0 ? static_cast<double>(bytes - lastBytes) / frameDelta : 0.0,
+            static_cast<unsigned long long>(skipped - lastSkipped),
+            static_cast<unsigned long long>(failures));
+        std::fflush(stdout);
+
+        lastFrames = frames;
+        lastBytes = bytes;
+        lastSkipped = skipped;
+    }
+
+    running.store(false);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return 0;
+}
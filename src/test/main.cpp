@@ -1,23 +1,103 @@
+#include "AllocationTracking.h"
+#include "Bvh.h"
 #include "Effect.h"
+#include "FrameArena.h"
+#include "GeometryRegistry.h"
+#include "GlObject.h"
+#include "JitterBuffer.h"
+#include "Match.h"
+#include "MatchServer.h"
+#include "MemoryTracker.h"
 #include "Mesh.h"
+#include "Network.h"
+#include "MlpPolicy.h"
+#include "ObjectPool.h"
+#include "PaddleController.h"
+#include "Randomizer.h"
+#if defined(__linux__)
+#include "Relay.h"
+#endif
+#include "Replay.h"
+#include "Rollback.h"
+#include "Snapshot.h"
+#include "SnapshotDelta.h"
+#include "SpatialGrid.h"
+#include "StreamBuffer.h"
+#include "SweepAndPrune.h"
+#include "Tournament.h"
+#include "Trajectory.h"
+#include "VectorEnv.h"
+#include "WorkStealingPool.h"
+#include "World.h"
 
 #include "TestReporterStdout.h"
 #include "TestRunner.h"
 #include "UnitTest++.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct MatchRollbackGame {
+    using State = MatchState;
+
+    void saveState(State& state) {
+        state = match;
+    }
+
+    void loadState(const State& state) {
+        match = state;
+    }
+
+    void advance(float leftAction, float rightAction) {
+        stepMatch(match, leftAction, rightAction, 1.0 / 60.0);
+    }
+
+    // Everything up to the randomizer, which has no padding, and then its state
+    std::uint64_t checksum() {
+        std::uint64_t randomState = match.random.getState();
+        std::uint64_t hash = hashBytes(14695981039346656037ull, &match, offsetof(MatchState, random));
+        return hashBytes(hash, &randomState, sizeof(randomState));
+    }
+
+    MatchState match;
+};
+
+struct CountingTraits {
+    static std::uint32_t create() {
+        return ++created;
+    }
+
+    static void destroy(std::uint32_t) {
+        destroyed++;
+    }
+
+    static std::uint32_t created;
+    static std::uint32_t destroyed;
+};
+
+std::uint32_t CountingTraits::created = 0;
+std::uint32_t CountingTraits::destroyed = 0;
 
 SUITE(PONG) {
 
     TEST(MeshQuadBuiltCorrectly) {
-        auto mesh = buildQuadMesh(10, 10, buildOrthoEffect());
-        CHECK_EQUAL(6, mesh->indexCount);
+        auto mesh = buildQuadMesh(10, 10, buildOrthoEffect(), standardVertexLayout());
+        auto geometry = mesh->geometry;
+        CHECK_EQUAL(6, geometry->indexCount);
 
         std::uint32_t expectedIndices[] = {
             0, 1, 3,
             1, 2, 3
         };
-        CHECK_ARRAY_EQUAL(expectedIndices, mesh->indices, 6);
+        CHECK_ARRAY_EQUAL(expectedIndices, geometry->indices, 6);
 
         float expectedVertices[] = {
             5, 5, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,
@@ -25,8 +105,1114 @@ SUITE(PONG) {
             -5, -5, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
             -5,  5, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f
         };
-        CHECK_ARRAY_EQUAL(expectedVertices, mesh->vertices, 32);
-        CHECK_EQUAL(128, mesh->verticesTotalSize);
+        auto vertices = reinterpret_cast<const float*>(geometry->vertexData.data());
+        CHECK_ARRAY_EQUAL(expectedVertices, vertices, 32);
+        CHECK_EQUAL(128, geometry->verticesTotalSize);
+    }
+
+    TEST(CompactQuadPacksPositionsAndQuantizedTexCoords) {
+        auto geometry = buildQuadGeometry(10, 10, compactVertexLayout());
+        CHECK_EQUAL(12u, geometry->layout.stride);
+        CHECK_EQUAL(48u, geometry->verticesTotalSize);
+        CHECK(geometry->layout.find(ColorLocation) == nullptr);
+
+        struct CompactVertex {
+            float x;
+            float y;
+            std::uint16_t u;
+            std::uint16_t v;
+        };
+        auto vertices = reinterpret_cast<const CompactVertex*>(geometry->vertexData.data());
+
+        CHECK_EQUAL(5.0f, vertices[1].x);
+        CHECK_EQUAL(-5.0f, vertices[1].y);
+        CHECK_EQUAL(65535, vertices[1].u);
+        CHECK_EQUAL(0, vertices[1].v);
+    }
+
+    TEST(GeometryRegistrySharesIdenticalShapes) {
+        GeometryRegistry registry;
+
+        auto paddle = registry.intern(buildQuadGeometry(20, 50));
+        auto otherPaddle = registry.intern(buildQuadGeometry(20, 50));
+        auto ball = registry.intern(buildQuadGeometry(10, 10));
+        CHECK(paddle == otherPaddle);
+        CHECK(paddle != ball);
+        CHECK_EQUAL(2u, registry.size());
+
+        auto dynamic = buildQuadGeometry(20, 50);
+        dynamic->dynamic = true;
+        CHECK(registry.intern(dynamic) == dynamic);
+
+        ball.reset();
+        CHECK_EQUAL(1u, registry.size());
+
+        // Once uploaded and discarded, a shape is rebuilt to compare it rather than trusted by hash
+        paddle->vertexData.clear();
+        paddle->indices.clear();
+        CHECK(registry.intern(buildQuadGeometry(20, 50)) == paddle);
+        paddle->rebuild = nullptr;
+        CHECK(registry.intern(buildQuadGeometry(20, 50)) != paddle);
+    }
+
+    TEST(GlObjectDeletesOwnedNameOnce) {
+        {
+            GlObject<CountingTraits> empty;
+            GlObject<CountingTraits> first = GlObject<CountingTraits>::create();
+            GlObject<CountingTraits> second = std::move(first);
+            CHECK(!first);
+            CHECK_EQUAL(1u, second.get());
+
+            second = GlObject<CountingTraits>::create();
+            CHECK_EQUAL(1u, CountingTraits::destroyed);
+        }
+        CHECK_EQUAL(2u, CountingTraits::destroyed);
+    }
+
+    TEST(WorldKeepsComponentsDenseAcrossRemoval) {
+        World world;
+        Entity first = world.create();
+        Entity second = world.create();
+        Entity third = world.create();
+
+        world.transforms.add(first, {glm::vec2(1.0, 0.0)});
+        world.transforms.add(second, {glm::vec2(2.0, 0.0)});
+        world.transforms.add(third, {glm::vec2(3.0, 0.0)});
+
+        world.destroy(first);
+        CHECK(!world.alive(first));
+        CHECK(!world.transforms.has(first));
+        CHECK_EQUAL(2u, world.transforms.size());
+        CHECK_EQUAL(3.0f, world.transforms.get(third).position.x);
+        CHECK(world.transforms.entities()[0] == third);
+
+        Entity reused = world.create();
+        CHECK_EQUAL(first.index, reused.index);
+        CHECK(reused != first);
+        CHECK(!world.transforms.has(reused));
+    }
+
+    TEST(SpatialGridFindsItemsInOverlappingCells) {
+        SpatialGrid grid(glm::vec2(0.0, 0.0), glm::vec2(100.0, 100.0), 10.0);
+        glm::vec2 positions[] = {
+            glm::vec2(5.0, 5.0),
+            glm::vec2(95.0, 95.0),
+            glm::vec2(12.0, 8.0),
+            glm::vec2(-50.0, 500.0)
+        };
+        grid.build(positions, 4);
+
+        std::vector<std::uint32_t> found;
+        grid.query(glm::vec2(0.0, 0.0), glm::vec2(15.0, 9.0), [&](std::uint32_t item) {
+            found.push_back(item);
+        });
+        std::sort(found.begin(), found.end());
+        CHECK_EQUAL(2u, found.size());
+        CHECK_EQUAL(0u, found[0]);
+        CHECK_EQUAL(2u, found[1]);
+
+        found.clear();
+        grid.query(glm::vec2(0.0, 90.0), glm::vec2(5.0, 100.0), [&](std::uint32_t item) {
+            found.push_back(item);
+        });
+        CHECK_EQUAL(1u, found.size());
+        CHECK_EQUAL(3u, found[0]);
+    }
+
+    TEST(SweepAndPrunePairsOnlyAcrossGroups) {
+        SweepAndPrune broadphase;
+        std::uint32_t wall = broadphase.add(glm::vec2(0.0, 0.0), glm::vec2(100.0, 10.0), 0);
+        broadphase.add(glm::vec2(50.0, 0.0), glm::vec2(60.0, 10.0), 0);
+        std::uint32_t ball = broadphase.add(glm::vec2(200.0, 0.0), glm::vec2(210.0, 10.0), 1);
+
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+        broadphase.findPairs(pairs);
+        CHECK_EQUAL(0u, pairs.size());
+
+        broadphase.update(ball, glm::vec2(10.0, 10.0), glm::vec2(20.0, 20.0));
+        broadphase.findPairs(pairs);
+        CHECK_EQUAL(1u, pairs.size());
+        CHECK_EQUAL(wall, pairs[0].first);
+        CHECK_EQUAL(ball, pairs[0].second);
+    }
+
+    TEST(BvhFindsFirstHitAlongSweep) {
+        std::vector<BvhBox> boxes;
+        for (int i = 0; i < 20; i++) {
+            glm::vec2 center(i * 30.0f, 0.0f);
+            boxes.push_back({center - glm::vec2(10.0, 10.0), center + glm::vec2(10.0, 10.0)});
+        }
+        Bvh bvh;
+        bvh.build(boxes);
+
+        BvhHit hit;
+        CHECK(bvh.raycast(glm::vec2(45.0, 0.0), glm::vec2(1.0, 0.0), 100.0f, hit));
+        CHECK_EQUAL(2u, hit.item);
+        CHECK_CLOSE(5.0f, hit.t, 0.0001f);
+        CHECK_EQUAL(-1.0f, hit.normal.x);
+
+        CHECK(bvh.sweep(glm::vec2(5.0, 5.0), glm::vec2(300.0, 50.0), glm::vec2(0.0, -50.0), hit));
+        CHECK_EQUAL(10u, hit.item);
+        CHECK_CLOSE(0.7f, hit.t, 0.0001f);
+        CHECK_EQUAL(1.0f, hit.normal.y);
+
+        CHECK(!bvh.sweep(glm::vec2(5.0, 5.0), glm::vec2(0.0, 0.0), glm::vec2(0.0, 50.0), hit));
+
+        std::vector<std::uint32_t> found;
+        bvh.queryOverlap(glm::vec2(5.0, -1.0), glm::vec2(25.0, 1.0), [&](std::uint32_t item) {
+            found.push_back(item);
+        });
+        std::sort(found.begin(), found.end());
+        CHECK_EQUAL(2u, found.size());
+        CHECK_EQUAL(1u, found[1]);
+    }
+
+    TEST(InterceptPredictionUnfoldsWallBounces) {
+        // Straight hit without touching a wall
+        CHECK_CLOSE(50.0f, predictInterceptY(glm::vec2(0.0, 0.0), glm::vec2(2.0, 1.0), 100.0f, -100.0f, 100.0f), 0.001f);
+
+        // One bounce off the top wall at y = 100, ending 50 below it
+        CHECK_CLOSE(50.0f, predictInterceptY(glm::vec2(0.0, 0.0), glm::vec2(1.0, 1.0), 150.0f, -100.0f, 100.0f), 0.001f);
+
+        // Off the top, then the bottom wall, moving left
+        CHECK_CLOSE(-60.0f, predictInterceptY(glm::vec2(0.0, 0.0), glm::vec2(-1.0, 1.0), -340.0f, -100.0f, 100.0f), 0.001f);
+
+        // Downwards off the bottom wall
+        CHECK_CLOSE(-90.0f, foldIntoRange(-110.0f, -100.0f, 100.0f), 0.001f);
+    }
+
+    TEST(BatchControllersAgreeWithScalarControllers) {
+        PaddleField field;
+        field.paddleX = 500.0;
+        field.paddleFaceX = 485.0;
+        field.ballMinY = -325.0;
+        field.ballMaxY = 325.0;
+
+        // Approaching downwards, receding, and approaching after a bounce off the top
+        float observations[] = {
+            300.0, 100.0, 200.0,
+            0.0, 0.0, 300.0,
+            200.0, -200.0, 100.0,
+            -100.0, 0.0, 100.0,
+            0.0, 20.0, 0.0,
+            0.0, 0.0, 0.0
+        };
+        auto batch = PaddleObservationBatch::fromBuffer(observations, 3);
+        CHECK_EQUAL(200.0f, batch[2].ballPosition.x);
+        CHECK_EQUAL(100.0f, batch[2].ballVelocity.y);
+
+        float actions[3];
+        InterceptBatchController intercept(field);
+        intercept.act(batch, actions);
+        CHECK_EQUAL(-1.0f, actions[0]);
+        CHECK_EQUAL(0.0f, actions[1]);
+        CHECK_EQUAL(1.0f, actions[2]);
+
+        std::vector<std::shared_ptr<PaddleController>> controllers;
+        for (int i = 0; i < 3; i++) {
+            controllers.push_back(std::make_shared<StateMachineController>(field, true));
+        }
+        ScalarControllerBatch stateMachines(controllers);
+
+        // The state machines notice the ball on the first tick and move from the second
+        stateMachines.act(batch, actions);
+        CHECK_EQUAL(0.0f, actions[0]);
+        stateMachines.act(batch, actions);
+        CHECK_EQUAL(-1.0f, actions[0]);
+        CHECK_EQUAL(0.0f, actions[1]);
+        CHECK_EQUAL(1.0f, actions[2]);
+    }
+
+    TEST(MatchBallStopsAtWallsAndScores) {
+        MatchState match;
+        resetMatch(match, 7);
+        match.ballPosition = glm::vec2(0.0, 320.0);
+        match.ballVelocity = glm::vec2(0.0, 400.0);
+
+        // Stopped at the wall, then bounced off it on the next tick
+        CHECK(stepMatch(match, 0.0, 0.0, 0.1) == MatchEvent::None);
+        CHECK_CLOSE(325.0f, match.ballPosition.y, 0.001f);
+        stepMatch(match, 0.0, 0.0, 0.1);
+        CHECK_CLOSE(-400.0f, match.ballVelocity.y, 0.001f);
+
+        match.ballPosition = glm::vec2(-590.0, 0.0);
+        match.ballVelocity = glm::vec2(-400.0, 0.0);
+        CHECK(stepMatch(match, 1.0, 0.0, 0.1) == MatchEvent::RightScored);
+        CHECK_EQUAL(1u, match.pointsRight);
+        CHECK_EQUAL(0.0f, match.ballPosition.x);
+        CHECK_CLOSE(30.0f, match.leftPaddleY, 0.001f);
+    }
+
+    TEST(MatchStepsByTheRulesOfTheGame) {
+        // Paddles go no faster than full speed and no further than the limit
+        CHECK_EQUAL(PaddleSpeed, paddleVelocity(2.0f));
+        CHECK_EQUAL(-PaddleSpeed, paddleVelocity(-1.0f));
+        CHECK_EQUAL(LimitY, constrainPaddleY(LimitY + 1.0f));
+
+        MatchState match;
+        resetMatch(match, 7);
+        match.rightPaddleY = LimitY - 1.0f;
+        stepMatch(match, 5.0, 1.0, 0.1);
+        CHECK_CLOSE(30.0f, match.leftPaddleY, 0.001f);
+        CHECK_EQUAL(LimitY, match.rightPaddleY);
+
+        // A paddle bounce moves the ball off the face before steering it
+        glm::vec2 position = glm::vec2(PaddleX - 15.0f, 10.0f);
+        glm::vec2 velocity = glm::vec2(BallSpeed, 0.0f);
+        bounceBallOffPaddle(position, velocity, glm::vec2(-1.0, 0.0), 0.0f);
+        CHECK_EQUAL(PaddleX - 15.0f - SurfaceDistance, position.x);
+        CHECK(velocity.x < 0.0f && velocity.y > 0.0f);
+
+        // Points are counted the same way, and a game is won at the same score
+        CHECK(ballScored(glm::vec2(LimitX + 1.0f, 0.0f)) == MatchEvent::LeftScored);
+        CHECK(ballScored(glm::vec2(-LimitX - 1.0f, 0.0f)) == MatchEvent::RightScored);
+        CHECK(ballScored(glm::vec2(LimitX, 0.0f)) == MatchEvent::None);
+        CHECK(!gameWon(GamePoints - 1, GamePoints - 1, GamePoints));
+        CHECK(gameWon(0, GamePoints, GamePoints));
+    }
+
+    TEST(VectorEnvMatchesSingleThreadedStepping) {
+        const std::size_t EnvCount = 7;
+        std::uint64_t seeds[EnvCount] = {1, 1, 2, 3, 4, 5, 6};
+
+        VectorEnv threaded(EnvCount, 3);
+        VectorEnv single(EnvCount, 1);
+
+        std::vector<float> observations(PaddleObservationSize * EnvCount);
+        std::vector<float> singleObservations(PaddleObservationSize * EnvCount);
+        threaded.reset(seeds, observations.data());
+        single.reset(seeds, singleObservations.data());
+
+        auto batch = PaddleObservationBatch::fromBuffer(observations.data(), EnvCount);
+        CHECK_EQUAL(0.0f, batch[4].ballPosition.x);
+        CHECK_CLOSE(BallSpeed, glm::length(batch[4].ballVelocity), 0.01f);
+
+        float actions[EnvCount];
+        float rewards[EnvCount];
+        float singleRewards[EnvCount];
+        std::uint8_t dones[EnvCount];
+        std::uint8_t singleDones[EnvCount];
+        std::uint32_t episodes = 0;
+
+        for (int tick = 0; tick < 2000; tick++) {
+            for (std::size_t i = 0; i < EnvCount; i++) {
+                actions[i] = static_cast<float>(tick % 3) - 1.0f;
+            }
+            threaded.step(actions, observations.data(), rewards, dones);
+            single.step(actions, singleObservations.data(), singleRewards, singleDones);
+
+            for (std::size_t i = 0; i < EnvCount; i++) {
+                episodes += dones[i];
+                CHECK(dones[i] || rewards[i] == 0.0f);
+            }
+            CHECK_ARRAY_EQUAL(rewards, singleRewards, EnvCount);
+        }
+
+        CHECK(episodes > 0);
+        CHECK(observations == singleObservations);
+        CHECK_EQUAL(observations[0], observations[1]);
+    }
+
+    TEST(MlpPolicyKernelsAgreeAndSurviveSaving) {
+        // Two hidden units see the height difference to the ball, one for each direction
+        MlpLayer hidden;
+        hidden.inputCount = PaddleObservationSize;
+        hidden.outputCount = 5;
+        hidden.weights.assign(hidden.inputCount * hidden.outputCount, 0.0f);
+        hidden.biases.assign(hidden.outputCount, 0.0f);
+        hidden.weights[0 * 6 + 1] = 0.1f;
+        hidden.weights[0 * 6 + 4] = -0.1f;
+        hidden.weights[1 * 6 + 1] = -0.1f;
+        hidden.weights[1 * 6 + 4] = 0.1f;
+
+        MlpLayer output;
+        output.inputCount = 5;
+        output.outputCount = 1;
+        output.weights = {1.0f, -1.0f, 0.0f, 0.0f, 0.0f};
+        output.biases = {0.0f};
+
+        MlpPolicy policy({hidden, output});
+
+        const std::size_t Count = 200;
+        std::vector<float> observations(PaddleObservationSize * Count, 0.0f);
+        for (std::size_t i = 0; i < Count; i++) {
+            observations[Count + i] = static_cast<float>(i) - 100.0f;
+        }
+        auto batch = PaddleObservationBatch::fromBuffer(observations.data(), Count);
+
+        std::vector<float> actions(Count);
+        std::vector<float> scalarActions(Count);
+        policy.act(batch, actions.data());
+        policy.setSimd(false);
+        policy.act(batch, scalarActions.data());
+
+        CHECK_ARRAY_CLOSE(actions, scalarActions, Count, 0.0001f);
+        CHECK_EQUAL(-1.0f, actions[0]);
+        CHECK_CLOSE(0.5f, actions[105], 0.0001f);
+        CHECK_EQUAL(1.0f, actions[199]);
+
+        const char* path = "pong-test-policy.mlp";
+        CHECK(policy.save(path));
+        auto loaded = MlpPolicy::load(path);
+        std::remove(path);
+
+        CHECK(loaded != nullptr);
+        CHECK_EQUAL(2u, loaded->getLayers().size());
+        CHECK_CLOSE(0.5f, loaded->act(batch[105]), 0.0001f);
+    }
+
+    TEST(WorkStealingPoolRunsEveryIndexOnce) {
+        WorkStealingPool pool(4);
+        std::vector<std::atomic<std::uint32_t>> visits(10007);
+        std::vector<std::uint32_t> perWorker(pool.size());
+        // Checks report from the test thread only, workers just count what went wrong
+        std::atomic<std::uint32_t> oversizedRanges {0};
+
+        pool.parallelFor(visits.size(), 7, [&](std::size_t worker, std::uint32_t begin, std::uint32_t end) {
+            if (end - begin > 7) {
+                oversizedRanges++;
+            }
+            for (std::uint32_t i = begin; i < end; i++) {
+                visits[i]++;
+            }
+            perWorker[worker] += end - begin;
+        });
+
+        for (const auto& count : visits) {
+            CHECK_EQUAL(1u, count.load());
+        }
+        CHECK_EQUAL(10007u, std::accumulate(perWorker.begin(), perWorker.end(), 0u));
+        CHECK_EQUAL(0u, oversizedRanges.load());
+    }
+
+    TEST(TournamentResultsDoNotDependOnThreadCount) {
+        PaddleField field = matchField();
+        std::vector<TournamentEntrant> entrants;
+        for (const char* name : {"tracking", "predictive"}) {
+            std::string controllerName = name;
+            entrants.push_back({controllerName, [controllerName, field]() {
+                return createPaddleController(controllerName, field);
+            }});
+        }
+
+        TournamentSettings settings;
+        settings.matchesPerPairing = 20;
+        settings.pointsToWin = 3;
+
+        WorkStealingPool singlePool(1);
+        WorkStealingPool pool(3);
+        TournamentResults single = runTournament(entrants, settings, singlePool);
+        TournamentResults results = runTournament(entrants, settings, pool);
+
+        CHECK_EQUAL(40u, results.matchCount);
+        CHECK(single.wins == results.wins);
+        CHECK(single.draws == results.draws);
+        CHECK_EQUAL(single.tickCount, results.tickCount);
+
+        // The predictive controller should win clearly and rate higher
+        CHECK(results.score(1, 0) > results.score(0, 1));
+        std::vector<double> ratings = fitEloRatings(results);
+        CHECK(ratings[1] > ratings[0]);
+        CHECK_CLOSE(3000.0, ratings[0] + ratings[1], 0.01);
+    }
+
+    TEST(ReplayPlaysBackRecordedActions) {
+        std::vector<std::uint8_t> bytes;
+        writeVarint(bytes, 300);
+        const std::uint8_t* cursor = bytes.data();
+        std::uint64_t value;
+        CHECK(readVarint(cursor, bytes.data() + bytes.size(), value));
+        CHECK_EQUAL(300u, value);
+        CHECK_EQUAL(2u, bytes.size());
+
+        // Seeded generators repeat themselves
+        Randomizer first(42);
+        Randomizer second(42);
+        for (int i = 0; i < 10; i++) {
+            glm::vec2 a = first.randomDirection();
+            glm::vec2 b = second.randomDirection();
+            CHECK_EQUAL(a.x, b.x);
+            CHECK_EQUAL(a.y, b.y);
+        }
+
+        ReplayHeader header;
+        header.seed = 7;
+        header.ballCount = 3;
+        header.tickTime = 1.0 / 120.0;
+
+        std::vector<float> leftActions;
+        std::vector<float> rightActions;
+        ReplayRecorder recorder(header);
+        for (std::uint32_t tick = 0; tick < 500; tick++) {
+            leftActions.push_back(tick < 100 ? 0.0f : (tick / 50 % 2 ? 1.0f : -1.0f));
+            rightActions.push_back(tick % 7 ? 0.25f * (tick % 3) : 0.0f);
+            recorder.record(tick, leftActions.back(), rightActions.back());
+        }
+
+        ReplayPlayer player;
+        CHECK(player.parse(recorder.finish(500, 1234)));
+        CHECK_EQUAL(7u, player.getHeader().seed);
+        CHECK_EQUAL(3u, player.getHeader().ballCount);
+        CHECK_EQUAL(500u, player.getTickCount());
+        CHECK_EQUAL(1234u, player.getChecksum());
+
+        for (std::uint32_t tick = 0; tick < 500; tick++) {
+            float left;
+            float right;
+            player.actionsAt(tick, left, right);
+            CHECK_EQUAL(leftActions[tick], left);
+            CHECK_EQUAL(rightActions[tick], right);
+        }
+
+        std::vector<std::uint8_t> truncated = recorder.finish(500, 1234);
+        truncated.resize(truncated.size() - 1);
+        CHECK(!player.parse(truncated));
+    }
+
+    TEST(ReplaySeeksFromKeyframes) {
+        PaddleField field = matchField();
+        TrackingController left;
+        StateMachineController right(field, true);
+
+        ReplayHeader header;
+        header.tickTime = 1.0 / 60.0;
+        ReplayRecorder recorder(header);
+
+        MatchState match;
+        resetMatch(match, 5);
+        std::vector<MatchState> states;
+        for (std::uint32_t tick = 0; tick < 2000; tick++) {
+            if (tick % 150 == 0) {
+                recorder.addKeyframe(tick, &match, sizeof(match));
+            }
+            states.push_back(match);
+
+            float leftAction = left.act(observeMatch(match, PaddleSide::Left));
+            float rightAction = right.act(observeMatch(match, PaddleSide::Right));
+            recorder.record(tick, leftAction, rightAction);
+            stepMatch(match, leftAction, rightAction, header.tickTime);
+        }
+
+        ReplayPlayer player;
+        CHECK(player.parse(recorder.finish(2000, 0)));
+        CHECK_EQUAL(14u, player.getKeyframes().size());
+
+        for (std::uint32_t target : {0u, 149u, 150u, 777u, 1999u, 1234u}) {
+            const ReplayKeyframe* keyframe = player.seek(target);
+            CHECK(keyframe);
+            CHECK_EQUAL(target / 150 * 150, keyframe->tick);
+            CHECK_EQUAL(sizeof(MatchState), keyframe->stateSize);
+
+            MatchState seeked;
+            std::memcpy(&seeked, player.keyframeState(*keyframe), sizeof(seeked));
+            while (seeked.tick < target) {
+                float leftAction;
+                float rightAction;
+                player.actionsAt(seeked.tick, leftAction, rightAction);
+                stepMatch(seeked, leftAction, rightAction, header.tickTime);
+            }
+
+            CHECK_EQUAL(states[target].ballPosition.x, seeked.ballPosition.x);
+            CHECK_EQUAL(states[target].ballPosition.y, seeked.ballPosition.y);
+            CHECK_EQUAL(states[target].rightPaddleY, seeked.rightPaddleY);
+            CHECK_EQUAL(states[target].random.getState(), seeked.random.getState());
+        }
+    }
+
+    TEST(SnapshotsRestoreBodiesAndControllers) {
+        GameSnapshot snapshot;
+        GameSnapshotHeader& header = snapshot.reset(3, 2);
+        header.tick = 99;
+        header.randomState = 0x123456789ull;
+        for (std::uint32_t i = 0; i < 3; i++) {
+            snapshot.transforms()[i].position = glm::vec2(i, -1.0f * i);
+        }
+        snapshot.velocities()[1].value = glm::vec2(5.0, 6.0);
+
+        GameSnapshot copy;
+        CHECK(copy.assign(snapshot.data(), snapshot.size()));
+        CHECK_EQUAL(99u, copy.getHeader().tick);
+        CHECK_EQUAL(0x123456789ull, copy.getHeader().randomState);
+        CHECK_EQUAL(-2.0f, copy.transforms()[2].position.y);
+        CHECK_EQUAL(6.0f, copy.velocities()[1].value.y);
+
+        CHECK(!copy.assign(snapshot.data(), snapshot.size() - 1));
+        std::vector<std::uint8_t> otherVersion(snapshot.data(), snapshot.data() + snapshot.size());
+        otherVersion[4]++;
+        CHECK(!copy.assign(otherVersion.data(), otherVersion.size()));
+
+        // A restored controller carries on as the original does
+        StateMachineController original(matchField(), true);
+        MatchState match;
+        resetMatch(match, 3);
+        for (int i = 0; i < 200; i++) {
+            stepMatch(match, 0.0, original.act(observeMatch(match, PaddleSide::Right)), 1.0 / 60.0);
+        }
+
+        StateMachineController restored(matchField(), true);
+        restored.restoreState(original.saveState());
+        CHECK(restored.getState() == original.getState());
+        for (int i = 0; i < 200; i++) {
+            PaddleObservation observation = observeMatch(match, PaddleSide::Right);
+            float action = original.act(observation);
+            CHECK_EQUAL(action, restored.act(observation));
+            stepMatch(match, 0.0, action, 1.0 / 60.0);
+        }
+    }
+
+    TEST(RollbackPeersAgreeOverLossyLoopback) {
+        const std::uint32_t TickCount = 600;
+        RollbackSettings settings;
+
+        // Inputs change every few ticks, and the input delay leaves the first ticks idle
+        Randomizer random(11);
+        std::vector<std::int8_t> inputs[2];
+        for (auto& playerInputs : inputs) {
+            std::int8_t input = 0;
+            for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+                if (random.random() < 0.1f) {
+                    input = static_cast<std::int8_t>(random.random() * 3.0f) - 1;
+                }
+                playerInputs.push_back(tick < settings.inputDelay ? 0 : input);
+            }
+        }
+
+        MatchRollbackGame reference;
+        resetMatch(reference.match, 8);
+        for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+            reference.advance(inputs[0][tick], inputs[1][tick]);
+        }
+
+        UdpSocket sockets[2];
+        CHECK(sockets[0].open(0));
+        CHECK(sockets[1].open(0));
+        sockaddr_in addresses[2] = {
+            UdpSocket::makeAddress(INADDR_LOOPBACK, sockets[0].getPort()),
+            UdpSocket::makeAddress(INADDR_LOOPBACK, sockets[1].getPort())
+        };
+
+        LinkConditions conditions;
+        conditions.latency = 0.04;
+        conditions.jitter = 0.03;
+        conditions.loss = 0.2;
+        LinkShim shims[2] = {LinkShim(sockets[0], conditions, 1), LinkShim(sockets[1], conditions, 2)};
+
+        MatchRollbackGame games[2];
+        resetMatch(games[0].match, 8);
+        resetMatch(games[1].match, 8);
+        RollbackSession<MatchRollbackGame> sessions[2] = {
+            RollbackSession<MatchRollbackGame>(games[0], PaddleSide::Left, settings),
+            RollbackSession<MatchRollbackGame>(games[1], PaddleSide::Right, settings)
+        };
+
+        // Virtual time moves a tick per round, the shims release datagrams by it
+        std::vector<std::uint8_t> packet;
+        std::uint8_t buffer[256];
+        for (std::uint32_t round = 0; round < TickCount * 4; round++) {
+            double now = round / 60.0;
+            bool done = true;
+
+            for (int peer = 0; peer < 2; peer++) {
+                sockaddr_in from;
+                while (std::size_t size = sockets[peer].receive(buffer, sizeof(buffer), from)) {
+                    CHECK(sessions[peer].receive(buffer, size));
+                }
+
+                RollbackSession<MatchRollbackGame>& session = sessions[peer];
+                std::uint32_t inputTick = session.getTick() + settings.inputDelay;
+                if (session.getTick() < TickCount && session.canAdvance()) {
+                    session.advance(inputTick < TickCount ? inputs[peer][inputTick] : 0);
+                } else {
+                    session.synchronize();
+                }
+
+                session.writePacket(packet);
+                shims[peer].send(addresses[1 - peer], packet.data(), packet.size(), now);
+                shims[peer].flush(now);
+                done = done && session.getConfirmedTick() == TickCount;
+            }
+
+            if (done) {
+                break;
+            }
+        }
+
+        for (int peer = 0; peer < 2; peer++) {
+            const MatchState& match = games[peer].match;
+            CHECK_EQUAL(TickCount, sessions[peer].getConfirmedTick());
+            CHECK_EQUAL(reference.match.tick, match.tick);
+            CHECK_EQUAL(reference.match.ballPosition.x, match.ballPosition.x);
+            CHECK_EQUAL(reference.match.ballPosition.y, match.ballPosition.y);
+            CHECK_EQUAL(reference.match.leftPaddleY, match.leftPaddleY);
+            CHECK_EQUAL(reference.match.rightPaddleY, match.rightPaddleY);
+            CHECK_EQUAL(reference.match.random.getState(), match.random.getState());
+            CHECK(sessions[peer].getStats().rollbacks > 0);
+            CHECK(sessions[peer].getStats().maxRollbackDepth <= settings.maxPrediction);
+            CHECK(sessions[peer].getStats().comparedChecksums > 0);
+            CHECK(!sessions[peer].hasDesynced());
+        }
+        CHECK(shims[0].getDropped() > 0);
+    }
+
+    TEST(RollbackSessionsReportMismatchedStartsAndDesyncs) {
+        // Packets go straight across, a round at a time
+        auto play = [](RollbackSession<MatchRollbackGame>* sessions, std::uint32_t rounds) {
+            std::vector<std::uint8_t> packets[2];
+            for (std::uint32_t round = 0; round < rounds; round++) {
+                for (int peer = 0; peer < 2; peer++) {
+                    if (sessions[peer].canAdvance()) {
+                        sessions[peer].advance(0);
+                    }
+                    sessions[peer].writePacket(packets[peer]);
+                }
+                for (int peer = 0; peer < 2; peer++) {
+                    CHECK(sessions[1 - peer].receive(packets[peer].data(), packets[peer].size()));
+                }
+            }
+        };
+
+        MatchRollbackGame games[2];
+        resetMatch(games[0].match, 8);
+        resetMatch(games[1].match, 8);
+        RollbackSettings settings[2];
+        settings[0].configuration = 1;
+        settings[1].configuration = 2;
+        RollbackSession<MatchRollbackGame> mismatched[2] = {
+            RollbackSession<MatchRollbackGame>(games[0], PaddleSide::Left, settings[0]),
+            RollbackSession<MatchRollbackGame>(games[1], PaddleSide::Right, settings[1])
+        };
+        play(mismatched, 10);
+        for (auto& session : mismatched) {
+            CHECK(session.hasMismatchedStart());
+            CHECK_EQUAL(0u, session.getTick());
+        }
+
+        // The same configuration with games that went apart anyway
+        resetMatch(games[1].match, 9);
+        RollbackSession<MatchRollbackGame> desynced[2] = {
+            RollbackSession<MatchRollbackGame>(games[0], PaddleSide::Left, settings[0]),
+            RollbackSession<MatchRollbackGame>(games[1], PaddleSide::Right, settings[0])
+        };
+        play(desynced, 200);
+        for (auto& session : desynced) {
+            CHECK(!session.hasMismatchedStart());
+            CHECK(session.hasDesynced());
+            CHECK_EQUAL(settings[0].checksumInterval, session.getDesyncTick());
+        }
+    }
+
+    TEST(MatchShardServesItsMatchesOverUdp) {
+        MatchServerSettings settings;
+        settings.matchCount = 10;
+        settings.shardCount = 3;
+
+        MatchShard shard(1, settings);
+        CHECK(shard.open(0, INADDR_LOOPBACK));
+        sockaddr_in server = UdpSocket::makeAddress(INADDR_LOOPBACK, shard.getPort());
+
+        UdpSocket client;
+        CHECK(client.open(0));
+
+        // Match 4 is on shard 1, match 5 is not and is ignored
+        std::uint8_t bytes[MaxServerStateSize];
+        for (std::uint32_t matchIndex : {4u, 5u}) {
+            ServerInput input;
+            input.match = matchIndex;
+            input.side = PaddleSide::Right;
+            input.action = 1;
+            encodeServerInput(input, bytes);
+            CHECK(client.send(server, bytes, ServerInputSize));
+        }
+
+        shard.receiveInputs();
+        shard.tick();
+        shard.tick();
+        CHECK_EQUAL(2u, shard.getStats().received.load());
+        CHECK_EQUAL(2u, shard.getStats().sent.load());
+
+        // Nothing was acknowledged, so both states stand alone
+        DeltaSnapshotCodec codec(settings.tickRate);
+        SnapshotHistory history;
+        QuantizedMatch state;
+        for (std::uint32_t tick = 1; tick <= 2; tick++) {
+            sockaddr_in from;
+            std::size_t size = client.receive(bytes, sizeof(bytes), from);
+
+            std::uint32_t matchIndex;
+            CHECK(decodeServerStateMatch(bytes, size, matchIndex));
+            CHECK_EQUAL(4u, matchIndex);
+            CHECK(decodeServerState(bytes, size, codec, history, state));
+            CHECK_EQUAL(tick, state.tick);
+            CHECK_EQUAL(quantize(PaddleSpeed * tick / settings.tickRate), state.rightPaddleY);
+            CHECK_EQUAL(0, state.leftPaddleY);
+        }
+        CHECK_EQUAL(quantize(shard.getMatch(4).ballPosition.x), state.ballX);
+        CHECK_EQUAL(quantize(shard.getMatch(4).ballVelocity.y), state.velocityY);
+
+        // Once the client acknowledges a state the next one is a delta against it
+        ServerInput input;
+        input.match = 4;
+        input.side = PaddleSide::Right;
+        input.acknowledgedTick = 2;
+        encodeServerInput(input, bytes);
+        CHECK(client.send(server, bytes, ServerInputSize));
+        shard.receiveInputs();
+        shard.tick();
+
+        sockaddr_in from;
+        std::size_t size = client.receive(bytes, sizeof(bytes), from);
+        CHECK(size < ServerStateHeaderSize + 8);
+        CHECK(decodeServerState(bytes, size, codec, history, state));
+        CHECK_EQUAL(3u, state.tick);
+        CHECK_EQUAL(quantize(shard.getMatch(4).ballPosition.y), state.ballY);
+    }
+
+    TEST(MatchShardSendsStatesToEveryWatcher) {
+        MatchServerSettings settings;
+        settings.matchCount = 1;
+
+        MatchShard shard(0, settings);
+        CHECK(shard.open(0, INADDR_LOOPBACK));
+        sockaddr_in server = UdpSocket::makeAddress(INADDR_LOOPBACK, shard.getPort());
+
+        // One watcher more than a match takes, the first watches twice without taking two slots
+        std::uint8_t bytes[MaxServerStateSize];
+        ServerWatch watch;
+        encodeServerWatch(watch, bytes);
+        std::vector<std::unique_ptr<UdpSocket>> watchers;
+        for (std::size_t i = 0; i <= MaxMatchWatchers; i++) {
+            watchers.push_back(std::make_unique<UdpSocket>());
+            CHECK(watchers.back()->open(0));
+            CHECK(watchers.back()->send(server, bytes, ServerWatchSize));
+        }
+        CHECK(watchers[0]->send(server, bytes, ServerWatchSize));
+
+        shard.receiveInputs();
+        shard.tick();
+        CHECK_EQUAL(1u, shard.getStats().rejectedWatches.load());
+        CHECK_EQUAL(MaxMatchWatchers, shard.getStats().sent.load());
+
+        for (std::size_t i = 0; i <= MaxMatchWatchers; i++) {
+            sockaddr_in from;
+            std::size_t size = watchers[i]->receive(bytes, sizeof(bytes), from);
+            std::uint32_t matchIndex;
+            CHECK_EQUAL(i < MaxMatchWatchers, decodeServerStateMatch(bytes, size, matchIndex));
+        }
+    }
+
+#if defined(__linux__)
+    TEST(RelaySharesEachFrameBetweenSpectators) {
+        MatchServerSettings serverSettings;
+        serverSettings.matchCount = 2;
+        MatchShard shard(0, serverSettings);
+        CHECK(shard.open(0, INADDR_LOOPBACK));
+
+        RelaySettings settings;
+        settings.matchCount = 2;
+        settings.serverPort = shard.getPort();
+        SpectatorRelay relay(settings);
+        CHECK(relay.open(0, INADDR_LOOPBACK));
+
+        std::vector<std::unique_ptr<SpectatorClient>> spectators;
+        for (int i = 0; i < 3; i++) {
+            spectators.push_back(std::make_unique<SpectatorClient>(settings.tickRate));
+            CHECK(spectators.back()->connect(INADDR_LOOPBACK, relay.getPort()));
+            CHECK(spectators.back()->watch(1));
+        }
+        // Every loop waiting on the sockets gives up after a few seconds rather than hang
+        const int MaxRounds = 50;
+        for (int round = 0; round < MaxRounds && relay.getStats().connections.load() < 3; round++) {
+            relay.poll(100);
+        }
+        CHECK_EQUAL(3u, relay.getStats().connections.load());
+        relay.poll(10);
+
+        // The relay acknowledges each state before the next tick, so every one is a delta
+        const std::uint32_t TickCount = 10;
+        for (std::uint32_t tick = 0; tick < TickCount; tick++) {
+            relay.sendWatches();
+            shard.receiveInputs();
+            shard.tick();
+            for (int round = 0; round < MaxRounds && relay.getStats().upstreamStates.load() < (tick + 1) * settings.matchCount; round++) {
+                relay.poll(100);
+            }
+            CHECK_EQUAL((tick + 1) * settings.matchCount, relay.getStats().upstreamStates.load());
+        }
+
+        QuantizedMatch expected = quantizeMatch(shard.getMatch(1));
+        for (auto& spectator : spectators) {
+            QuantizedMatch last;
+            std::uint32_t frames = 0;
+            for (int round = 0; round < MaxRounds * 100 && last.tick < expected.tick; round++) {
+                relay.poll(1);
+                CHECK(spectator->receive([&](std::uint32_t matchIndex, const QuantizedMatch& state, std::size_t) {
+                    CHECK_EQUAL(1u, matchIndex);
+                    last = state;
+                    frames++;
+                }));
+            }
+            CHECK_EQUAL(expected.tick, last.tick);
+            CHECK_EQUAL(TickCount, frames);
+            CHECK_EQUAL(0, std::memcmp(&expected, &last, sizeof(last)));
+        }
+
+        // One standalone frame and then one delta per tick, whatever the spectator count
+        CHECK_EQUAL(TickCount, relay.getStats().encodedFrames.load());
+        CHECK_EQUAL(TickCount * 3, relay.getStats().queuedFrames.load());
+    }
+
+    TEST(SpectatorClientRejectsOversizedFrames) {
+        int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = UdpSocket::makeAddress(INADDR_LOOPBACK, 0);
+        socklen_t length = sizeof(address);
+        CHECK_EQUAL(0, ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+        CHECK_EQUAL(0, ::listen(listener, 1));
+        CHECK_EQUAL(0, ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length));
+
+        SpectatorClient spectator(RelaySettings().tickRate);
+        CHECK(spectator.connect(INADDR_LOOPBACK, ntohs(address.sin_port)));
+        CHECK(spectator.watch(1));
+        int connection = ::accept(listener, nullptr, nullptr);
+        CHECK(connection >= 0);
+
+        // The length byte claims more than any frame holds, and more than that follows it
+        std::uint8_t bytes[256] = {};
+        bytes[0] = 255;
+        CHECK_EQUAL(static_cast<ssize_t>(sizeof(bytes)), ::send(connection, bytes, sizeof(bytes), MSG_NOSIGNAL));
+
+        pollfd request = {spectator.getDescriptor(), POLLIN, 0};
+        CHECK_EQUAL(1, ::poll(&request, 1, 1000));
+        std::uint32_t frames = 0;
+        CHECK(!spectator.receive([&](std::uint32_t, const QuantizedMatch&, std::size_t) {
+            frames++;
+        }));
+        CHECK_EQUAL(0u, frames);
+
+        ::close(connection);
+        ::close(listener);
+    }
+#endif
+
+    TEST(JitterBufferDrawsSmoothlyThroughJitter) {
+        const double TickTime = 1.0 / 60;
+        const double FrameTime = 1.0 / 144;
+
+        // Snapshots of a match sent every tick arrive 20 ms late plus up to 30 ms of jitter
+        MatchState match;
+        resetMatch(match, 5);
+        std::vector<std::pair<double, QuantizedMatch>> arrivals;
+        Randomizer random(9);
+        for (int tick = 0; tick < 600; tick++) {
+            stepMatch(match, 0.0f, 0.0f, static_cast<float>(TickTime));
+            arrivals.push_back({match.tick * TickTime + 0.02 + 0.03 * random.random(), quantizeMatch(match)});
+        }
+        std::sort(arrivals.begin(), arrivals.end(), [](const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+
+        JitterBuffer buffer(TickTime);
+        RemoteMatchView view;
+        RemoteMatchView previous;
+        std::size_t next = 0;
+        std::uint32_t jumps = 0;
+        std::uint32_t extrapolated = 0;
+        for (double now = 0.0; next < arrivals.size(); now += FrameTime) {
+            while (next < arrivals.size() && arrivals[next].first <= now) {
+                buffer.add(arrivals[next].second, arrivals[next].first);
+                next++;
+            }
+            if (!buffer.sample(now, view)) {
+                continue;
+            }
+
+            // Once the delay has settled the buffer never runs dry and the ball never moves
+            // further in a frame than it can, apart from when a point puts it back
+            bool scored = view.pointsLeft != previous.pointsLeft || view.pointsRight != previous.pointsRight;
+            if (now > 1.0 && !scored && glm::length(view.ballPosition - previous.ballPosition) > BallSpeed * FrameTime * 1.5) {
+                jumps++;
+            }
+            extrapolated += now > 1.0 && view.extrapolated;
+            previous = view;
+        }
+
+        CHECK_EQUAL(0u, jumps);
+        CHECK_EQUAL(0u, extrapolated);
+        CHECK(buffer.getDelay() > 0.03 && buffer.getDelay() < 0.1);
+
+        // Once the network calms down the delay comes back towards one snapshot interval
+        double last = arrivals.back().first;
+        for (int tick = 0; tick < 1200; tick++) {
+            stepMatch(match, 0.0f, 0.0f, static_cast<float>(TickTime));
+            double now = last + (tick + 1) * TickTime;
+            buffer.add(quantizeMatch(match), now);
+            buffer.sample(now, view);
+            buffer.sample(now + TickTime / 2, view);
+        }
+        CHECK(buffer.getTargetDelay() < TickTime * 1.5);
+        CHECK(buffer.getDelay() < 0.04);
+    }
+
+    TEST(DeltaSnapshotsRoundTripInFewBytes) {
+        DeltaSnapshotCodec codec(60);
+        MatchState match;
+        resetMatch(match, 3);
+
+        // Deltas decode exactly to what was encoded, and mostly only the paddles and the
+        // rounding of the ball cost more than a bit
+        QuantizedMatch previous = quantizeMatch(match);
+        std::size_t totalSize = 0;
+        std::uint8_t bytes[MaxDeltaSnapshotSize];
+        for (int tick = 0; tick < 600; tick++) {
+            PaddleObservation left = observeMatch(match, PaddleSide::Left);
+            PaddleObservation right = observeMatch(match, PaddleSide::Right);
+            stepMatch(match,
+                static_cast<float>(steerTowards(left.ballPosition.y, left.paddleY, BallToleranceY)),
+                static_cast<float>(steerTowards(right.ballPosition.y, right.paddleY, BallToleranceY)),
+                1.0f / 60);
+
+            QuantizedMatch current = quantizeMatch(match);
+            std::size_t size = codec.encode(current, &previous, bytes);
+            totalSize += size;
+
+            QuantizedMatch decoded;
+            CHECK(codec.decode(bytes, size, &previous, decoded));
+            CHECK_EQUAL(0, std::memcmp(&current, &decoded, sizeof(current)));
+            previous = current;
+        }
+        CHECK(totalSize < 600 * 6);
+
+        // Standing alone costs more but needs no baseline
+        std::size_t size = codec.encode(previous, nullptr, bytes);
+        CHECK(size <= MaxDeltaSnapshotSize);
+        QuantizedMatch decoded;
+        CHECK(codec.decode(bytes, size, nullptr, decoded));
+        CHECK_EQUAL(0, std::memcmp(&previous, &decoded, sizeof(previous)));
+
+        // A delta against a baseline the receiver does not have is refused, as is a cut one
+        std::uint8_t other[MaxDeltaSnapshotSize];
+        QuantizedMatch older = previous;
+        older.tick -= 5;
+        size = codec.encode(previous, &older, other);
+        CHECK(!codec.decode(other, size, &previous, decoded));
+        CHECK(!codec.decode(other, 1, &older, decoded));
+    }
+
+    TEST(StreamRingReservesAlignedRegionsPerFrame) {
+        StreamRing ring(256, 3);
+        std::uint32_t offset;
+
+        CHECK(ring.reserve(10, 16, offset));
+        CHECK_EQUAL(0u, offset);
+        CHECK(ring.reserve(10, 16, offset));
+        CHECK_EQUAL(16u, offset);
+        CHECK(!ring.reserve(250, 16, offset));
+
+        ring.advance();
+        CHECK(ring.reserve(256, 16, offset));
+        CHECK_EQUAL(256u, offset);
+
+        ring.advance();
+        ring.advance();
+        CHECK_EQUAL(0u, ring.frameOffset());
+    }
+
+    TEST(FrameArenaAndPoolsAllocateNothingOnceWarm) {
+        FrameArena arena(4096);
+        ObjectPool<std::uint64_t> pool(2);
+        AllocationWatch allocations;
+
+        CHECK(arena.allocate(3, 1) != nullptr);
+        double* values = arena.allocateArray<double>(4);
+        CHECK(values != nullptr);
+        CHECK_EQUAL(0u, reinterpret_cast<std::uintptr_t>(values) % alignof(double));
+        std::size_t used = arena.getUsed();
+
+        {
+            ArenaScope scratch(arena);
+            ArenaVector<std::uint32_t> numbers {ArenaAllocator<std::uint32_t>(arena)};
+            for (std::uint32_t i = 0; i < 100; i++) {
+                numbers.push_back(i);
+            }
+            CHECK(arena.owns(numbers.data()));
+            CHECK_EQUAL(99u, numbers.back());
+        }
+        CHECK_EQUAL(used, arena.getUsed());
+        CHECK(arena.getHighWater() > used);
+
+        std::uint64_t* first = pool.acquire();
+        std::uint64_t* second = pool.acquire();
+        CHECK(first != nullptr && second != nullptr && first != second);
+        CHECK(pool.acquire() == nullptr);
+        pool.release(first);
+        CHECK(pool.acquire() == first);
+        CHECK_EQUAL(2u, pool.getHighWater());
+
+        CHECK_EQUAL(0u, allocations.count());
+
+        // What does not fit still works, from the heap
+        {
+            ArenaVector<std::uint8_t> large(8192, ArenaAllocator<std::uint8_t>(arena));
+            CHECK(!arena.owns(large.data()));
+            CHECK_EQUAL(1u, arena.getOverflows());
+        }
+        arena.reset();
+        CHECK_EQUAL(0u, arena.getUsed());
+
+        if (AllocationTrackingEnabled) {
+            CHECK_EQUAL(1u, allocations.count());
+            std::vector<int> heap(10);
+            CHECK_EQUAL(2u, allocations.count());
+        }
+    }
+
+    TEST(MemoryTrackerChargesTagsAndGpuObjects) {
+        if (MemoryTracker::tracksHeap()) {
+            MemoryTagStats before = memoryTracker().getHeapStats(MemoryTag::Image);
+            std::vector<std::uint8_t> pixels;
+            {
+                MemoryTagScope memoryTag(MemoryTag::Image);
+                pixels.resize(1000);
+            }
+            MemoryTagStats during = memoryTracker().getHeapStats(MemoryTag::Image);
+            CHECK_EQUAL(before.liveBytes + 1000, during.liveBytes);
+            CHECK_EQUAL(before.allocations + 1, during.allocations);
+            CHECK(during.highWaterBytes >= during.liveBytes);
+
+            // Freed outside its scope, still credited to the tag it was charged to
+            std::vector<std::uint8_t>().swap(pixels);
+            CHECK_EQUAL(before.liveBytes, memoryTracker().getHeapStats(MemoryTag::Image).liveBytes);
+        }
+
+        MemoryTracker tracker;
+        tracker.addGpuObject(GpuObjectKind::Texture, 3, 100);
+        tracker.addGpuObject(GpuObjectKind::VertexBuffer, 3, 64);
+        tracker.addGpuObject(GpuObjectKind::IndexBuffer, 4, 32);
+        CHECK_EQUAL(100u, tracker.getGpuStats(MemoryTag::Image).bytes);
+        CHECK_EQUAL(96u, tracker.getGpuStats(MemoryTag::Mesh).bytes);
+        CHECK_EQUAL(3u, tracker.getGpuTotal().objectCount);
+
+        tracker.addGpuObject(GpuObjectKind::Texture, 3, 50);
+        tracker.removeGpuObject(GpuNamespace::Buffer, 4);
+        tracker.removeGpuObject(GpuNamespace::Buffer, 5);
+        CHECK_EQUAL(50u, tracker.getGpuStats(MemoryTag::Image).bytes);
+        CHECK_EQUAL(100u, tracker.getGpuStats(MemoryTag::Image).highWaterBytes);
+        CHECK_EQUAL(114u, tracker.getGpuTotal().bytes);
+        CHECK_EQUAL(196u, tracker.getGpuTotal().highWaterBytes);
+
+        // Buffers of every kind share names, a new one under a name replaces the old
+        tracker.addGpuObject(GpuObjectKind::UniformBuffer, 3, 16);
+        CHECK_EQUAL(0u, tracker.getGpuStats(MemoryTag::Mesh).bytes);
+        CHECK_EQUAL(16u, tracker.getGpuStats(MemoryTag::Renderer).bytes);
+        CHECK_EQUAL(2u, tracker.getGpuTotal().objectCount);
+
+        std::ostringstream json;
+        tracker.writeJson(json);
+        CHECK(json.str().find("{\"kind\": \"texture\", \"name\": 3, \"tag\": \"image\", \"bytes\": 50}") != std::string::npos);
+        CHECK(json.str().find("\"simulation\": {") != std::string::npos);
+
+        tracker.clearGpuObjects();
+        CHECK_EQUAL(0u, tracker.getGpuTotal().bytes);
+        CHECK(tracker.getGpuObjects().empty());
     }
 
 }
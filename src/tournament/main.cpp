@@ -0,0 +1,145 @@
+#include "Match.h"
+#include "MlpPolicy.h"
+#include "PaddleController.h"
+#include "Tournament.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+void printUsage() {
+    std::printf("Usage: pong-tournament [--matches N] [--points N] [--threads N] [--seed N] [--mlp PATH]...\n");
+    std::printf("Plays N matches for every ordered pair of controllers, first to the given points.\n");
+}
+
+std::vector<TournamentEntrant> builtInEntrants() {
+    std::vector<TournamentEntrant> entrants;
+    PaddleField field = matchField();
+
+    for (const char* name : {"tracking", "state-machine", "predictive"}) {
+        std::string controllerName = name;
+        entrants.push_back({controllerName, [controllerName, field]() {
+            return createPaddleController(controllerName, field);
+        }});
+    }
+    return entrants;
+}
+
+void printRatings(const std::vector<TournamentEntrant>& entrants, const TournamentResults& results) {
+    std::vector<double> ratings = fitEloRatings(results);
+    std::vector<std::size_t> order(entrants.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return ratings[a] > ratings[b];
+    });
+
+    std::printf("%-24s %8s %10s %10s %10s\n", "controller", "elo", "won", "drawn", "lost");
+    for (std::size_t a : order) {
+        std::uint64_t won = 0;
+        std::uint64_t drawn = 0;
+        std::uint64_t lost = 0;
+        for (std::size_t b = 0; b < entrants.size(); b++) {
+            won += results.wins[a * results.entrantCount + b];
+            drawn += results.draws[a * results.entrantCount + b];
+            lost += results.wins[b * results.entrantCount + a];
+        }
+        std::printf("%-24s %8.0f %10llu %10llu %10llu\n",
+            entrants[a].name.c_str(),
+            ratings[a],
+            static_cast<unsigned long long>(won),
+            static_cast<unsigned long long>(drawn),
+            static_cast<unsigned long long>(lost));
+    }
+    std::printf("\n");
+
+    std::printf("Score of row against column, draws count half\n");
+    std::printf("%-24s", "");
+    for (std::size_t b = 0; b < entrants.size(); b++) {
+        std::printf(" %8zu", b + 1);
+    }
+    std::printf("\n");
+
+    for (std::size_t a = 0; a < entrants.size(); a++) {
+        std::printf("%zu %-22s", a + 1, entrants[a].name.c_str());
+        for (std::size_t b = 0; b < entrants.size(); b++) {
+            double games = results.games(a, b);
+            if (a == b || games == 0.0) {
+                std::printf(" %8s", "-");
+            } else {
+                std::printf(" %7.1f%%", 100.0 * results.score(a, b) / games);
+            }
+        }
+        std::printf("\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    TournamentSettings settings;
+    std::size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<TournamentEntrant> entrants = builtInEntrants();
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (option == "--matches") {
+            settings.matchesPerPairing = std::max(1, std::stoi(value));
+        } else if (option == "--points") {
+            settings.pointsToWin = std::max(1, std::stoi(value));
+        } else if (option == "--threads") {
+            threadCount = std::max(1, std::stoi(value));
+        } else if (option == "--seed") {
+            settings.seed = std::stoull(value);
+        } else if (option == "--mlp") {
+            auto policy = MlpPolicy::load(value);
+            if (!policy) {
+                std::fprintf(stderr, "Could not load policy %s\n", value.c_str());
+                return 1;
+            }
+            entrants.push_back({"mlp:" + value, [policy]() {
+                return std::static_pointer_cast<PaddleController>(policy);
+            }});
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::uint64_t matchCount = static_cast<std::uint64_t>(entrants.size()) * (entrants.size() - 1) *
+        settings.matchesPerPairing;
+    if (matchCount > UINT32_MAX) {
+        std::fprintf(stderr, "Too many matches, at most %u can be played at once\n", UINT32_MAX);
+        return 1;
+    }
+
+    std::printf("%zu controllers, %llu matches on %zu threads\n\n",
+        entrants.size(),
+        static_cast<unsigned long long>(matchCount),
+        threadCount);
+
+    WorkStealingPool pool(threadCount);
+    auto start = std::chrono::high_resolution_clock::now();
+    TournamentResults results = runTournament(entrants, settings, pool);
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    printRatings(entrants, results);
+
+    std::printf("\n%.2f s, %.0f matches/s, %.0f ticks/s\n",
+        elapsed.count(),
+        results.matchCount / elapsed.count(),
+        results.tickCount / elapsed.count());
+
+    return 0;
+}